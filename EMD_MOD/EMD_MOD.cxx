@@ -17,7 +17,7 @@ void mexFunction(int nout, mxArray *out[],
 	size_t NBO= OP_mex_utils::getLength(in[0]);	
 
 #ifndef NDEBUG
-	if (OP_mex_utils::getLength(in[1])~=NBO) {
+	if (OP_mex_utils::getLength(in[1])!=NBO) {
 		mexErrMsgTxt("Input vectors do not have the same length.");
 	}
 	if (NBO%2!=0) {
@@ -40,28 +40,13 @@ void mexFunction(int nout, mxArray *out[],
 	if (nout==1) {
 		(*dist)= EMD_MOD<false>(P, Q, NBO);
 	} else {
-		std::vector< std::list< std::pair<int,double> > > flows;
-
-		(*dist)= EMD_MOD<true>(P, Q, NBO, &flows);
-		
-		int nzmax= 2*NBO;
+		int nzmax= EMD_MOD_maxFlowsNum(NBO);
 		out[1] = mxCreateSparse(NBO, NBO, nzmax, mxREAL);
 
-		double* sr= mxGetPr(out[1]);
-		mwIndex* irs= mxGetIr(out[1]);
-		mwIndex* jcs= mxGetJc(out[1]);
-		mwIndex sparseInd= 0;
-		for (mwIndex c= 0; c<NBO; ++c) {
-            jcs[c]= sparseInd;
-			for (std::list< std::pair<int,double> >::const_iterator it= flows[c].begin();
-                 it!= flows[c].end();
-                 ++it) {
-                irs[sparseInd]= it->first; 
-                sr[sparseInd]= it->second;
-                ++sparseInd;
-            }
-		}
-		jcs[NBO]= sparseInd;
+		// The flows are written directly into the sparse matrix
+		EmdModWorkspace ws(false, NBO);
+		(*dist)= EMD_MOD_sparseFlows(P, Q, NBO, ws,
+									 mxGetIr(out[1]), mxGetPr(out[1]), mxGetJc(out[1]));
 
 	} // needed to compute flows
     
@@ -23,6 +23,291 @@ struct CompByVec {
 //-------------------------------------------------------------
 
 
+//-------------------------------------------------------------
+template<typename T, typename COMP>
+void insertionSort(T* v, int n, COMP comp) {
+	for (int i= 1; i<n; ++i) {
+		T x= v[i];
+		int j= i;
+		for (; j>0 && comp(x,v[j-1]); --j) {
+			v[j]= v[j-1];
+		}
+		v[j]= x;
+	}
+} // end insertionSort
+
+/// Rearranges v[0..n) like std::nth_element(v, v+k, v+n, comp):
+/// v[k] is the element that would be there if v was sorted, no element
+/// before it is greater and no element after it is smaller.
+/// Worst case linear time (median of medians pivots, Blum et al. 1973),
+/// with a three way partition so that equal elements do not slow it down.
+template<typename T, typename COMP>
+void medianOfMediansSelect(T* v, int n, int k, COMP comp) {
+
+	assert(k>=0&&k<n);
+	while (n>5) {
+
+		// The medians of groups of 5 are moved to v[0..groups)
+		int groups= 0;
+		for (int g= 0; g<n; g+= 5, ++groups) {
+			int m= std::min(5, n-g);
+			insertionSort(v+g, m, comp);
+			std::swap(v[groups], v[g+(m-1)/2]);
+		}
+		medianOfMediansSelect(v, groups, (groups-1)/2, comp);
+		const T pivot= v[(groups-1)/2];
+
+		// v[0..lt) < pivot, v[lt..gt) == pivot, v[gt..n) > pivot
+		int lt= 0, i= 0, gt= n;
+		while (i<gt) {
+			if (comp(v[i],pivot)) {
+				std::swap(v[lt++], v[i++]);
+			} else if (comp(pivot,v[i])) {
+				std::swap(v[i], v[--gt]);
+			} else {
+				++i;
+			}
+		}
+		if (k<lt) {
+			n= lt;
+		} else if (k>=gt) {
+			v+= gt;
+			k-= gt;
+			n-= gt;
+		} else {
+			return;
+		}
+		
+	} // n>5
+	insertionSort(v, n, comp);
+	
+} // end medianOfMediansSelect
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+// Where EmdModWorkspace::flow puts the flows. The walk around the circle
+// visits the "to" bins (iB) in the order start..NBO-1,0..start-1, and the
+// "from" bins (iA) of each "to" bin in increasing order modulo NBO.
+
+struct EmdModNoFlows {
+	void begin(int, int) {}
+	void add(int, int, double) {}
+	void end() {}
+};
+
+struct EmdModListFlows {
+	std::vector< std::list< std::pair<int,double> > >* _flows;
+	explicit EmdModListFlows(std::vector< std::list< std::pair<int,double> > >* flows) : _flows(flows) {}
+	void begin(int NBO, int) {
+		_flows->clear();
+		_flows->resize(NBO);
+	}
+	void add(int iA, int iB, double f) {
+		(*_flows)[iB].push_back( std::make_pair(iA, f) );
+	}
+	void end() {}
+};
+
+/// Writes the flows in compressed sparse column form (column iB, row iA),
+/// with the rows of each column sorted. See EMD_MOD_sparseFlows.
+template<typename IDX>
+struct EmdModSparseFlows {
+	
+	IDX* _rows;
+	double* _amounts;
+	IDX* _colStarts;
+	int _NBO;
+	int _start;
+	IDX _num;
+	// Number of flows into bins start..NBO-1, which come first in the walk
+	IDX _numFromStart;
+
+	EmdModSparseFlows(IDX* rows, double* amounts, IDX* colStarts)
+		: _rows(rows), _amounts(amounts), _colStarts(colStarts) {}
+
+	void begin(int NBO, int start) {
+		_NBO= NBO;
+		_start= start;
+		_num= 0;
+		_numFromStart= 0;
+		for (int j= 0; j<=NBO; ++j) _colStarts[j]= 0;
+	}
+	
+	void add(int iA, int iB, double f) {
+		_rows[_num]= iA;
+		_amounts[_num]= f;
+		++_num;
+		if (iB>=_start) _numFromStart= _num;
+		++_colStarts[iB+1];
+	}
+	
+	void end() {
+		// Columns 0..start-1 first
+		std::rotate(_rows, _rows+_numFromStart, _rows+_num);
+		std::rotate(_amounts, _amounts+_numFromStart, _amounts+_num);
+		for (int j= 0; j<_NBO; ++j) _colStarts[j+1]+= _colStarts[j];
+		// iA goes around the circle once, so at most one column has its rows
+		// in two increasing runs
+		for (int j= 0; j<_NBO; ++j) {
+			IDX b= _colStarts[j];
+			IDX e= _colStarts[j+1];
+			for (IDX k= b+1; k<e; ++k) {
+				if (_rows[k]<_rows[k-1]) {
+					std::rotate(_rows+b, _rows+k, _rows+e);
+					std::rotate(_amounts+b, _amounts+k, _amounts+e);
+					return;
+				}
+			}
+		}
+	}
+	
+};
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+/// The memory EMD_MOD needs, kept between calls so that computing many
+/// distances does not allocate (after the first call with the largest NBO).
+/// Not thread safe - use a workspace per thread.
+class EmdModWorkspace {
+
+public:
+
+	/// @param worstCaseLinearSelection if true the median of the prefix sums
+	/// differences is found with medianOfMediansSelect, whose worst case is
+	/// linear, instead of std::nth_element, which is linear only on average.
+	/// Both give the same distance, up to floating point rounding when the
+	/// median value appears more than once.
+	explicit EmdModWorkspace(bool worstCaseLinearSelection= false, int NBO= 0)
+		: _worstCaseLinearSelection(worstCaseLinearSelection) {
+		reserve(NBO);
+	}
+
+	void reserve(int NBO) {
+		if (static_cast<int>(_F.size())<NBO) {
+			_A.resize(NBO);
+			_B.resize(NBO);
+			_F.resize(NBO);
+			_FI.resize(NBO);
+		}
+	}
+
+	bool worstCaseLinearSelection() const { return _worstCaseLinearSelection; }
+
+private:
+
+	// EMD_MOD of _A, _B where _F are the differences of their prefix sums
+	template<typename FLOWS>
+	double flow(int NBO, FLOWS& flows) {
+
+		double _emd= 0.0;
+		double* A= &_A[0];
+		double* B= &_B[0];
+		int* FI= &_FI[0];
+
+		if (_worstCaseLinearSelection) {
+			medianOfMediansSelect(FI, NBO, NBO/2, CompByVec(_F));
+		} else {
+			// On average, linear in NBO/2
+			std::nth_element(FI, FI+(NBO/2), FI+NBO, CompByVec(_F));
+		}
+	
+		// The flow goes around the circle starting from this bin
+		const int start= (FI[NBO/2] + 1) % NBO;
+      
+		int tA=0;
+		int tB=0;
+		int iA=start;
+		int iB=start;
+		flows.begin(NBO, start);
+		while (true) {
+
+		    while (A[iA]==0.0) {
+				if (++tA==NBO) {
+					flows.end();
+					return _emd;
+				}
+				if (++iA==NBO) iA= 0;
+		    }
+			while (B[iB]==0.0) {
+				if (++tB==NBO) {
+					flows.end();
+					return _emd;
+				}
+				if (++iB==NBO) iB= 0;
+		    }
+
+		    double f= std::min(A[iA],B[iB]);
+		    A[iA]-= f;
+			B[iB]-= f;
+			_emd+= f*std::min(abs(iA-iB), NBO-abs(iA-iB));
+
+			flows.add(iA, iB, f);
+		
+		} // true (flowing)
+
+	} // end flow
+
+	// Copies oA, oB and sets the prefix sums differences
+	void fill(const double* oA, const double* oB, int NBO) {
+		reserve(NBO);
+		double* A= &_A[0];
+		double* B= &_B[0];
+		double* F= &_F[0];
+		int* FI= &_FI[0];
+
+		// One pass for the copies and both prefix sums
+		double CA= 0.0;
+		double CB= 0.0;
+		for (int i= 0; i<NBO; ++i) {
+			A[i]= oA[i];
+			B[i]= oB[i];
+			CA+= oA[i];
+			CB+= oB[i];
+			F[i]= CA-CB;
+			FI[i]= i;
+		}
+	}
+
+	template<bool computeFlow>
+	double flow(int NBO, std::vector< std::list< std::pair<int,double> > >* flows_ptr) {
+		if (computeFlow) {
+			EmdModListFlows flows(flows_ptr);
+			return flow(NBO, flows);
+		}
+		EmdModNoFlows flows;
+		return flow(NBO, flows);
+	}
+
+	template<bool computeFlow>
+	friend double EMD_MOD(const double* oA, const double* oB, int NBO,
+						  EmdModWorkspace& ws,
+						  std::vector< std::list< std::pair<int,double> > >* flows_ptr);
+
+	template<bool computeFlow>
+	friend double EMD_MOD_prefixSums(const double* oA, const double* oB,
+									 const double* prefA, const double* prefB, int NBO,
+									 EmdModWorkspace& ws,
+									 std::vector< std::list< std::pair<int,double> > >* flows_ptr);
+
+	template<typename IDX>
+	friend double EMD_MOD_sparseFlows(const double* oA, const double* oB, int NBO,
+									  EmdModWorkspace& ws,
+									  IDX* rows, double* amounts, IDX* colStarts);
+
+	bool _worstCaseLinearSelection;
+	// Residual masses
+	std::vector<double> _A;
+	std::vector<double> _B;
+	// Prefix sums differences and their indices for the median selection
+	std::vector<double> _F;
+	std::vector<int> _FI;
+	
+}; // end EmdModWorkspace
+//-------------------------------------------------------------
+
+
 /// Computes the EMD_MOD between two equal mass histograms.
 /// That is, EMD with modulo L1 as the ground distance,
 /// between histograms that their sums should be equal.
@@ -35,89 +320,97 @@ struct CompByVec {
 /// 1. For SIFT matching, this distance performance was bad.
 ///    Try using my QC / FastEMD / SIFT_DIST codes
 ///    (from ECCV 2010, ICCV 2009, ECCV 2008 respectively).
-/// 2. This implementation is linear on the average as I use
+/// 2. By default this implementation is linear on the average as I use
 ///    the nth_element function of standard C++ library,
-///    which is currently average linear time. There are worst time
-///    linear algorithms, but I did not implement them.
+///    which is currently average linear time. For worst case linear
+///    time, use an EmdModWorkspace with worstCaseLinearSelection.
 ///
 /// Params:
 /// oA - first histogram
 /// oB - second histograms
 /// NBO - number of bins
+/// ws - memory reused between calls (see EmdModWorkspace)
 /// flows - If computeFlow is true, this is the pointer to a vector that will be filled
 ///         with lists of flows from each bin (each pair is the going to bin and how much).
 ///         Note: the vector is cleared before being filled.
 template<bool computeFlow>
 double EMD_MOD(const double* oA, const double* oB, int NBO,
-			   std::vector< std::list< std::pair<int,double> > >* flows_ptr=NULL) {
+			   EmdModWorkspace& ws,
+			   std::vector< std::list< std::pair<int,double> > >* flows_ptr) {
 	
-	double _emd= 0.0;
+	ws.fill(oA, oB, NBO);
+	return ws.flow<computeFlow>(NBO, flows_ptr);
+
+} // end EMD_MOD
+
+
+/// The maximum number of flows EMD_MOD returns for NBO bins
+/// (each flow empties at least one bin of one of the histograms).
+inline int EMD_MOD_maxFlowsNum(int NBO) {
+	return 2*NBO;
+} // end EMD_MOD_maxFlowsNum
+
+
+/// Same as EMD_MOD, with the flows written without any allocation to
+/// caller owned arrays in compressed sparse column form (the form of
+/// Matlab sparse matrices, IDX can be mwIndex):
+/// the flows into bin j of oB are from bins rows[colStarts[j]..colStarts[j+1])
+/// of oA (in increasing order), with amounts[colStarts[j]..colStarts[j+1]).
+/// rows and amounts should have room for EMD_MOD_maxFlowsNum(NBO) flows,
+/// and colStarts for NBO+1 indices. colStarts[NBO] is the number of flows.
+template<typename IDX>
+double EMD_MOD_sparseFlows(const double* oA, const double* oB, int NBO,
+						   EmdModWorkspace& ws,
+						   IDX* rows, double* amounts, IDX* colStarts) {
 	
-	std::vector<double> A(oA, oA+NBO);
-	std::vector<double> B(oB, oB+NBO);
-	std::vector<double> F(NBO);
-	std::vector<int> FI(NBO);
-	std::vector<int> I(NBO);
-            
-	// CA and CB can be removed with an optimization
-	std::vector<double> CA(oA, oA+NBO);
-	std::vector<double> CB(oB, oB+NBO);
-	F[0]= CA[0]-CB[0];
-	for (int i= 1; i<NBO; ++i) {
-		CA[i]= CA[i]+CA[i-1];
-		CB[i]= CB[i]+CB[i-1];	    
-		F[i]= CA[i]-CB[i];
-	}
-	  
+	ws.fill(oA, oB, NBO);
+	EmdModSparseFlows<IDX> flows(rows, amounts, colStarts);
+	return ws.flow(NBO, flows);
+
+} // end EMD_MOD_sparseFlows
+
+
+/// The prefix sums of hist (NBO bins) as used by EMD_MOD_prefixSums
+inline void EMD_MOD_computePrefixSums(const double* hist, int NBO, double* pref) {
+	double C= 0.0;
 	for (int i= 0; i<NBO; ++i) {
-		FI[i]= i;
+		C+= hist[i];
+		pref[i]= C;
 	}
-	// On average, linear in NBO/2
-	// There are strictly linear time algorithms, which might be faster, or not... :)
-	nth_element(FI.begin(), FI.begin()+(NBO/2), FI.end(), CompByVec(F));
+} // end EMD_MOD_computePrefixSums
+
+
+/// Same as EMD_MOD, where prefA and prefB are the prefix sums of oA and oB
+/// (see EMD_MOD_computePrefixSums). For distances between sets of
+/// histograms, where each prefix sum is computed once (see EMD_MOD_matrix.hpp).
+template<bool computeFlow>
+double EMD_MOD_prefixSums(const double* oA, const double* oB,
+						  const double* prefA, const double* prefB, int NBO,
+						  EmdModWorkspace& ws,
+						  std::vector< std::list< std::pair<int,double> > >* flows_ptr) {
 	
-	int i= (FI[NBO/2] + 1) % NBO;
-	for (int t= 0; t<NBO; ++t) {
-	    I[t]= i;
-	    ++i;
-	    i= i%NBO;
-	}
-      
-	int tA=0;
-	int tB=0;
-	int iA=I[tA];
-	int iB=I[tB];
-	if (computeFlow) {
-		flows_ptr->clear();
-		flows_ptr->resize(NBO);
+	ws.reserve(NBO);
+	double* A= &ws._A[0];
+	double* B= &ws._B[0];
+	double* F= &ws._F[0];
+	int* FI= &ws._FI[0];
+	for (int i= 0; i<NBO; ++i) {
+		A[i]= oA[i];
+		B[i]= oB[i];
+		F[i]= prefA[i]-prefB[i];
+		FI[i]= i;
 	}
-	while (true) {
-
-	    while (A[iA]==0.0) {
-			if (++tA==NBO) {
-				return _emd;
-			}
-			iA=I[tA];
-	    }
-		while (B[iB]==0.0) {
-			if (++tB==NBO) {
-				return _emd;
-			}
-			iB=I[tB];
-	    }
+	return ws.flow<computeFlow>(NBO, flows_ptr);
 
-	    double f= std::min(A[iA],B[iB]);
-	    A[iA]-= f;
-		B[iB]-= f;
-		_emd+= f*std::min(abs(iA-iB), NBO-abs(iA-iB));
+} // end EMD_MOD_prefixSums
 
-		if (computeFlow) {
-			std::vector< std::list< std::pair<int,double> > >& flows= *flows_ptr;
-			flows[iB].push_back( std::make_pair(iA, f) );
-		}
-		
-	} // true (flowing)
 
+/// Same as above, with a temporary workspace (allocates on each call).
+template<bool computeFlow>
+double EMD_MOD(const double* oA, const double* oB, int NBO,
+			   std::vector< std::list< std::pair<int,double> > >* flows_ptr=NULL) {
+	EmdModWorkspace ws(false, NBO);
+	return EMD_MOD<computeFlow>(oA, oB, NBO, ws, flows_ptr);
 } // end EMD_MOD
 
 #endif
@@ -0,0 +1,120 @@
+#include "EMD_MOD.hpp"
+#include "EMD_MOD_matrix.hpp"
+#include <cstdlib>
+#include <functional>
+
+// Checks EMD_MOD on a few histograms with known distances, and that the
+// workspace, the worst case linear selection and the matrix API give the
+// same distances.
+int main() {
+
+	// The demo_EMD_MOD.m histograms: 3 units move 1 bin, 2 units move 1 bin
+	double P[]= {0, 0, 3, 0, 0, 3, 0, 0};
+	double Q[]= {0, 3, 0, 0, 0, 1, 2, 0};
+	assert(EMD_MOD<false>(P, Q, 8)==5.0);
+
+	// The ground distance is modulo NBO: bin 0 to bin 7 is 1, to bin 4 is 4
+	double P2[]= {2, 0, 0, 0, 0, 0, 0, 0};
+	double Q2[]= {0, 0, 0, 0, 1, 0, 0, 1};
+	assert(EMD_MOD<false>(P2, Q2, 8)==5.0);
+
+	std::vector< std::list< std::pair<int,double> > > flows;
+	assert(EMD_MOD<true>(P2, Q2, 8, &flows)==5.0);
+	assert(flows[4].size()==1 && flows[4].front()==std::make_pair(0, 1.0));
+	assert(flows[7].size()==1 && flows[7].front()==std::make_pair(0, 1.0));
+
+	// The same flows in compressed sparse column form
+	int rows[16], colStarts[9];
+	double amounts[16];
+	EmdModWorkspace ws8;
+	assert(EMD_MOD_sparseFlows(P2, Q2, 8, ws8, rows, amounts, colStarts)==5.0);
+	assert(colStarts[8]==2 && colStarts[4]==0 && colStarts[5]==1 && colStarts[7]==1);
+	assert(rows[0]==0 && amounts[0]==1.0 && rows[1]==0 && amounts[1]==1.0);
+
+	// Random integer histograms, so that all the sums are exact
+	EmdModWorkspace ws;
+	EmdModWorkspace ws_linear(true);
+	srand(1);
+	for (int it= 0; it<2000; ++it) {
+		int NBO= 2*(1+rand()%180);
+		std::vector<double> A(NBO, 0.0), B(NBO, 0.0);
+		int mass= 1+rand()%200;
+		for (int m= 0; m<mass; ++m) {
+			// Few distinct values, so the median selection has ties
+			A[(rand()%4)*(NBO/4)]+= 1.0;
+			B[rand()%NBO]+= 1.0;
+		}
+		double d= EMD_MOD<false>(&A[0], &B[0], NBO);
+		assert(EMD_MOD<false>(&A[0], &B[0], NBO, ws, NULL)==d);
+		assert(EMD_MOD<false>(&A[0], &B[0], NBO, ws_linear, NULL)==d);
+	}
+
+	// medianOfMediansSelect is an nth_element
+	for (int it= 0; it<1000; ++it) {
+		int n= 1+rand()%200;
+		std::vector<int> v(n);
+		for (int i= 0; i<n; ++i) v[i]= rand()%(1+rand()%20);
+		std::vector<int> sorted(v);
+		std::sort(sorted.begin(), sorted.end());
+		int k= rand()%n;
+		medianOfMediansSelect(&v[0], n, k, std::less<int>());
+		assert(v[k]==sorted[k]);
+		for (int i= 0; i<k; ++i) assert(v[i]<=v[k]);
+		for (int i= k+1; i<n; ++i) assert(v[i]>=v[k]);
+	}
+
+	// The matrix and top-k of a few sets, on several threads
+	{
+		int NBO= 36, n1= 7, n2= 11, k= 3;
+		std::vector<double> H1(n1*NBO, 0.0), H2(n2*NBO, 0.0);
+		for (int m= 0; m<50; ++m) {
+			for (int i= 0; i<n1; ++i) H1[i*NBO+rand()%NBO]+= 1.0;
+			for (int j= 0; j<n2; ++j) H2[j*NBO+rand()%NBO]+= 1.0;
+		}
+		std::vector<double> D(n1*n2), K(k*n1);
+		std::vector<int> I(k*n1);
+		EMD_MOD_matrix(&H1[0], n1, &H2[0], n2, NBO, &D[0], 3);
+		EMD_MOD_topK(&H1[0], n1, &H2[0], n2, NBO, k, &I[0], &K[0], 3);
+		for (int i= 0; i<n1; ++i) {
+			std::vector< std::pair<double,int> > row;
+			for (int j= 0; j<n2; ++j) {
+				assert(D[i+j*n1]==EMD_MOD<false>(&H1[i*NBO], &H2[j*NBO], NBO));
+				row.push_back(std::make_pair(D[i+j*n1], j));
+			}
+			std::sort(row.begin(), row.end());
+			for (int r= 0; r<k; ++r) {
+				assert(K[r+i*k]==row[r].first && I[r+i*k]==row[r].second);
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+// Copyright (c) 2011, Ofir Pele
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met: 
+//    * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//    * Neither the name of the The Hebrew University of Jerusalem nor the
+//    names of its contributors may be used to endorse or promote products
+//    derived from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
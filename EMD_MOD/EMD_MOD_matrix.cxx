@@ -0,0 +1,105 @@
+#include <mex.h>
+#include "EMD_MOD_matrix.hpp"
+
+void mexFunction(int nout, mxArray *out[], 
+                 int nin, const mxArray *in[]) {
+	
+	if (nin<2||nin>4) {
+		mexErrMsgTxt("2 to 4 arguments are required.");
+	}
+	if (nout>2) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+	if (!mxIsDouble(in[0])||!mxIsDouble(in[1])) {
+		mexErrMsgTxt("P and Q should be double matrices.");
+	}
+	
+	const double* P= static_cast<const double*>( mxGetData(in[0]) );
+	const double* Q= static_cast<const double*>( mxGetData(in[1]) );
+	int NBO= static_cast<int>(mxGetM(in[0]));
+	int n1= static_cast<int>(mxGetN(in[0]));
+	int n2= static_cast<int>(mxGetN(in[1]));
+	if (static_cast<int>(mxGetM(in[1]))!=NBO) {
+		mexErrMsgTxt("P and Q should have the same number of rows (bins).");
+	}
+
+	int K= 0;
+	if (nin>2&&!mxIsEmpty(in[2])) {
+		K= static_cast<int>(mxGetScalar(in[2]));
+		if (K<1||K>n2) {
+			mexErrMsgTxt("K should be between 1 and the number of columns of Q.");
+		}
+	} else if (nout>1) {
+		mexErrMsgTxt("I is returned only when K is given.");
+	}
+	unsigned int threadsNum= 1;
+	if (nin>3) {
+		double t= mxGetScalar(in[3]);
+		if (t<0) {
+			mexErrMsgTxt("numThreads should be non negative.");
+		}
+		threadsNum= static_cast<unsigned int>(t);
+	}
+
+#ifndef NDEBUG
+	if (NBO%2!=0) {
+		mexErrMsgTxt("I did not check if it works with odd length vectors, so use even length, or check :)");
+	}
+	if (n1>0) {
+		double sum0= 0.0;
+		for (int b= 0; b<NBO; ++b) sum0+= P[b];
+		for (int c= 0; c<n1+n2; ++c) {
+			const double* H= c<n1 ? P+c*NBO : Q+(c-n1)*NBO;
+			double sum= 0.0;
+			for (int b= 0; b<NBO; ++b) sum+= H[b];
+			if (sum!=sum0) {
+				mexErrMsgTxt("Only works when the sums of all the histograms are equal.");
+			}
+		}
+	}
+#endif
+
+	if (K==0) {
+		out[0]= mxCreateDoubleMatrix(n1, n2, mxREAL);
+		EMD_MOD_matrix(P, n1, Q, n2, NBO, mxGetPr(out[0]), threadsNum);
+	} else {
+		out[0]= mxCreateDoubleMatrix(K, n1, mxREAL);
+		std::vector<int> inds(static_cast<size_t>(K)*n1);
+		EMD_MOD_topK(P, n1, Q, n2, NBO, K,
+					 inds.empty() ? NULL : &inds[0], mxGetPr(out[0]), threadsNum);
+		if (nout>1) {
+			out[1]= mxCreateDoubleMatrix(K, n1, mxREAL);
+			double* I= mxGetPr(out[1]);
+			for (size_t i= 0; i<inds.size(); ++i) I[i]= inds[i]+1;
+		}
+	}
+    
+}
+
+
+// Copyright (c) 2011, Ofir Pele
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met: 
+//    * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//    * Neither the name of the The Hebrew University of Jerusalem nor the
+//    names of its contributors may be used to endorse or promote products
+//    derived from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
@@ -0,0 +1,218 @@
+#ifndef EMD_MOD_MATRIX_HPP_
+#define EMD_MOD_MATRIX_HPP_
+
+#include "EMD_MOD.hpp"
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+// Distances between two sets of histograms with EMD_MOD (needs C++11 and
+// -pthread for the threads).
+// Histograms are stored one after the other, NBO bins each (that is, the
+// columns of an NBO x n Matlab matrix). Each thread has its own
+// EmdModWorkspace, and the prefix sums of each histogram are computed once.
+
+
+//-------------------------------------------------------------
+/// The number of threads EMD_MOD_forEachRow uses for rowsNum rows
+/// with threadsNum (0 means the number of cores).
+inline unsigned int EMD_MOD_threadsNum(int rowsNum, unsigned int threadsNum) {
+	if (threadsNum==0) threadsNum= std::thread::hardware_concurrency();
+	if (threadsNum==0) threadsNum= 1;
+	return std::min(threadsNum, static_cast<unsigned int>(std::max(rowsNum, 1)));
+}
+
+/// Runs rowFunc(i, t, ws) for 0<=i<rowsNum on EMD_MOD_threadsNum(rowsNum, threadsNum)
+/// threads, where t is the index of the calling thread and ws is its EmdModWorkspace.
+/// Rows are taken one by one, so slow rows do not hold the others back.
+template<typename ROW_FUNC>
+void EMD_MOD_forEachRow(int rowsNum, unsigned int threadsNum, bool worstCaseLinearSelection,
+						ROW_FUNC& rowFunc) {
+	
+	threadsNum= EMD_MOD_threadsNum(rowsNum, threadsNum);
+	std::atomic<int> nextRow(0);
+	std::vector<EmdModWorkspace> wss(threadsNum, EmdModWorkspace(worstCaseLinearSelection));
+	struct Worker {
+		static void run(std::atomic<int>* nextRow, int rowsNum, unsigned int t, EmdModWorkspace* ws, ROW_FUNC* rowFunc) {
+			for (int i= (*nextRow)++; i<rowsNum; i= (*nextRow)++) {
+				(*rowFunc)(i, t, *ws);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned int t= 1; t<threadsNum; ++t) {
+		threads.push_back(std::thread(&Worker::run, &nextRow, rowsNum, t, &wss[t], &rowFunc));
+	}
+	Worker::run(&nextRow, rowsNum, 0, &wss[0], &rowFunc);
+	for (unsigned int t= 0; t<threads.size(); ++t) threads[t].join();
+
+} // end EMD_MOD_forEachRow
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+/// The prefix sums of n histograms of NBO bins
+inline std::vector<double> EMD_MOD_computePrefixSums(const double* hists, int n, int NBO) {
+	std::vector<double> prefs(static_cast<size_t>(n)*NBO);
+	for (int i= 0; i<n; ++i) {
+		EMD_MOD_computePrefixSums(hists+static_cast<size_t>(i)*NBO, NBO, &prefs[static_cast<size_t>(i)*NBO]);
+	}
+	return prefs;
+}
+//-------------------------------------------------------------
+
+
+//-------------------------------------------------------------
+struct EmdModMatrixRow {
+	
+	void operator()(int i, unsigned int, EmdModWorkspace& ws) const {
+		const double* A= hists1+static_cast<size_t>(i)*NBO;
+		const double* prefA= prefs1+static_cast<size_t>(i)*NBO;
+		for (int j= 0; j<n2; ++j) {
+			dists[i+static_cast<size_t>(j)*n1]=
+				EMD_MOD_prefixSums<false>(A, hists2+static_cast<size_t>(j)*NBO,
+										  prefA, prefs2+static_cast<size_t>(j)*NBO, NBO,
+										  ws, NULL);
+		}
+	}
+
+	const double* hists1;
+	const double* prefs1;
+	int n1;
+	const double* hists2;
+	const double* prefs2;
+	int n2;
+	int NBO;
+	double* dists;
+	
+};
+//-------------------------------------------------------------
+
+
+/// Fills dists, an n1 x n2 column major (Matlab) matrix, with the EMD_MOD
+/// between each histogram of hists1 and each histogram of hists2.
+/// All histograms should have the same mass.
+/// threadsNum - number of threads, 0 means the number of cores.
+/// worstCaseLinearSelection - see EmdModWorkspace.
+inline void EMD_MOD_matrix(const double* hists1, int n1,
+						   const double* hists2, int n2,
+						   int NBO,
+						   double* dists,
+						   unsigned int threadsNum= 1,
+						   bool worstCaseLinearSelection= false) {
+	
+	std::vector<double> prefs1= EMD_MOD_computePrefixSums(hists1, n1, NBO);
+	std::vector<double> prefs2= EMD_MOD_computePrefixSums(hists2, n2, NBO);
+	EmdModMatrixRow row= { hists1, prefs1.empty() ? NULL : &prefs1[0], n1,
+						   hists2, prefs2.empty() ? NULL : &prefs2[0], n2,
+						   NBO, dists };
+	EMD_MOD_forEachRow(n1, threadsNum, worstCaseLinearSelection, row);
+	
+} // end EMD_MOD_matrix
+
+
+//-------------------------------------------------------------
+struct EmdModTopKRow {
+
+	// Smaller distance first, ties by index
+	struct Closer {
+		const double* _dists;
+		Closer(const double* dists) : _dists(dists) { }
+		bool operator()(int a, int b) const {
+			return _dists[a]<_dists[b] || (_dists[a]==_dists[b] && a<b);
+		}
+	};
+	
+	void operator()(int i, unsigned int t, EmdModWorkspace& ws) const {
+		// Each thread runs one row at a time, thus one buffer per thread
+		std::vector<double>& rowDists= (*rowsDists)[t];
+		std::vector<int>& rowInds= (*rowsInds)[t];
+		rowDists.resize(n2);
+		rowInds.resize(n2);
+		
+		const double* A= hists1+static_cast<size_t>(i)*NBO;
+		const double* prefA= prefs1+static_cast<size_t>(i)*NBO;
+		for (int j= 0; j<n2; ++j) {
+			rowDists[j]= EMD_MOD_prefixSums<false>(A, hists2+static_cast<size_t>(j)*NBO,
+												   prefA, prefs2+static_cast<size_t>(j)*NBO, NBO,
+												   ws, NULL);
+			rowInds[j]= j;
+		}
+		std::partial_sort(rowInds.begin(), rowInds.begin()+k, rowInds.end(), Closer(&rowDists[0]));
+		for (int r= 0; r<k; ++r) {
+			inds[r+static_cast<size_t>(i)*k]= rowInds[r];
+			dists[r+static_cast<size_t>(i)*k]= rowDists[rowInds[r]];
+		}
+	}
+
+	const double* hists1;
+	const double* prefs1;
+	const double* hists2;
+	const double* prefs2;
+	int n2;
+	int NBO;
+	int k;
+	int* inds;
+	double* dists;
+	std::vector< std::vector<double> >* rowsDists;
+	std::vector< std::vector<int> >* rowsInds;
+	
+};
+//-------------------------------------------------------------
+
+
+/// For each histogram i of hists1, finds the k histograms of hists2 with
+/// the smallest EMD_MOD to it (ties are broken by the smaller index).
+/// inds and dists are k x n1 column major (Matlab) matrices: column i holds
+/// the (0 based) indices and the distances of the neighbors of histogram i,
+/// closest first. k should be at most n2.
+/// Other params are as in EMD_MOD_matrix.
+inline void EMD_MOD_topK(const double* hists1, int n1,
+						 const double* hists2, int n2,
+						 int NBO, int k,
+						 int* inds, double* dists,
+						 unsigned int threadsNum= 1,
+						 bool worstCaseLinearSelection= false) {
+
+	assert(k>=0&&k<=n2);
+	if (k==0) return;
+	std::vector<double> prefs1= EMD_MOD_computePrefixSums(hists1, n1, NBO);
+	std::vector<double> prefs2= EMD_MOD_computePrefixSums(hists2, n2, NBO);
+	std::vector< std::vector<double> > rowsDists(EMD_MOD_threadsNum(n1, threadsNum));
+	std::vector< std::vector<int> > rowsInds(rowsDists.size());
+	EmdModTopKRow row= { hists1, prefs1.empty() ? NULL : &prefs1[0],
+						 hists2, &prefs2[0], n2,
+						 NBO, k, inds, dists, &rowsDists, &rowsInds };
+	EMD_MOD_forEachRow(n1, threadsNum, worstCaseLinearSelection, row);
+	
+} // end EMD_MOD_topK
+
+#endif
+
+// Copyright (c) 2011, Ofir Pele
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met: 
+//    * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//    * Neither the name of the The Hebrew University of Jerusalem nor the
+//    names of its contributors may be used to endorse or promote products
+//    derived from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
@@ -0,0 +1,49 @@
+%[D I]= EMD_MOD_matrix(P, Q, K, numThreads)
+% Computes the EMD_MOD (see EMD_MOD.m) between all the columns of P and
+% all the columns of Q. All the histograms should have the same mass.
+% The prefix sums of each histogram are computed once, and the rows are
+% computed in parallel, each thread with its own work space.
+%
+% Returns:
+% D - without K, an n1 x n2 matrix where D(i,j) is the EMD_MOD between P(:,i)
+%     and Q(:,j). With K, a K x n1 matrix where D(:,i) are the K smallest
+%     distances of P(:,i) to the columns of Q in ascending order.
+% I - (only with K) K x n1 matrix of the indices of the columns of Q
+%     that D(:,i) belong to. Ties are ordered by index.
+% 
+% Params:
+% P - NBO x n1 matrix of histograms (one per column).
+% Q - NBO x n2 matrix of histograms (one per column).
+% K - optional, the number of nearest columns of Q to return for each
+%     column of P (1<=K<=n2). [] or not given means the full matrix.
+% numThreads - optional, the number of threads. 0 means the number of
+%              cores. Default is 1.
+
+
+% Copyright (c) 2011, Ofir Pele
+% All rights reserved.
+
+% Redistribution and use in source and binary forms, with or without
+% modification, are permitted provided that the following conditions are
+% met: 
+%    * Redistributions of source code must retain the above copyright
+%    notice, this list of conditions and the following disclaimer.
+%    * Redistributions in binary form must reproduce the above copyright
+%    notice, this list of conditions and the following disclaimer in the
+%    documentation and/or other materials provided with the distribution.
+%    * Neither the name of the The Hebrew University of Jerusalem nor the
+%    names of its contributors may be used to endorse or promote products
+%    derived from this software without specific prior written permission.
+
+
+% THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+% IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+% THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+% PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+% CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+% EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+% PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+% PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+% LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+% NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+% SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
@@ -1,5 +1,6 @@
 warning('Compiling in optimized setting - no checking of input (same mass, etc). Remove the -DNDEBUG to enable checkings');
 mex -O -largeArrayDims -DNDEBUG EMD_MOD.cxx
+mex -O -largeArrayDims -DNDEBUG CXXFLAGS='$CXXFLAGS -std=c++11 -pthread' LDFLAGS='$LDFLAGS -pthread' EMD_MOD_matrix.cxx
 
 
 
@@ -0,0 +1,194 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_FRAMES_GRID__HXX
+#define _OFIRPELE_FRAMES_GRID__HXX
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "MyMinMax.hxx"
+
+
+/// A uniform grid over the circles of the frames of an image (center and
+/// radius), for finding the frames that might overlap a given circle without
+/// testing all of them. Each frame is in all the grid cells its bounding box
+/// covers. The cell size is about the diameter of a median frame, bounded so
+/// that there are at most about as many cells as frames. The few frames that
+/// are much larger than that are candidates of all the queries.
+class FramesGrid {
+
+public:
+
+    FramesGrid() : _frames_num(0), _x0(0), _y0(0), _inv_cell_size(0), _cols(0), _rows(0) {}
+
+    /// @param frames FRAMES_COL_SIZE doubles for each frame, x and y at
+    /// FRAMES_X_IND and FRAMES_Y_IND.
+    /// @param radius_vec the radius of each frame.
+    void build(const double* frames, int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND,
+               const std::vector<double>& radius_vec) {
+
+        const unsigned int n= static_cast<unsigned int>(radius_vec.size());
+        _frames_num= n;
+        _cols= _rows= 0;
+        _cell_starts.clear();
+        _entries.clear();
+        _always.clear();
+        _first_col.assign(n, 0);
+        _first_row.assign(n, 0);
+        if (n==0) return;
+
+        // Bounding box of the circles, frames with non finite values are
+        // candidates of all the queries
+        double min_x= HUGE_VAL, min_y= HUGE_VAL, max_x= -HUGE_VAL, max_y= -HUGE_VAL;
+        std::vector<double> radiuses;
+        radiuses.reserve(n);
+        for (unsigned int i=0; i<n; ++i) {
+            double x= frames[i*FRAMES_COL_SIZE+FRAMES_X_IND], y= frames[i*FRAMES_COL_SIZE+FRAMES_Y_IND], r= radius_vec[i];
+            if (!isFinite(x) || !isFinite(y) || !isFinite(r) || r<0) {
+                _always.push_back(i);
+                continue;
+            }
+            min_x= std::min(min_x, x-r);
+            min_y= std::min(min_y, y-r);
+            max_x= std::max(max_x, x+r);
+            max_y= std::max(max_y, y+r);
+            radiuses.push_back(r);
+        }
+        if (radiuses.empty()) return;
+
+        std::nth_element(radiuses.begin(), radiuses.begin()+radiuses.size()/2, radiuses.end());
+        double width= max_x-min_x, height= max_y-min_y;
+        double cell_size= std::max(2*radiuses[radiuses.size()/2],
+                                   std::sqrt(width*height/radiuses.size()));
+        cell_size= std::max(cell_size, std::max(width, height)/radiuses.size());
+        if (!(cell_size>0)) cell_size= 1;
+        _x0= min_x;
+        _y0= min_y;
+        _inv_cell_size= 1.0/cell_size;
+        _cols= 1+static_cast<unsigned int>(width*_inv_cell_size);
+        _rows= 1+static_cast<unsigned int>(height*_inv_cell_size);
+
+        // Counting pass, then filling pass (frames of a cell stay ascending)
+        _cell_starts.assign(_cols*_rows+1, 0);
+        for (int pass=0; pass<2; ++pass) {
+            if (pass==1) {
+                for (unsigned int c=0; c<_cols*_rows; ++c) _cell_starts[c+1]+= _cell_starts[c];
+                _entries.resize(_cell_starts[_cols*_rows]);
+            }
+            for (unsigned int i=0; i<n; ++i) {
+                double x= frames[i*FRAMES_COL_SIZE+FRAMES_X_IND], y= frames[i*FRAMES_COL_SIZE+FRAMES_Y_IND], r= radius_vec[i];
+                if (!isFinite(x) || !isFinite(y) || !isFinite(r) || r<0) continue;
+                unsigned int c0, c1, r0, r1;
+                cellsRange(x, y, r, c0, c1, r0, r1);
+                if ((c1-c0+1)*(r1-r0+1)>MAX_CELLS_PER_FRAME) {
+                    if (pass==0) _always.push_back(i);
+                    continue;
+                }
+                _first_col[i]= c0;
+                _first_row[i]= r0;
+                for (unsigned int row=r0; row<=r1; ++row) {
+                    for (unsigned int col=c0; col<=c1; ++col) {
+                        unsigned int cell= row*_cols+col;
+                        if (pass==0) ++_cell_starts[cell+1];
+                        else _entries[_cell_starts[cell]++]= i;
+                    }
+                }
+            }
+        }
+        // The filling pass moved each start to the next cell's start
+        for (unsigned int c=_cols*_rows; c>0; --c) _cell_starts[c]= _cell_starts[c-1];
+        _cell_starts[0]= 0;
+
+    } // build
+
+    /// Sets inds to the indices of the frames that might intersect the circle
+    /// (x,y,r), in no particular order and without repetitions. All the frames
+    /// that intersect it are there.
+    void candidates(double x, double y, double r, std::vector<unsigned int>& inds) const {
+        inds.assign(_always.begin(), _always.end());
+        if (_cols==0) return;
+        if (!isFinite(x) || !isFinite(y) || !isFinite(r)) {
+            inds.clear();
+            for (unsigned int i=0; i<_frames_num; ++i) inds.push_back(i);
+            return;
+        }
+        unsigned int c0, c1, r0, r1;
+        cellsRange(x, y, r, c0, c1, r0, r1);
+        for (unsigned int row=r0; row<=r1; ++row) {
+            for (unsigned int col=c0; col<=c1; ++col) {
+                unsigned int cell= row*_cols+col;
+                for (unsigned int e=_cell_starts[cell]; e<_cell_starts[cell+1]; ++e) {
+                    // A frame in several of the cells is taken from the first
+                    // of them that both it and the circle cover
+                    unsigned int i= _entries[e];
+                    if (myMax(_first_col[i], c0)==col && myMax(_first_row[i], r0)==row) inds.push_back(i);
+                }
+            }
+        }
+    } // candidates
+
+private:
+
+    static const unsigned int MAX_CELLS_PER_FRAME= 64;
+
+    static bool isFinite(double v) { return v-v==0; }
+
+    // The cells covered by the bounding box of the circle (clamped to the grid)
+    void cellsRange(double x, double y, double r,
+                    unsigned int& c0, unsigned int& c1, unsigned int& r0, unsigned int& r1) const {
+        c0= clampedCell(x-r, _x0, _cols);
+        c1= clampedCell(x+r, _x0, _cols);
+        r0= clampedCell(y-r, _y0, _rows);
+        r1= clampedCell(y+r, _y0, _rows);
+    }
+
+    unsigned int clampedCell(double v, double v0, unsigned int cells) const {
+        double c= (v-v0)*_inv_cell_size;
+        if (c<=0) return 0;
+        if (c>=cells-1) return cells-1;
+        return static_cast<unsigned int>(c);
+    }
+
+    unsigned int _frames_num;
+    double _x0, _y0;
+    double _inv_cell_size;
+    unsigned int _cols, _rows;
+    // The frames of cell c are _entries[_cell_starts[c].._cell_starts[c+1])
+    std::vector<unsigned int> _cell_starts;
+    std::vector<unsigned int> _entries;
+    // Frames that are not in the cells
+    std::vector<unsigned int> _always;
+    // The first column and row of the cells of each frame
+    std::vector<unsigned int> _first_col;
+    std::vector<unsigned int> _first_row;
+
+}; // end class FramesGrid
+
+#endif
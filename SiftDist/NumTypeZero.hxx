@@ -53,5 +53,26 @@ struct NumTypeZero<int> {
 	}
 };
 
+template<>
+struct NumTypeZero<unsigned int> {
+      static unsigned int ZERO() {
+		return 0u;
+	}
+};
+
+template<>
+struct NumTypeZero<unsigned short> {
+      static unsigned short ZERO() {
+		return 0u;
+	}
+};
+
+template<>
+struct NumTypeZero<unsigned char> {
+      static unsigned char ZERO() {
+		return 0u;
+	}
+};
+
 #endif
 
@@ -0,0 +1,306 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DESCR_SET__HXX
+#define _OFIRPELE_SIFT_DESCR_SET__HXX
+
+#include "SiftDist.hxx"
+#include "FramesGrid.hxx"
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+/// What SiftRatioMatcher reads of a set of descriptors: num descriptors of
+/// NBO*NBP*NBP entries and their frames, with the radius of each frame, a
+/// FramesGrid of the frames and (only for prunedDist) CELLS_NUM cells masses
+/// for each descriptor. Nothing is owned.
+template<typename DESCR_T>
+struct SiftDescrSetView {
+    typedef typename SiftDistAccum<DESCR_T>::DIST_T DIST_T;
+    SiftDescrSetView()
+        : descr(NULL), frames(NULL), num(0), radius_vec(NULL), grid(NULL), cellsMass(NULL) {}
+    const DESCR_T* descr;
+    const double* frames;
+    unsigned int num;
+    const std::vector<double>* radius_vec;
+    const FramesGrid* grid;
+    const DIST_T* cellsMass;
+};
+
+
+/// The neighbors of each descriptor of a set1 in a set2, as SiftRatioMatcher
+/// finds them along with the matches: the k nearest (all if k is 0) whose
+/// distance is smaller than radius (HUGE_VAL for any distance).
+/// The neighbors of set1 descriptor i are inds[starts[i]..starts[i+1]) (0-based
+/// indices in set2), sorted by their dists (equal ones by index).
+struct SiftNeighbors {
+
+    explicit SiftNeighbors(unsigned int k_= 0, double radius_= HUGE_VAL) : k(k_), radius(radius_) {}
+
+    unsigned int k;
+    double radius;
+
+    std::vector<unsigned int> starts;
+    std::vector<unsigned int> inds;
+    std::vector<double> dists;
+
+    unsigned int num(unsigned int i) const { return starts[i+1]-starts[i]; }
+
+}; // end SiftNeighbors
+
+
+/// How raw descriptors (e.g. vl_sift's, as doubles) are prepared once, when
+/// they are appended to a SiftDescrSet, instead of by the caller before each
+/// match: each descriptor is divided by its sum (if l1Normalize), then each
+/// entry is replaced by its square root (if takeSqrt, the RootSIFT of an L1
+/// normalized descriptor), multiplied by scale, and for integer DESCR_T
+/// rounded and clamped to its range.
+/// The defaults (sqrt, no L1 and scale 1) are SiftRatioMatch(sqrt(descr),...)
+/// of demo_SiftDist.m. For unsigned char with l1Normalize a scale of e.g. 255
+/// keeps the entries in range (they are at most 1 before the scale).
+struct SiftDescrPrep {
+
+    SiftDescrPrep() : l1Normalize(false), takeSqrt(true), scale(1.0) {}
+
+    bool l1Normalize;
+    bool takeSqrt;
+    double scale;
+
+    /// Prepares one descriptor of sift_dim entries.
+    template<typename DESCR_T>
+    void operator()(const double* in, unsigned int sift_dim, DESCR_T* out) const {
+        double factor= scale;
+        if (l1Normalize) {
+            double sum= 0.0;
+            for (unsigned int k=0; k<sift_dim; ++k) sum+= in[k];
+            // An empty descriptor stays empty
+            if (sum>0.0) factor= takeSqrt ? scale/std::sqrt(sum) : scale/sum;
+        }
+        for (unsigned int k=0; k<sift_dim; ++k) {
+            assert(in[k]>=0.0);
+            double v= (takeSqrt ? std::sqrt(in[k]) : in[k]) * factor;
+            out[k]= toDescr<DESCR_T>(v);
+        }
+    } // operator()
+
+    template<typename DESCR_T>
+    static DESCR_T toDescr(double v) {
+        if (!std::numeric_limits<DESCR_T>::is_integer) return static_cast<DESCR_T>(v);
+        const double max= static_cast<double>(std::numeric_limits<DESCR_T>::max());
+        v= std::floor(v+0.5);
+        return static_cast<DESCR_T>(v<0.0 ? 0.0 : (v>max ? max : v));
+    }
+
+}; // end SiftDescrPrep
+
+
+/// A set of descriptors (e.g. of a video frame, or a growing database) with
+/// everything SiftRatioMatcher needs of them prepared once: the radius of each
+/// frame, the FramesGrid of the frames and the cells masses of the descriptors.
+/// The set can then be matched against any number of other sets.
+/// Descriptors can be appended and removed. Each one gets an id when appended,
+/// which does not change when others are removed (its index does, as the set
+/// stays contiguous and in append order), see id() and find().
+/// The grid is rebuilt by each append and remove, so appending in batches
+/// (a frame at a time) is cheaper than a descriptor at a time.
+template<typename DESCR_T= double>
+class SiftDescrSet {
+
+public:
+
+typedef typename SiftDistAccum<DESCR_T>::DIST_T DIST_T;
+
+/// NBO, NBP, Magnif and the frames layout are as in SiftRatioMatchImpl.
+SiftDescrSet(unsigned int NBO= 16, unsigned int NBP= 4, double Magnif= 3.0,
+             int FRAMES_COL_SIZE= 4, int FRAMES_X_IND= 0, int FRAMES_Y_IND= 1, int FRAMES_SCALE_IND= 2)
+    : _NBO(NBO), _NBP(NBP), _Magnif(Magnif),
+      _FRAMES_COL_SIZE(FRAMES_COL_SIZE), _FRAMES_X_IND(FRAMES_X_IND), _FRAMES_Y_IND(FRAMES_Y_IND),
+      _FRAMES_SCALE_IND(FRAMES_SCALE_IND),
+      _CELLS_NUM(NBP*NBP), _sift_dim(NBO*NBP*NBP), _next_id(0) {}
+
+/// Appends sift_num descriptors and their frames (copied).
+/// Returns the id of the first, the others get the ids after it.
+unsigned int append(const DESCR_T* descr, const double* frames, unsigned int sift_num) {
+    unsigned int first_id= _next_id;
+    if (sift_num==0) return first_id;
+    unsigned int old_num= size();
+    _descr.insert(_descr.end(), descr, descr+sift_num*_sift_dim);
+    _frames.insert(_frames.end(), frames, frames+sift_num*_FRAMES_COL_SIZE);
+    _radius_vec.resize(old_num+sift_num);
+    extractRadiusesFromFrames(frames, sift_num, _FRAMES_SCALE_IND, _FRAMES_COL_SIZE, scaleToRadiusFactor(),
+                              &_radius_vec[0]+old_num);
+    _cellsMass.resize((old_num+sift_num)*_CELLS_NUM);
+    computeCellsMasses(descr, sift_num, _NBO, _CELLS_NUM, &_cellsMass[0]+old_num*_CELLS_NUM);
+    for (unsigned int i=0; i<sift_num; ++i) _ids.push_back(_next_id++);
+    rebuildGrid();
+    return first_id;
+} // append
+
+/// Appends sift_num raw descriptors, prepared by prep, and their frames.
+/// Returns the id of the first, as the other append.
+unsigned int append(const double* raw_descr, const double* frames, unsigned int sift_num,
+                    const SiftDescrPrep& prep) {
+    std::vector<DESCR_T> descr(sift_num*_sift_dim);
+    for (unsigned int i=0; i<sift_num; ++i) {
+        prep(raw_descr+i*_sift_dim, _sift_dim, &descr[0]+i*_sift_dim);
+    }
+    return append(descr.empty() ? NULL : &descr[0], frames, sift_num);
+} // append
+
+/// Removes the descriptors with these ids (ids that are not in the set are
+/// ignored). The others keep their order. Returns the number removed.
+unsigned int remove(const unsigned int* ids, unsigned int ids_num) {
+    std::vector<bool> removed(size(), false);
+    unsigned int removed_num= 0;
+    for (unsigned int k=0; k<ids_num; ++k) {
+        unsigned int i;
+        if (find(ids[k], i) && !removed[i]) {
+            removed[i]= true;
+            ++removed_num;
+        }
+    }
+    if (removed_num==0) return 0;
+
+    unsigned int n= 0;
+    for (unsigned int i=0; i<size(); ++i) {
+        if (removed[i]) continue;
+        if (n!=i) {
+            std::copy(_descr.begin()+i*_sift_dim, _descr.begin()+(i+1)*_sift_dim, _descr.begin()+n*_sift_dim);
+            std::copy(_frames.begin()+i*_FRAMES_COL_SIZE, _frames.begin()+(i+1)*_FRAMES_COL_SIZE,
+                      _frames.begin()+n*_FRAMES_COL_SIZE);
+            std::copy(_cellsMass.begin()+i*_CELLS_NUM, _cellsMass.begin()+(i+1)*_CELLS_NUM,
+                      _cellsMass.begin()+n*_CELLS_NUM);
+            _radius_vec[n]= _radius_vec[i];
+            _ids[n]= _ids[i];
+        }
+        ++n;
+    }
+    _descr.resize(n*_sift_dim);
+    _frames.resize(n*_FRAMES_COL_SIZE);
+    _cellsMass.resize(n*_CELLS_NUM);
+    _radius_vec.resize(n);
+    _ids.resize(n);
+    rebuildGrid();
+    return removed_num;
+} // remove
+
+/// Removes all the descriptors (the ids of the next ones are still new).
+void clear() {
+    _descr.clear();
+    _frames.clear();
+    _cellsMass.clear();
+    _radius_vec.clear();
+    _ids.clear();
+    rebuildGrid();
+}
+
+unsigned int size() const { return static_cast<unsigned int>(_ids.size()); }
+
+/// The id of the descriptor at index i.
+unsigned int id(unsigned int i) const {
+    assert(i<size());
+    return _ids[i];
+}
+
+/// Sets i to the index of the descriptor with this id, if it is in the set.
+/// The ids are increasing with the indices, so this is a binary search.
+bool find(unsigned int id, unsigned int& i) const {
+    std::vector<unsigned int>::const_iterator it= std::lower_bound(_ids.begin(), _ids.end(), id);
+    if (it==_ids.end() || *it!=id) return false;
+    i= static_cast<unsigned int>(it-_ids.begin());
+    return true;
+}
+
+const DESCR_T* descr() const { return _descr.empty() ? NULL : &_descr[0]; }
+const double* frames() const { return _frames.empty() ? NULL : &_frames[0]; }
+const std::vector<double>& radiuses() const { return _radius_vec; }
+const FramesGrid& grid() const { return _grid; }
+const DIST_T* cellsMass() const { return _cellsMass.empty() ? NULL : &_cellsMass[0]; }
+
+unsigned int NBO() const { return _NBO; }
+unsigned int NBP() const { return _NBP; }
+double Magnif() const { return _Magnif; }
+int FRAMES_COL_SIZE() const { return _FRAMES_COL_SIZE; }
+int FRAMES_X_IND() const { return _FRAMES_X_IND; }
+int FRAMES_Y_IND() const { return _FRAMES_Y_IND; }
+int FRAMES_SCALE_IND() const { return _FRAMES_SCALE_IND; }
+
+SiftDescrSetView<DESCR_T> view() const {
+    SiftDescrSetView<DESCR_T> v;
+    v.descr= descr();
+    v.frames= frames();
+    v.num= size();
+    v.radius_vec= &_radius_vec;
+    v.grid= &_grid;
+    v.cellsMass= cellsMass();
+    return v;
+}
+
+/// The radius of a frame is its scale times Magnif*NBP/2 (half the width of the descriptor).
+double scaleToRadiusFactor() const { return (_Magnif*_NBP)/2.0; }
+
+static void extractRadiusesFromFrames(const double* frames, unsigned int sift_num,
+                                      int FRAMES_SCALE_IND, int FRAMES_COL_SIZE, double scaleToRadiusFactor,
+                                      double* radiuses) {
+      frames+= FRAMES_SCALE_IND;
+      for (unsigned int i=0; i<sift_num; ++i,frames+=FRAMES_COL_SIZE) {
+	    radiuses[i]= (*frames) * scaleToRadiusFactor;
+      } // for i
+} // extractRadiusesFromFrames
+
+static void computeCellsMasses(const DESCR_T* descr, unsigned int sift_num, unsigned int NBO, unsigned int CELLS_NUM,
+                               DIST_T* cellsMass) {
+    for (unsigned int i=0; i<sift_num*CELLS_NUM; ++i, descr+= NBO) {
+        cellsMass[i]= SiftDist<DESCR_T>::cellMass(descr, NBO);
+    }
+} // computeCellsMasses
+
+private:
+
+void rebuildGrid() {
+    _grid.build(frames(), _FRAMES_COL_SIZE, _FRAMES_X_IND, _FRAMES_Y_IND, _radius_vec);
+}
+
+    unsigned int _NBO, _NBP;
+    double _Magnif;
+    int _FRAMES_COL_SIZE, _FRAMES_X_IND, _FRAMES_Y_IND, _FRAMES_SCALE_IND;
+    unsigned int _CELLS_NUM, _sift_dim;
+    std::vector<DESCR_T> _descr;
+    std::vector<double> _frames;
+    std::vector<double> _radius_vec;
+    std::vector<DIST_T> _cellsMass;
+    std::vector<unsigned int> _ids;
+    unsigned int _next_id;
+    FramesGrid _grid;
+
+}; // end class SiftDescrSet
+
+#endif
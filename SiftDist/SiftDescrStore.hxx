@@ -0,0 +1,353 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DESCR_STORE__HXX
+#define _OFIRPELE_SIFT_DESCR_STORE__HXX
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIFT_DESCR_STORE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+/// A binary file of SIFT-like descriptors and their frames that can be
+/// memory mapped and given as is to SiftDist, SiftRatioMatchImpl etc.
+/// Layout (native byte order, all offsets in bytes from the file start):
+///   header        SiftDescrStoreHeader (64 bytes)
+///   descriptors   count columns of NBO*NBP*NBP elements (as descr in SiftRatioMatch),
+///                 at descrOffset. The elements are double, or quantized
+///                 unsigned char / unsigned short (see elemType).
+///   frames        count columns of FRAMES_COL_SIZE doubles (as frames in
+///                 SiftRatioMatch: x, y, scale, orientation), at framesOffset
+/// Both sections start at a multiple of alignment.
+struct SiftDescrStoreHeader {
+
+    enum { ELEM_DOUBLE= 1, ELEM_UINT8= 2, ELEM_UINT16= 3 };
+    static const uint32_t VERSION= 1;
+    static const uint32_t BYTE_ORDER_MARK= 0x01020304u;
+    static const uint32_t FRAMES_COL_SIZE= 4;
+    static const uint32_t ALIGNMENT= 64;
+
+    char magic[8];          // "SIFTDSC\0"
+    uint32_t version;
+    uint32_t byteOrderMark; // BYTE_ORDER_MARK as written by the machine that wrote the file
+    uint32_t NBO;
+    uint32_t NBP;
+    uint32_t elemType;
+    uint32_t elemBytes;
+    uint64_t count;
+    uint32_t alignment;
+    uint32_t framesColSize;
+    uint64_t descrOffset;
+    uint64_t framesOffset;
+
+    static const char* MAGIC() { return "SIFTDSC"; }
+
+    static uint64_t alignUp(uint64_t offset) {
+        return ((offset+ALIGNMENT-1)/ALIGNMENT)*ALIGNMENT;
+    }
+
+    static uint32_t elemTypeBytes(uint32_t type) {
+        switch (type) {
+        case ELEM_DOUBLE: return sizeof(double);
+        case ELEM_UINT8:  return sizeof(unsigned char);
+        case ELEM_UINT16: return sizeof(unsigned short);
+        }
+        return 0;
+    }
+
+    void init(unsigned int nbo, unsigned int nbp, uint32_t elem_type) {
+        memset(this, 0, sizeof(*this));
+        memcpy(magic, MAGIC(), 8);
+        version= VERSION;
+        byteOrderMark= BYTE_ORDER_MARK;
+        NBO= nbo;
+        NBP= nbp;
+        elemType= elem_type;
+        elemBytes= elemTypeBytes(elem_type);
+        alignment= ALIGNMENT;
+        framesColSize= FRAMES_COL_SIZE;
+        descrOffset= alignUp(sizeof(SiftDescrStoreHeader));
+    }
+
+    uint64_t siftDim() const { return static_cast<uint64_t>(NBO)*NBP*NBP; }
+
+    /// Returns NULL if the header is valid for a file of file_size bytes,
+    /// otherwise the reason it is not.
+    const char* check(uint64_t file_size) const {
+        if (memcmp(magic, MAGIC(), 8)!=0) return "not a SIFT descriptors store file";
+        if (byteOrderMark!=BYTE_ORDER_MARK) return "the file was written with a different byte order";
+        if (version!=VERSION) return "unsupported version";
+        if (elemTypeBytes(elemType)==0||elemBytes!=elemTypeBytes(elemType)) return "unsupported element type";
+        if (NBO<2||NBP<1||NBP>0xFFFFu||siftDim()>0xFFFFFFFFu) return "invalid NBO or NBP";
+        if (framesColSize!=FRAMES_COL_SIZE) return "unsupported frames layout";
+        if (alignment==0||descrOffset%alignment!=0||framesOffset%alignment!=0) return "misaligned sections";
+        if (descrOffset<sizeof(SiftDescrStoreHeader)) return "invalid descriptors offset";
+        if (count>0xFFFFFFFFu) return "too many descriptors";
+        // The sizes are compared by division, so that corrupt offsets and
+        // counts can not overflow
+        const uint64_t descr_bytes= siftDim()*elemBytes;
+        const uint64_t frame_bytes= framesColSize*sizeof(double);
+        if (descrOffset>file_size||count>(file_size-descrOffset)/descr_bytes) return "truncated file";
+        if (framesOffset<descrOffset+count*descr_bytes) return "invalid frames offset";
+        if (framesOffset>file_size||count>(file_size-framesOffset)/frame_bytes) return "truncated file";
+        return NULL;
+    }
+
+}; // end SiftDescrStoreHeader
+
+
+/// The SiftDescrStoreHeader::elemType of descriptors of type NUM_T
+template<typename NUM_T> struct SiftDescrStoreElem;
+template<> struct SiftDescrStoreElem<double> { enum { TYPE= SiftDescrStoreHeader::ELEM_DOUBLE }; };
+template<> struct SiftDescrStoreElem<unsigned char> { enum { TYPE= SiftDescrStoreHeader::ELEM_UINT8 }; };
+template<> struct SiftDescrStoreElem<unsigned short> { enum { TYPE= SiftDescrStoreHeader::ELEM_UINT16 }; };
+
+
+/// Read only access to a SiftDescrStoreHeader file. The file is memory
+/// mapped where possible (POSIX), otherwise it is read to memory.
+/// Usage:
+///   SiftDescrStore store;
+///   if (!store.open("descrs.sds")) { ... store.error() ... }
+///   SiftRatioMatchImpl<...>(store.descr(), store.frames(), store.size(), ...,
+///                           SiftDescrStore::FRAMES_COL_SIZE, 0, 1, 2, ...);
+/// For quantized stores use store.descr<unsigned char>() etc.
+class SiftDescrStore {
+
+public:
+
+    static const int FRAMES_COL_SIZE= SiftDescrStoreHeader::FRAMES_COL_SIZE;
+
+    SiftDescrStore() : _data(NULL), _data_size(0) {}
+    ~SiftDescrStore() { close(); }
+
+    /// Returns false (and sets error()) if the file can not be opened or is invalid.
+    bool open(const char* path) {
+        close();
+        if (!map(path)) return false;
+        if (_data_size<sizeof(SiftDescrStoreHeader)) {
+            return fail(std::string(path)+": too short for a header");
+        }
+        memcpy(&_header, _data, sizeof(_header));
+        const char* err= _header.check(_data_size);
+        if (err!=NULL) return fail(std::string(path)+": "+err);
+        return true;
+    }
+
+    void close() {
+#ifdef SIFT_DESCR_STORE_MMAP
+        if (_data!=NULL) munmap(const_cast<char*>(_data), _data_size);
+#endif
+        _data= NULL;
+        _data_size= 0;
+        _buf.clear();
+    }
+
+    bool isOpen() const { return _data!=NULL; }
+    const std::string& error() const { return _error; }
+
+    unsigned int NBO() const { return _header.NBO; }
+    unsigned int NBP() const { return _header.NBP; }
+    unsigned int siftDim() const { return static_cast<unsigned int>(_header.siftDim()); }
+    unsigned int size() const { return static_cast<unsigned int>(_header.count); }
+
+    /// SiftDescrStoreHeader::ELEM_DOUBLE, ELEM_UINT8 or ELEM_UINT16
+    unsigned int elemType() const { return _header.elemType; }
+
+    /// size() descriptors, siftDim() NUM_T each. NUM_T must match elemType().
+    template<typename NUM_T>
+    const NUM_T* descr() const {
+        assert(static_cast<unsigned int>(SiftDescrStoreElem<NUM_T>::TYPE)==elemType());
+        return reinterpret_cast<const NUM_T*>(_data+_header.descrOffset);
+    }
+    template<typename NUM_T>
+    const NUM_T* descr(unsigned int i) const { return descr<NUM_T>() + static_cast<size_t>(i)*siftDim(); }
+    const double* descr() const { return descr<double>(); }
+    const double* descr(unsigned int i) const { return descr<double>(i); }
+    /// size() frames, FRAMES_COL_SIZE doubles each
+    const double* frames() const { return reinterpret_cast<const double*>(_data+_header.framesOffset); }
+
+private:
+
+    SiftDescrStore(const SiftDescrStore&);
+    SiftDescrStore& operator=(const SiftDescrStore&);
+
+    bool fail(const std::string& err) {
+        close();
+        _error= err;
+        return false;
+    }
+
+    bool map(const char* path) {
+#ifdef SIFT_DESCR_STORE_MMAP
+        int fd= ::open(path, O_RDONLY);
+        if (fd<0) return fail(std::string("can not open ")+path);
+        struct stat st;
+        if (fstat(fd, &st)!=0) {
+            ::close(fd);
+            return fail(std::string("can not stat ")+path);
+        }
+        _data_size= static_cast<size_t>(st.st_size);
+        if (_data_size==0) {
+            ::close(fd);
+            return fail(std::string(path)+": empty file");
+        }
+        void* p= mmap(NULL, _data_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p==MAP_FAILED) return fail(std::string("can not map ")+path);
+        _data= static_cast<const char*>(p);
+        return true;
+#else
+        FILE* f= fopen(path, "rb");
+        if (f==NULL) return fail(std::string("can not open ")+path);
+        std::vector<char> bytes;
+        char chunk[1<<16];
+        size_t n;
+        while ((n= fread(chunk, 1, sizeof(chunk), f))>0) bytes.insert(bytes.end(), chunk, chunk+n);
+        fclose(f);
+        if (bytes.empty()) return fail(std::string(path)+": empty file");
+        // Copied to an ALIGNMENT aligned address, as mmap would
+        const size_t align= SiftDescrStoreHeader::ALIGNMENT;
+        _buf.resize(bytes.size()+align);
+        size_t skip= (align - reinterpret_cast<size_t>(&_buf[0])%align)%align;
+        memcpy(&_buf[skip], &bytes[0], bytes.size());
+        _data_size= bytes.size();
+        _data= &_buf[skip];
+        return true;
+#endif
+    }
+
+    SiftDescrStoreHeader _header;
+    const char* _data;
+    size_t _data_size;
+    // Without mmap, the file content
+    std::vector<char> _buf;
+    std::string _error;
+
+}; // end class SiftDescrStore
+
+
+/// Writes a SiftDescrStoreHeader file one descriptor (or a few) at a time.
+/// The descriptors are written as they come, the frames (which are small)
+/// are kept in memory and written by close(), which also fills the header.
+class SiftDescrStoreWriter {
+
+public:
+
+    SiftDescrStoreWriter() : _f(NULL) {}
+    ~SiftDescrStoreWriter() { close(); }
+
+    /// @param elemType SiftDescrStoreHeader::ELEM_DOUBLE, ELEM_UINT8 or ELEM_UINT16,
+    /// the type of the descriptors given to append.
+    bool open(const char* path, unsigned int NBO, unsigned int NBP,
+              unsigned int elemType= SiftDescrStoreHeader::ELEM_DOUBLE) {
+        close();
+        _error.clear();
+        if (SiftDescrStoreHeader::elemTypeBytes(elemType)==0) return fail("unsupported element type");
+        _header.init(NBO, NBP, elemType);
+        _frames.clear();
+        _f= fopen(path, "wb");
+        if (_f==NULL) return fail(std::string("can not create ")+path);
+        // The header is written again by close()
+        if (!writeZeros(_header.descrOffset)) return false;
+        return true;
+    }
+
+    /// Appends n descriptors (NBO*NBP*NBP NUM_T each, NUM_T of the elemType
+    /// given to open) and their frames (SiftDescrStore::FRAMES_COL_SIZE doubles each).
+    template<typename NUM_T>
+    bool append(const NUM_T* descr, const double* frames, unsigned int n= 1) {
+        if (_f==NULL) return fail("not open");
+        if (static_cast<uint32_t>(SiftDescrStoreElem<NUM_T>::TYPE)!=_header.elemType) return fail("wrong element type");
+        size_t descr_num= static_cast<size_t>(n*_header.siftDim());
+        if (fwrite(descr, sizeof(NUM_T), descr_num, _f)!=descr_num) return fail("write failed");
+        _frames.insert(_frames.end(), frames, frames+n*SiftDescrStoreHeader::FRAMES_COL_SIZE);
+        _header.count+= n;
+        return true;
+    }
+
+    /// Writes the frames and the header. Returns false if something failed
+    /// since open.
+    bool close() {
+        if (_f==NULL) return _error.empty();
+        uint64_t descr_end= _header.descrOffset + _header.count*_header.siftDim()*_header.elemBytes;
+        _header.framesOffset= SiftDescrStoreHeader::alignUp(descr_end);
+        bool ok= _error.empty()
+            && writeZeros(_header.framesOffset-descr_end)
+            && (_frames.empty() || fwrite(&_frames[0], sizeof(double), _frames.size(), _f)==_frames.size())
+            && fseek(_f, 0, SEEK_SET)==0
+            && fwrite(&_header, sizeof(_header), 1, _f)==1;
+        if (fclose(_f)!=0) ok= false;
+        _f= NULL;
+        _frames.clear();
+        if (!ok&&_error.empty()) _error= "write failed";
+        return ok;
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(_header.count); }
+    const std::string& error() const { return _error; }
+
+private:
+
+    SiftDescrStoreWriter(const SiftDescrStoreWriter&);
+    SiftDescrStoreWriter& operator=(const SiftDescrStoreWriter&);
+
+    bool fail(const std::string& err) {
+        if (_error.empty()) _error= err;
+        return false;
+    }
+
+    bool writeZeros(uint64_t n) {
+        static const char zeros[SiftDescrStoreHeader::ALIGNMENT]= {0};
+        while (n>0) {
+            size_t m= static_cast<size_t>(n<sizeof(zeros) ? n : sizeof(zeros));
+            if (fwrite(zeros, 1, m, _f)!=m) return fail("write failed");
+            n-= m;
+        }
+        return true;
+    }
+
+    FILE* _f;
+    SiftDescrStoreHeader _header;
+    std::vector<double> _frames;
+    std::string _error;
+
+}; // end class SiftDescrStoreWriter
+
+#endif
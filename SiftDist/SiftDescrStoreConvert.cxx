@@ -0,0 +1,166 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+// Converts descriptors and frames saved from Matlab as ASCII matrices, e.g.:
+//   save -ascii descr.txt descr     % (NBO*NBP*NBP) x n
+//   save -ascii frames.txt frames   % 4 x n (x, y, scale, orientation)
+// to a SiftDescrStore file that can be memory mapped (see SiftDescrStore.hxx).
+// Usage: SiftDescrStoreConvert descr.txt frames.txt NBO NBP out.sds [double|uint8|uint16]
+// With uint8 or uint16 the descriptors entries should be integers in range.
+
+#include "SiftDescrStore.hxx"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Reads a whitespace separated matrix, one row per line. Returns false if the
+// file can not be read or its rows do not have the same length.
+static bool readMatrix(const char* path, std::vector< std::vector<double> >& rows) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "can not open %s\n", path);
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::vector<double> row;
+        double v;
+        while (ls >> v) row.push_back(v);
+        if (!ls.eof()) {
+            fprintf(stderr, "%s: not a number in row %u\n", path, static_cast<unsigned int>(rows.size()+1));
+            return false;
+        }
+        if (row.empty()) continue;
+        if (!rows.empty()&&row.size()!=rows[0].size()) {
+            fprintf(stderr, "%s: row %u has %u columns instead of %u\n", path,
+                    static_cast<unsigned int>(rows.size()+1), static_cast<unsigned int>(row.size()),
+                    static_cast<unsigned int>(rows[0].size()));
+            return false;
+        }
+        rows.push_back(row);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+
+    if (argc!=6&&argc!=7) {
+        fprintf(stderr, "Usage: %s descr.txt frames.txt NBO NBP out.sds [double|uint8|uint16]\n", argv[0]);
+        return 1;
+    }
+    std::string elem= argc==7 ? argv[6] : "double";
+    unsigned int elemType;
+    double elemMax;
+    if (elem=="double") {
+        elemType= SiftDescrStoreHeader::ELEM_DOUBLE;
+        elemMax= 0;
+    } else if (elem=="uint8") {
+        elemType= SiftDescrStoreHeader::ELEM_UINT8;
+        elemMax= 255;
+    } else if (elem=="uint16") {
+        elemType= SiftDescrStoreHeader::ELEM_UINT16;
+        elemMax= 65535;
+    } else {
+        fprintf(stderr, "Unknown element type %s\n", elem.c_str());
+        return 1;
+    }
+    int NBO= atoi(argv[3]);
+    int NBP= atoi(argv[4]);
+    if (NBO<2||NBP<1) {
+        fprintf(stderr, "NBO should be at least 2 and NBP at least 1\n");
+        return 1;
+    }
+    const unsigned int sift_dim= NBO*NBP*NBP;
+    const unsigned int frames_col_size= SiftDescrStore::FRAMES_COL_SIZE;
+
+    std::vector< std::vector<double> > descr_rows, frames_rows;
+    if (!readMatrix(argv[1], descr_rows)||!readMatrix(argv[2], frames_rows)) return 1;
+    if (descr_rows.size()!=sift_dim) {
+        fprintf(stderr, "%s should have NBO*NBP*NBP=%u rows, it has %u\n", argv[1], sift_dim,
+                static_cast<unsigned int>(descr_rows.size()));
+        return 1;
+    }
+    if (frames_rows.size()!=frames_col_size) {
+        fprintf(stderr, "%s should have %u rows, it has %u\n", argv[2], frames_col_size,
+                static_cast<unsigned int>(frames_rows.size()));
+        return 1;
+    }
+    const unsigned int n= static_cast<unsigned int>(descr_rows[0].size());
+    if (frames_rows[0].size()!=n) {
+        fprintf(stderr, "%s has %u descriptors but %s has %u frames\n", argv[1], n, argv[2],
+                static_cast<unsigned int>(frames_rows[0].size()));
+        return 1;
+    }
+
+    if (elemMax>0) {
+        for (unsigned int d=0; d<sift_dim; ++d) {
+            for (unsigned int i=0; i<n; ++i) {
+                double v= descr_rows[d][i];
+                if (v<0||v>elemMax||v!=static_cast<double>(static_cast<unsigned int>(v))) {
+                    fprintf(stderr, "%s: %g (row %u column %u) is not a %s\n", argv[1], v, d+1, i+1, elem.c_str());
+                    return 1;
+                }
+            }
+        }
+    }
+
+    SiftDescrStoreWriter writer;
+    if (!writer.open(argv[5], NBO, NBP, elemType)) {
+        fprintf(stderr, "%s\n", writer.error().c_str());
+        return 1;
+    }
+    std::vector<double> descr(sift_dim), frame(frames_col_size);
+    std::vector<unsigned char> descr_u8(sift_dim);
+    std::vector<unsigned short> descr_u16(sift_dim);
+    for (unsigned int i=0; i<n; ++i) {
+        for (unsigned int d=0; d<sift_dim; ++d) {
+            descr[d]= descr_rows[d][i];
+            descr_u8[d]= static_cast<unsigned char>(descr[d]);
+            descr_u16[d]= static_cast<unsigned short>(descr[d]);
+        }
+        for (unsigned int d=0; d<frames_col_size; ++d) frame[d]= frames_rows[d][i];
+        if (elemType==SiftDescrStoreHeader::ELEM_UINT8) {
+            writer.append(&descr_u8[0], &frame[0]);
+        } else if (elemType==SiftDescrStoreHeader::ELEM_UINT16) {
+            writer.append(&descr_u16[0], &frame[0]);
+        } else {
+            writer.append(&descr[0], &frame[0]);
+        }
+    }
+    if (!writer.close()) {
+        fprintf(stderr, "%s: %s\n", argv[5], writer.error().c_str());
+        return 1;
+    }
+    printf("%u descriptors written to %s\n", n, argv[5]);
+    return 0;
+
+} // end main
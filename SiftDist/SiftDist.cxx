@@ -28,7 +28,8 @@
 
 #include <mex.h>
 #include "mexCheckAndExtractInputs.hxx"
-#include "SiftDist.hxx"
+#include "SiftMatch.hxx"
+
 
 void mexFunction(int nout, mxArray *out[], 
                  int nin, const mxArray *in[]) {
@@ -89,16 +90,14 @@ void mexFunction(int nout, mxArray *out[],
       //-------------------------------------------------------
       // Create and fill output
       //-------------------------------------------------------
-      SiftDist<double> sd(NBO, CELLS_NUM);
-
       out[0]= mxCreateDoubleMatrix(sift_num1, sift_num2, mxREAL);
       double* dists= (double*)mxGetData(out[0]);
-      unsigned int SIFT_DIM= NBO*CELLS_NUM;
-      for(unsigned int j=0,f2=0,j_mult_sift_num1=0; j<sift_num2; ++j,f2+=SIFT_DIM,j_mult_sift_num1+=sift_num1){
-	    for(unsigned int i=0,f1=0; i<sift_num1; ++i,f1+=SIFT_DIM){
-		  (*(dists+j_mult_sift_num1+i))= sd(descr1+f1, descr2+f2, stopThresholdsArr);
-	    }
-      }
+
+      siftDistMatrix(descr1, sift_num1,
+                     descr2, sift_num2,
+                     NBO, CELLS_NUM,
+                     stopThresholdsArr,
+                     dists);
       //-------------------------------------------------------
 
       delete[] stopThresholdsArr;
@@ -31,24 +31,95 @@
 
 #include "NumTypeZero.hxx"
 #include "MyMinMax.hxx"
+#include "SiftDistCounters.hxx"
 #include <cassert>
-// For the cyclic edge special case:
+#include <cstddef> // NULL
+// For the cyclic edge scratch arrays and SiftDistPruneStats:
 #include <vector>
 
 
+/// How the SiftDist::prunedDist calls ended. Used for tuning the
+/// stop thresholds (e.g. stopThresholdsFactorGamma in SiftRatioMatch).
+struct SiftDistPruneStats {
+
+    explicit SiftDistPruneStats(unsigned int CELLS_NUM= 0)
+        : pairs(0), boundStops(0), thresholdStops(0), cellsComputed(0),
+          stopsAtCell(CELLS_NUM, 0), cascadePairs(0), cascadeSkips(0) {}
+
+    /// Number of pairs
+    unsigned long long pairs;
+    /// Pairs stopped because their lower bound reached the last stop threshold
+    unsigned long long boundStops;
+    /// Pairs stopped because their distance reached a stop threshold
+    unsigned long long thresholdStops;
+    /// Number of cells (addEmdTModForWindow calls) computed for all pairs
+    unsigned long long cellsComputed;
+    /// stopsAtCell[i] is the number of pairs (of both kinds of stops) that
+    /// were stopped after computing i cells
+    std::vector<unsigned long long> stopsAtCell;
+    /// Pairs of the cascade of SiftRatioMatcher, and the ones of them that were
+    /// not computed at all (not in pairs) as their lower bound reached the last
+    /// stop threshold
+    unsigned long long cascadePairs;
+    unsigned long long cascadeSkips;
+
+    void add(const SiftDistPruneStats& o) {
+        pairs+= o.pairs;
+        boundStops+= o.boundStops;
+        thresholdStops+= o.thresholdStops;
+        cellsComputed+= o.cellsComputed;
+        cascadePairs+= o.cascadePairs;
+        cascadeSkips+= o.cascadeSkips;
+        if (stopsAtCell.size()<o.stopsAtCell.size()) stopsAtCell.resize(o.stopsAtCell.size(), 0);
+        for (unsigned int i=0; i<o.stopsAtCell.size(); ++i) stopsAtCell[i]+= o.stopsAtCell[i];
+    }
+
+}; // end SiftDistPruneStats
+
+
+/// The type SiftDist<NUM_T> computes distances in. Quantized descriptors
+/// (unsigned 8 and 16 bit) are widened to unsigned int, which is enough for
+/// any practical descriptor (the distance is at most twice the sum of the
+/// bins). All the intermediate values of the computation are non-negative,
+/// so unsigned types are fine.
+template<typename NUM_T>
+struct SiftDistAccum {
+    typedef NUM_T DIST_T;
+};
+
+template<>
+struct SiftDistAccum<unsigned char> {
+    typedef unsigned int DIST_T;
+};
+
+template<>
+struct SiftDistAccum<unsigned short> {
+    typedef unsigned int DIST_T;
+};
+
+
 /// This class has operator() which returns the SiftDist
 /// as defined in the paper:
 /// A Linear Time Histogram Metric for Improved SIFT Matching
 /// Ofir Pele, Michael Werman
 /// ECCV 2008
 ///
-///@param NUM_T the type of numbers. Must be signed. Its zero
+///@param NUM_T the type of the descriptors entries. Distances (and stop
+/// thresholds, cells masses) are of type DIST_T (see SiftDistAccum), which
+/// is NUM_T unless NUM_T is unsigned char or unsigned short. Its zero
 /// value must be defined in NumTypeZero.hxx
-template<typename NUM_T>
+///@param FIXED_NBO, FIXED_CELLS_NUM if not 0, NBO and CELLS_NUM are known
+/// at compile time (and must be equal to the ones given to the constructor).
+/// The loops over the orientation bins and over the cells then have
+/// compile time bounds and the cyclic edge case uses fixed size arrays.
+/// See SiftDistDispatch.hxx for choosing an instance at runtime.
+template<typename NUM_T, unsigned int FIXED_NBO=0, unsigned int FIXED_CELLS_NUM=0>
 class SiftDist {
             
 public:
 
+    typedef typename SiftDistAccum<NUM_T>::DIST_T DIST_T;
+
     /// @param NBO the number of orientation bins
     /// (original SIFT had 8 bins, but in my paper
     /// I found that 16 gives better results with
@@ -60,12 +131,18 @@ public:
     SiftDist(unsigned int NBO,
              unsigned int CELLS_NUM) 
              
-        : NUM_T_ZERO(NumTypeZero<NUM_T>::ZERO()),
+        : DIST_T_ZERO(NumTypeZero<DIST_T>::ZERO()),
           _NBO(NBO),
-          _CELLS_NUM(CELLS_NUM)
+          _CELLS_NUM(CELLS_NUM),
+          _pruneStats(CELLS_NUM),
+          _counters(CELLS_NUM),
+          _cyclicScratchVec(FIXED_NBO>0 ? 0 : 3*NBO),
+          _cyclicIndsScratchVec(FIXED_NBO>0 ? 0 : NBO)
         {
             assert(NBO>1);
             assert(CELLS_NUM>0);
+            assert(FIXED_NBO==0||FIXED_NBO==NBO);
+            assert(FIXED_CELLS_NUM==0||FIXED_CELLS_NUM==CELLS_NUM);
         }
     
     /// Returns the SiftDist between the two SIFT-like
@@ -87,45 +164,139 @@ public:
     /// i.e: if the distance after computing the distance for cell number i is greater
     /// or equal to stopThresholdsArr[i] we stop the computation and return stopThresholdsArr[CELLS_NUM-1]
     /// If NULL it is ignored.
-    NUM_T operator()(const NUM_T* sift1, 
+    DIST_T operator()(const NUM_T* sift1, 
                      const NUM_T* sift2,
-                     const NUM_T* stopThresholdsArr=NULL) {
+                     const DIST_T* stopThresholdsArr=NULL) {
         
-        _dist= NUM_T_ZERO;
+        _dist= DIST_T_ZERO;
+        SIFT_DIST_COUNT(++_counters.pairs);
         
 	    // Runs until _CELLS_NUM-2 and does another
 	    // addEmdTModForWindow outside in order
 	    // to save the time of the two sift1+= sift2+=
-	    for (unsigned int i=0; i<_CELLS_NUM-1; ++i) {
+	    for (unsigned int i=0; i<cellsNum()-1; ++i) {
             addEmdTModForWindow(sift1, sift2);
             if (stopThresholdsArr) {
                 if (_dist>=stopThresholdsArr[i]) {
-                    return stopThresholdsArr[_CELLS_NUM-1];
+                    SIFT_DIST_COUNT(++_counters.stopsAtCell[i+1]);
+                    return stopThresholdsArr[cellsNum()-1];
                 }
             }
-            sift1+= _NBO;
-            sift2+= _NBO;
+            sift1+= nbo();
+            sift2+= nbo();
 	    } // i
         addEmdTModForWindow(sift1, sift2);
 	    
 	    return _dist;
 	    
     } // operator()
+
+    /// Sum of a cell's bins (as used by prunedDist)
+    static DIST_T cellMass(const NUM_T* cell, unsigned int NBO) {
+        DIST_T m= NumTypeZero<DIST_T>::ZERO();
+        for (unsigned int k=0; k<NBO; ++k) m+= cell[k];
+        return m;
+    }
+
+    /// A stricter operator() for when most pairs are far.
+    /// The cells are computed in the order cellsOrder (e.g. cells with more
+    /// mass first, where most of the distance is), and stopThresholdsArr[i]
+    /// is checked after the i'th computed cell. In addition, the computation
+    /// stops as soon as the distance so far plus a lower bound of the
+    /// distance of the cells that are left reaches stopThresholdsArr[CELLS_NUM-1].
+    /// The lower bound of a cell is 2*|cellsMass1[c]-cellsMass2[c]|, as each
+    /// unit of mass that is not matched costs the threshold, 2.
+    /// In both cases stopThresholdsArr[CELLS_NUM-1] is returned.
+    /// @param cellsMass1, cellsMass2 cellMass of each of the cells of sift1, sift2.
+    /// @param cellsOrder a permutation of 0..CELLS_NUM-1 or NULL for the usual order.
+    /// Counts how it ended in pruneStats().
+    DIST_T prunedDist(const NUM_T* sift1,
+                     const NUM_T* sift2,
+                     const DIST_T* stopThresholdsArr,
+                     const DIST_T* cellsMass1,
+                     const DIST_T* cellsMass2,
+                     const unsigned int* cellsOrder) {
+
+        assert(stopThresholdsArr!=NULL);
+        const unsigned int NBO= nbo();
+        const unsigned int CELLS_NUM= cellsNum();
+        const DIST_T stopThreshold= stopThresholdsArr[CELLS_NUM-1];
+        ++_pruneStats.pairs;
+        SIFT_DIST_COUNT(++_counters.pairs);
+
+        DIST_T bound= cellsBound(cellsMass1, cellsMass2);
+
+        _dist= DIST_T_ZERO;
+        for (unsigned int i=0; i<CELLS_NUM; ++i) {
+            if (_dist+bound>=stopThreshold) {
+                ++_pruneStats.boundStops;
+                ++_pruneStats.stopsAtCell[i];
+                SIFT_DIST_COUNT(++_counters.stopsAtCell[i]);
+                _pruneStats.cellsComputed+= i;
+                return stopThreshold;
+            }
+            unsigned int c= cellsOrder!=NULL ? cellsOrder[i] : i;
+            addEmdTModForWindow(sift1+c*NBO, sift2+c*NBO);
+            bound-= cellBound(cellsMass1[c], cellsMass2[c]);
+            if (i<CELLS_NUM-1 && _dist>=stopThresholdsArr[i]) {
+                ++_pruneStats.thresholdStops;
+                ++_pruneStats.stopsAtCell[i+1];
+                SIFT_DIST_COUNT(++_counters.stopsAtCell[i+1]);
+                _pruneStats.cellsComputed+= i+1;
+                return stopThreshold;
+            }
+        } // i
+        _pruneStats.cellsComputed+= CELLS_NUM;
+
+        return _dist;
+
+    } // prunedDist
+
+    const SiftDistPruneStats& pruneStats() const { return _pruneStats; }
+    void resetPruneStats() { _pruneStats= SiftDistPruneStats(cellsNum()); }
+
+    /// What was computed since the construction or resetCounters()
+    /// (only with SIFT_DIST_COUNTERS, see "SiftDistCounters.hxx")
+    const SiftDistCounters& counters() const { return _counters; }
+    void resetCounters() { _counters= SiftDistCounters(cellsNum()); }
+
+    /// The lower bound of prunedDist for all the cells
+    DIST_T cellsBound(const DIST_T* cellsMass1, const DIST_T* cellsMass2) const {
+        DIST_T bound= DIST_T_ZERO;
+        for (unsigned int c=0; c<cellsNum(); ++c) {
+            bound+= cellBound(cellsMass1[c], cellsMass2[c]);
+        }
+        return bound;
+    }
+
+    /// The lower bound of prunedDist for one cell
+    static DIST_T cellBound(DIST_T mass1, DIST_T mass2) {
+        DIST_T d= mass1>=mass2 ? mass1-mass2 : mass2-mass1;
+        return d+d;
+    }
     
     
 private:
-    
+
+    unsigned int nbo() const { return FIXED_NBO>0 ? FIXED_NBO : _NBO; }
+    unsigned int cellsNum() const { return FIXED_CELLS_NUM>0 ? FIXED_CELLS_NUM : _CELLS_NUM; }
+
+    // Computes several pairs at once, and uses
+    // cyclicEdgeAddEmdTModForWindow for the lanes that need it.
+    template<unsigned int W> friend struct SiftDistSimdKernel;
+    template<typename T, unsigned int N, unsigned int C> friend class SiftDistMulti;
     
     void addEmdTModForWindow(const NUM_T* Q, const NUM_T* P) {
         
+        SIFT_DIST_COUNT(++_counters.cells);
 	    // The mass that is left after zero-cost
 	    // and one-cost flows
-	    NUM_T sumQ= NUM_T_ZERO;
-	    NUM_T sumP= NUM_T_ZERO;
+	    DIST_T sumQ= DIST_T_ZERO;
+	    DIST_T sumP= DIST_T_ZERO;
 
 	    // After each step we update these two
 	    // for next stage
-	    NUM_T old_P, old_Q;
+	    DIST_T old_P, old_Q;
 	    // j is a running index, declared here because
 	    // of goto jumps
 	    unsigned int j;
@@ -137,7 +308,8 @@ private:
 	    // Note that we will work on i-1 to i - because of
 	    // sumQ and sumP
 	    unsigned int i;
-	    for (i= 1; i<_NBO; ++i) {
+	    const unsigned int NBO= nbo();
+	    for (i= 1; i<NBO; ++i) {
 		  
             // We check if there are NO one-cost edges
             // from i-1 to i
@@ -177,14 +349,14 @@ private:
 	    // i==_NBO
         
 	    // edge between last P and first Q
- 	    if ( (P[_NBO-1]>Q[_NBO-1]) && (Q[0]>P[0]) ) {
-            assert((_NBO%2)==0);
+ 	    if ( (P[NBO-1]>Q[NBO-1]) && (Q[0]>P[0]) ) {
+            assert((NBO%2)==0);
             cyclicEdgeAddEmdTModForWindow(P,Q);
             return;
 	    }
 	    // edge between last Q and first P
- 	    if ( (Q[_NBO-1]>P[_NBO-1]) && (P[0]>Q[0]) ) {
-            assert((_NBO%2)==0);
+ 	    if ( (Q[NBO-1]>P[NBO-1]) && (P[0]>Q[0]) ) {
+            assert((NBO%2)==0);
             cyclicEdgeAddEmdTModForWindow(Q,P);
             return;
 	    }
@@ -200,7 +372,7 @@ private:
 	    old_Q= Q[i];
 	    old_P= P[i];
 	    j= i+1;
-	    while (j<_NBO) {
+	    while (j<NBO) {
             checkDirectionAndAddSmallFlows
                 (Q,P, j,sumQ,sumP,old_Q,old_P);
             ++j;
@@ -232,8 +404,8 @@ private:
     
     void checkDirectionAndAddSmallFlows(const NUM_T* Q, const NUM_T* P,
                                         const unsigned int& j,
-                                        NUM_T& sumQ, NUM_T& sumP,
-                                        NUM_T& old_Q, NUM_T& old_P) {
+                                        DIST_T& sumQ, DIST_T& sumP,
+                                        DIST_T& old_Q, DIST_T& old_P) {
 	    if (old_Q>=old_P) {
             addSmallFlows(Q,P,
                           j,sumQ,sumP,old_Q,old_P);
@@ -245,22 +417,27 @@ private:
     
     void addSmallFlows(const NUM_T* Q, const NUM_T* P,
                        const unsigned int& j,
-                       NUM_T& sumQ, NUM_T& sumP,
-                       NUM_T& old_Q, NUM_T& old_P) {
+                       DIST_T& sumQ, DIST_T& sumP,
+                       DIST_T& old_Q, DIST_T& old_P) {
 	    
-	    NUM_T old_dqp= old_Q-old_P;
+	    // Passed only so that the two calls above are symmetric
+	    (void)sumP;
+	    DIST_T old_dqp= old_Q-old_P;
 	    if (Q[j]>=P[j]) {
+		  SIFT_DIST_COUNT(++_counters.smallFlowsCarry);
 		  sumQ+= old_dqp;
 		  old_Q= Q[j];
 		  old_P= P[j];
 	    } else {
-		  NUM_T dpq= P[j]-Q[j];
-		  old_Q= NUM_T_ZERO;
+		  DIST_T dpq= static_cast<DIST_T>(P[j])-Q[j];
+		  old_Q= DIST_T_ZERO;
 		  if (old_dqp>=dpq) {
+			SIFT_DIST_COUNT(++_counters.smallFlowsAbsorb);
 			_dist+= dpq;
 			sumQ+= old_dqp-dpq;
-			old_P= NUM_T_ZERO;
+			old_P= DIST_T_ZERO;
 		  } else {
+			SIFT_DIST_COUNT(++_counters.smallFlowsFlip);
 			_dist+= old_dqp;
 			old_P= dpq-old_dqp;
 		  }			    
@@ -275,11 +452,22 @@ private:
       // All following methods are for the cyclic edge special case
       
       // Note: as this function is rarely used, I didn't bother
-      // to optimize it.
+      // to optimize it (besides not allocating memory).
       // Assumes that the last cyclic edge is from last Q to first P.
       // i.e: P[0]>Q[0] , Q[1]>P[1] , ... , Q[_NBO-1] > P[_NBO-1]
       // Also assumes that _NBO is even (otherwise there are no cycles)
       void cyclicEdgeAddEmdTModForWindow(const NUM_T* Q, const NUM_T* P) {
+	    SIFT_DIST_COUNT(++_counters.cyclicEdges);
+	    if (FIXED_NBO>0) {
+		  cyclicEdgeAddEmdTModForWindow(Q,P, _cyclicScratch, _cyclicIndsScratch);
+	    } else {
+		  cyclicEdgeAddEmdTModForWindow(Q,P, &_cyclicScratchVec[0], &_cyclicIndsScratchVec[0]);
+	    }
+      } // end cyclicEdgeAddEmdTModForWindow
+
+      // scratch should have 3*NBO entries and inds_scratch NBO entries
+      void cyclicEdgeAddEmdTModForWindow(const NUM_T* Q, const NUM_T* P,
+					 DIST_T* scratch, unsigned int* inds_scratch) {
 	    
 	    // Copy without zeros to cQ,cP.
 	    // i.e:
@@ -300,13 +488,14 @@ private:
 	    // | *<-4-*
 	    // |     /
 	    // \-5---
-	    unsigned int NBO_DIV_2= _NBO/2;
-	    std::vector<NUM_T> cP(NBO_DIV_2);
-	    std::vector<NUM_T> cQ(NBO_DIV_2);
+	    const unsigned int NBO= nbo();
+	    unsigned int NBO_DIV_2= NBO/2;
+	    DIST_T* cP= scratch;
+	    DIST_T* cQ= cP + NBO_DIV_2;
         unsigned int i;
         for (i=0; i<NBO_DIV_2; ++i) {
-		  cP[i]= P[2*i]   - Q[2*i];
-		  cQ[i]= Q[2*i+1] - P[2*i+1];
+		  cP[i]= static_cast<DIST_T>(P[2*i])   - Q[2*i];
+		  cQ[i]= static_cast<DIST_T>(Q[2*i+1]) - P[2*i+1];
 		  assert(cP[i]>0&&cQ[i]>0);
 	    }
 	    
@@ -335,9 +524,13 @@ private:
 	     |     /\
 	     \-5---/
 	    */
-	    std::vector<NUM_T> cP_left(cP);
-	    std::vector<NUM_T> cQ_left(cQ);
-	    std::vector<NUM_T> partial_residual_capacity_vec(_NBO);
+	    DIST_T* cP_left= cQ + NBO_DIV_2;
+	    DIST_T* cQ_left= cP_left + NBO_DIV_2;
+	    for (i=0; i<NBO_DIV_2; ++i) {
+		  cP_left[i]= cP[i];
+		  cQ_left[i]= cQ[i];
+	    }
+	    DIST_T* partial_residual_capacity_vec= cQ_left + NBO_DIV_2;
 	    // The ignored edge
 	    partial_residual_capacity_vec[0]=
 		  myMin(cP[0],cQ[0]); 
@@ -358,18 +551,18 @@ private:
 		  flow(cQ_left,NBO_DIV_2-1,cP_left,0);
 
 	    
-	    NUM_T sumLeftP= NUM_T_ZERO;
-	    NUM_T sumLeftQ= NUM_T_ZERO;
+	    DIST_T sumLeftP= DIST_T_ZERO;
+	    DIST_T sumLeftQ= DIST_T_ZERO;
 	    for (i=0; i<NBO_DIV_2; ++i) {
 		  sumLeftQ+= cQ_left[i];
 	          sumLeftP+= cP_left[i];
 	    }
-	    NUM_T maxSumLeft= myMax(sumLeftQ,sumLeftP);
+	    DIST_T maxSumLeft= myMax(sumLeftQ,sumLeftP);
 	    
 
 	    // vectors of indices
-	    std::vector<unsigned int> targets_vec(NBO_DIV_2);
-	    std::vector<unsigned int> sources_vec(NBO_DIV_2);
+	    unsigned int* targets_vec= inds_scratch;
+	    unsigned int* sources_vec= targets_vec + NBO_DIV_2;
 	    for (i=0; i<NBO_DIV_2; ++i) {
 		  sources_vec[i]= i;
 	    }
@@ -385,14 +578,14 @@ private:
 	    // capacity of critical edge in the "middle-edges"
 	    // i.e: between the nodes of Q ("small-sources")
 	    // to the nodes of P ("small-targets")
-	    NUM_T m_capacity=
+	    DIST_T m_capacity=
 		  partial_residual_capacity_vec[0]; 
 	    // indice that of the next "middle-edge" in
 	    // the partial_residual_capacity_vec from a
 	    // "small-target" to a "small-source"
 	    // (backward edge)
 	    // Note that this index should decrease for next
-	    unsigned int m_t_i= _NBO-1;
+	    unsigned int m_t_i= NBO-1;
 	    // indice that of the next "middle-edge" in
 	    // the partial_residual_capacity_vec from a
 	    // "small-source" to a "small-target"
@@ -409,19 +602,19 @@ private:
 	    // we stop. Thus runs at most NBO_DIV_2 times
 	    while (true) {
 		  
-		  if (m_capacity==NUM_T_ZERO) {
+		  if (m_capacity==DIST_T_ZERO) {
 			(_dist+= maxSumLeft)+= maxSumLeft;
 			return;
 		  }
 
-		  NUM_T s_capacity= cQ_left[ sources_vec[s_i] ];
-		  while (s_capacity==NUM_T_ZERO) {
+		  DIST_T s_capacity= cQ_left[ sources_vec[s_i] ];
+		  while (s_capacity==DIST_T_ZERO) {
 			++s_i;
-			if (s_i==NBO_DIV_2||m_capacity==NUM_T_ZERO) {
+			if (s_i==NBO_DIV_2||m_capacity==DIST_T_ZERO) {
 			      (_dist+= maxSumLeft)+= maxSumLeft;
 			      return;  
 			}
-			assert(m_s_i+1<_NBO);
+			assert(m_s_i+1<NBO);
 			/*
 			  Expand augmented path with these two edges
 			 (s is old source, ns is new source)
@@ -436,14 +629,14 @@ private:
 			s_capacity= cQ_left[ sources_vec[s_i] ];
 		  }
 
-		  NUM_T t_capacity= cP_left[ targets_vec[t_i] ];
-		  while (t_capacity==NUM_T_ZERO) {
+		  DIST_T t_capacity= cP_left[ targets_vec[t_i] ];
+		  while (t_capacity==DIST_T_ZERO) {
 			++t_i;
-			if (t_i==NBO_DIV_2||m_capacity==NUM_T_ZERO) {
+			if (t_i==NBO_DIV_2||m_capacity==DIST_T_ZERO) {
 			      (_dist+= maxSumLeft)+= maxSumLeft;
 			      return;  
 			}
-			assert(m_t_i-1>=0&&m_t_i<_NBO);
+			assert(m_t_i>=1&&m_t_i<NBO);
 			/*
 			  Expand augmented path with these two edges:
 			  (t is old target, nt is new target)
@@ -459,7 +652,7 @@ private:
 			t_capacity= cP_left[ targets_vec[t_i] ];
 		  }
 
-		  NUM_T f= myMin( myMin(s_capacity,t_capacity),m_capacity); 
+		  DIST_T f= myMin( myMin(s_capacity,t_capacity),m_capacity); 
 		  
 		  _dist+= f;
 		  maxSumLeft-= f;
@@ -474,10 +667,10 @@ private:
       } // end cyclicEdgeAddEmdTModForWindow
 
 
-      NUM_T flow(std::vector<NUM_T>& cQ, unsigned int i,
-		std::vector<NUM_T>& cP, unsigned int j) {
+      DIST_T flow(DIST_T* cQ, unsigned int i,
+		DIST_T* cP, unsigned int j) {
 
-	    NUM_T f= myMin(cQ[i],cP[j]);
+	    DIST_T f= myMin(cQ[i],cP[j]);
 	    cQ[i]-= f;
 	    cP[j]-= f;
 	    _dist+= f;
@@ -488,9 +681,20 @@ private:
 
       //-----------------------------------------------------------
 	    
-      NUM_T _dist;
-      const NUM_T NUM_T_ZERO;
+      DIST_T _dist;
+      const DIST_T DIST_T_ZERO;
       unsigned int _NBO, _CELLS_NUM;
+      SiftDistPruneStats _pruneStats;
+      SiftDistCounters _counters;
+
+      // Scratch arrays of the cyclic edge case when NBO is known at compile time
+      static const unsigned int CYCLIC_SCRATCH_NBO= FIXED_NBO>0 ? FIXED_NBO : 1;
+      DIST_T _cyclicScratch[3*CYCLIC_SCRATCH_NBO];
+      unsigned int _cyclicIndsScratch[CYCLIC_SCRATCH_NBO];
+      // Otherwise, allocated once by the constructor so that
+      // the distances never allocate memory
+      std::vector<DIST_T> _cyclicScratchVec;
+      std::vector<unsigned int> _cyclicIndsScratchVec;
       
 }; // end class SiftDist
 
@@ -0,0 +1,233 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DIST_BATCH__HXX
+#define _OFIRPELE_SIFT_DIST_BATCH__HXX
+
+#include "MyMinMax.hxx"
+#include <cassert>
+#include <vector>
+
+
+/// How a distance functor computes a group of pairs. By default the
+/// pairs are computed one by one. Functors that compute several pairs
+/// at once (e.g. SiftDistMulti) specialize it.
+template<typename DISTANCE_T>
+struct SiftDistGroup {
+
+    static unsigned int lanes(const DISTANCE_T&) { return 1; }
+
+    /// dists[l]= sd(sifts1[l], sifts2[l], stopThresholdsArr) for l<pairs_num
+    /// DIST_T is the type of the distances (see SiftDistAccum).
+    template<typename NUM_T, typename DIST_T>
+    static void dists(DISTANCE_T& sd,
+                      const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int pairs_num,
+                      const DIST_T* stopThresholdsArr,
+
+                      DIST_T* dists) {
+        for (unsigned int l=0; l<pairs_num; ++l) {
+            dists[l]= sd(sifts1[l], sifts2[l], stopThresholdsArr);
+        }
+    }
+
+    /// dists[l]= sd.prunedDist(sifts1[l], sifts2[l], stopThresholdsArr,
+    ///                         cellsMass1[l], cellsMass2[l], cellsOrder) for l<pairs_num
+    template<typename NUM_T, typename DIST_T>
+    static void prunedDists(DISTANCE_T& sd,
+                            const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int pairs_num,
+                            const DIST_T* stopThresholdsArr,
+                            const DIST_T* const* cellsMass1, const DIST_T* const* cellsMass2,
+                            const unsigned int* cellsOrder,
+
+                            DIST_T* dists) {
+        for (unsigned int l=0; l<pairs_num; ++l) {
+            dists[l]= sd.prunedDist(sifts1[l], sifts2[l], stopThresholdsArr,
+                                    cellsMass1[l], cellsMass2[l], cellsOrder);
+        }
+    }
+
+}; // end SiftDistGroup
+
+
+/// Computes distances between a block of query SIFT-like descriptors
+/// and a set of database descriptors (one-to-many / many-to-many).
+/// Both sets are tiled: a tile of queries is kept in L2 while a tile of
+/// database descriptors, small enough for L1, is reused by all the
+/// queries in it. Each query still visits the database descriptors
+/// in increasing order, so callers that update their stop thresholds
+/// as they go (e.g. SiftRatioMatchImpl) get exactly the same results
+/// as with a plain loop.
+class SiftDistBatch {
+
+public:
+
+    /// Maximum number of pairs in a group of forEachGroup
+    static const unsigned int MAX_GROUP_SIZE= 16;
+
+    /// @param sift_dim the number of entries in each descriptor (NBO*CELLS_NUM).
+    /// @param elemBytes sizeof of one entry of the descriptors.
+    /// @param L1Bytes cache budget for a tile of database descriptors.
+    /// @param L2Bytes cache budget for a tile of query descriptors.
+    SiftDistBatch(unsigned int sift_dim,
+                  unsigned int elemBytes= sizeof(double),
+                  unsigned int L1Bytes= 24*1024,
+                  unsigned int L2Bytes= 192*1024)
+
+        : _sift_dim(sift_dim)
+        {
+            assert(sift_dim>0);
+            unsigned int descrBytes= sift_dim*elemBytes;
+            _descrTileSize=   myMax(1u, L1Bytes/descrBytes);
+            _queriesTileSize= myMax(1u, L2Bytes/descrBytes);
+        }
+
+    unsigned int queriesTileSize() const { return _queriesTileSize; }
+    unsigned int descrTileSize() const { return _descrTileSize; }
+
+    /// Calls visitor(q, d, queries[q], descr+d*sift_dim) for all
+    /// 0<=q<queries_num, 0<=d<descr_num. For a fixed q, d is increasing.
+    template<typename NUM_T, typename VISITOR>
+    void forEachPair(const NUM_T* const* queries, unsigned int queries_num,
+                     const NUM_T* descr, unsigned int descr_num,
+                     VISITOR& visitor) const {
+
+        for (unsigned int q0=0; q0<queries_num; q0+= _queriesTileSize) {
+            unsigned int q1= myMin(queries_num, q0+_queriesTileSize);
+
+            const NUM_T* descr_d0= descr;
+            for (unsigned int d0=0; d0<descr_num; d0+= _descrTileSize, descr_d0+= _descrTileSize*_sift_dim) {
+                unsigned int d1= myMin(descr_num, d0+_descrTileSize);
+
+                for (unsigned int q=q0; q<q1; ++q) {
+                    const NUM_T* query= queries[q];
+                    const NUM_T* descr_d= descr_d0;
+                    for (unsigned int d=d0; d<d1; ++d, descr_d+= _sift_dim) {
+                        visitor(q, d, query, descr_d);
+                    } // d
+                } // q
+
+            } // d0
+        } // q0
+
+    } // forEachPair
+
+    /// Same as forEachPair but calls visitor(q, d, n, queries[q], descr+d*sift_dim)
+    /// for groups of n<=groupSize consecutive database descriptors.
+    template<typename NUM_T, typename VISITOR>
+    void forEachGroup(const NUM_T* const* queries, unsigned int queries_num,
+                      const NUM_T* descr, unsigned int descr_num,
+                      unsigned int groupSize,
+                      VISITOR& visitor) const {
+
+        assert(groupSize>0&&groupSize<=MAX_GROUP_SIZE);
+        // Whole groups in each tile
+        unsigned int descrTileSize= ((_descrTileSize+groupSize-1)/groupSize)*groupSize;
+
+        for (unsigned int q0=0; q0<queries_num; q0+= _queriesTileSize) {
+            unsigned int q1= myMin(queries_num, q0+_queriesTileSize);
+
+            const NUM_T* descr_d0= descr;
+            for (unsigned int d0=0; d0<descr_num; d0+= descrTileSize, descr_d0+= descrTileSize*_sift_dim) {
+                unsigned int d1= myMin(descr_num, d0+descrTileSize);
+
+                for (unsigned int q=q0; q<q1; ++q) {
+                    const NUM_T* query= queries[q];
+                    const NUM_T* descr_d= descr_d0;
+                    for (unsigned int d=d0; d<d1; d+= groupSize, descr_d+= groupSize*_sift_dim) {
+                        visitor(q, d, myMin(groupSize, d1-d), query, descr_d);
+                    } // d
+                } // q
+
+            } // d0
+        } // q0
+
+    } // forEachGroup
+
+    /// Fills dists, a sift_num1 x sift_num2 column major (Matlab) matrix,
+    /// with sd(descr1(:,i), descr2(:,j), stopThresholdsArr).
+    template<typename DISTANCE_T, typename NUM_T, typename DIST_T>
+    void computeDistsMatrix(DISTANCE_T& sd,
+                            const NUM_T* descr1, unsigned int sift_num1,
+                            const NUM_T* descr2, unsigned int sift_num2,
+                            const DIST_T* stopThresholdsArr,
+
+                            DIST_T* dists) const {
+
+        MatrixVisitor<DISTANCE_T, NUM_T, DIST_T> visitor(sd, stopThresholdsArr, dists, sift_num1, _sift_dim);
+        std::vector<const NUM_T*> queries(_queriesTileSize);
+        for (unsigned int i0=0; i0<sift_num1; i0+= _queriesTileSize) {
+            unsigned int queries_num= myMin(_queriesTileSize, sift_num1-i0);
+            for (unsigned int i=0; i<queries_num; ++i) {
+                queries[i]= descr1 + (i0+i)*_sift_dim;
+            }
+            visitor._dists= dists + i0;
+            forEachGroup(&queries[0], queries_num, descr2, sift_num2,
+                         SiftDistGroup<DISTANCE_T>::lanes(sd),
+                         visitor);
+        } // i0
+
+    } // computeDistsMatrix
+
+private:
+
+    template<typename DISTANCE_T, typename NUM_T, typename DIST_T>
+    struct MatrixVisitor {
+
+        MatrixVisitor(DISTANCE_T& sd, const DIST_T* stopThresholdsArr, DIST_T* dists,
+                      unsigned int sift_num1, unsigned int sift_dim)
+            : _sd(sd), _stopThresholdsArr(stopThresholdsArr), _dists(dists),
+              _sift_num1(sift_num1), _sift_dim(sift_dim) {}
+
+        void operator()(unsigned int i, unsigned int j0, unsigned int n,
+                        const NUM_T* descr1_i, const NUM_T* descr2_j0) {
+            const NUM_T* sifts1[MAX_GROUP_SIZE];
+            const NUM_T* sifts2[MAX_GROUP_SIZE];
+            DIST_T group_dists[MAX_GROUP_SIZE];
+            for (unsigned int l=0; l<n; ++l) {
+                sifts1[l]= descr1_i;
+                sifts2[l]= descr2_j0 + l*_sift_dim;
+            }
+            SiftDistGroup<DISTANCE_T>::dists(_sd, sifts1, sifts2, n, _stopThresholdsArr, group_dists);
+            for (unsigned int l=0; l<n; ++l) {
+                _dists[(j0+l)*_sift_num1 + i]= group_dists[l];
+            }
+        }
+
+        DISTANCE_T& _sd;
+        const DIST_T* _stopThresholdsArr;
+        DIST_T* _dists;
+        unsigned int _sift_num1, _sift_dim;
+    };
+
+    unsigned int _sift_dim;
+    unsigned int _queriesTileSize;
+    unsigned int _descrTileSize;
+
+}; // end class SiftDistBatch
+
+#endif
@@ -0,0 +1,492 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+// Benchmarks of SiftDist, SiftRatioMatchImpl and EMD_MOD. Built without Matlab, e.g.:
+//   g++ -O2 -std=c++11 -pthread -I../EMD_MOD SiftDistBench.cxx -o SiftDistBench
+//   ./SiftDistBench [--quick] [--json results.json] [--real descrs1.sds descrs2.sds]
+// Reports pairs per second, ns per cell (per bin for EMD_MOD), the fraction of
+// pruned pairs and heap allocations per pair, for synthetic descriptors:
+//  sift   - SIFT-like: a dominant orientation per cell, normalized, clamped at
+//           0.2 and renormalized as in Lowe's SIFT, scaled to 0..512.
+//  sqrt   - the same, L1 normalized and square rooted (as "RootSIFT").
+//  cyclic - half the cells go through the cyclic edge case of SiftDist.
+// --real adds the descriptors of two SiftDescrStore files, e.g. of img1.ppm and
+// img3.ppm (computed as in demo_SiftDist.m, saved with "save -ascii" and
+// converted with SiftDescrStoreConvert).
+// Built with SIFT_DIST_COUNTERS (cmake -DSIFTDIST_COUNTERS=ON), the json has
+// the SiftRatioMatchCounters of each SiftRatioMatch row too.
+// The random numbers do not depend on the platform, so runs are comparable.
+// Each measurement is the fastest of a few repetitions.
+
+#include "SiftDist.hxx"
+#include "SiftDistDispatch.hxx"
+#include "SiftRatioMatchImpl.hxx"
+#include "SiftDescrStore.hxx"
+#include "SiftEmdModDist.hxx"
+#include "../EMD_MOD/EMD_MOD.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+
+// Counts the heap allocations of the process
+static unsigned long long g_allocs= 0;
+
+void* operator new(std::size_t n) {
+    ++g_allocs;
+    void* p= malloc(n>0 ? n : 1);
+    if (p==NULL) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, std::size_t) noexcept { free(p); }
+
+
+/// A small random generator whose sequence is the same everywhere
+/// (unlike rand() and the std distributions).
+class BenchRandom {
+public:
+    explicit BenchRandom(unsigned long long seed) : _s(seed*0x9E3779B97F4A7C15ULL+1) {}
+    unsigned long long next() {
+        // xorshift64*
+        _s^= _s>>12; _s^= _s<<25; _s^= _s>>27;
+        return _s*0x2545F4914F6CDD1DULL;
+    }
+    /// Uniform in [0,1)
+    double uniform() { return (next()>>11)*(1.0/9007199254740992.0); }
+    unsigned int below(unsigned int n) { return static_cast<unsigned int>(next()%n); }
+private:
+    unsigned long long _s;
+};
+
+
+/// A set of descriptors with their frames (x, y, scale, orientation)
+struct BenchDescrs {
+    std::vector<double> descr;
+    std::vector<double> frames;
+    unsigned int num;
+};
+
+static void makeFrames(unsigned int n, BenchRandom& rnd, std::vector<double>& frames) {
+    frames.resize(4*n);
+    for (unsigned int i=0; i<n; ++i) {
+        frames[4*i]=   rnd.uniform()*640;
+        frames[4*i+1]= rnd.uniform()*480;
+        frames[4*i+2]= 1.0+rnd.uniform()*8;
+        frames[4*i+3]= rnd.uniform()*2*M_PI;
+    }
+}
+
+/// A SIFT-like descriptor: each cell has its gradient mass around a dominant
+/// orientation, cells far from the center have less mass.
+static void makeSiftLike(unsigned int NBO, unsigned int NBP, BenchRandom& rnd, double* d) {
+    unsigned int sift_dim= NBO*NBP*NBP;
+    double norm2= 0;
+    for (unsigned int c=0; c<NBP*NBP; ++c) {
+        double cx= (c%NBP)-(NBP-1)/2.0, cy= (c/NBP)-(NBP-1)/2.0;
+        double weight= exp(-(cx*cx+cy*cy)/(NBP*NBP/2.0));
+        double dominant= rnd.uniform()*NBO;
+        for (unsigned int b=0; b<NBO; ++b) {
+            double dist= fabs(b-dominant);
+            dist= std::min(dist, NBO-dist);
+            double v= weight*(exp(-dist*dist/2.0)*rnd.uniform()*3 + rnd.uniform()*0.3);
+            d[c*NBO+b]= v;
+            norm2+= v*v;
+        }
+    }
+    double norm= sqrt(norm2);
+    norm2= 0;
+    for (unsigned int k=0; k<sift_dim; ++k) {
+        d[k]= std::min(d[k]/norm, 0.2);
+        norm2+= d[k]*d[k];
+    }
+    norm= sqrt(norm2);
+    for (unsigned int k=0; k<sift_dim; ++k) d[k]= floor(512*d[k]/norm);
+}
+
+/// L1 normalizes and takes the square root of each entry, scaled to 0..512
+static void sqrtNormalize(unsigned int sift_dim, double* d) {
+    double sum= 0;
+    for (unsigned int k=0; k<sift_dim; ++k) sum+= d[k];
+    for (unsigned int k=0; k<sift_dim; ++k) d[k]= floor(512*sqrt(d[k]/std::max(sum, 1.0)));
+}
+
+/// Descriptors where a fraction cyclic_frac of the cells go through the cyclic
+/// edge case of SiftDist when compared to the descriptor at the same index
+/// of the other set (seed 1 and 2 of the same distribution): in such cells the
+/// two descriptors alternate being larger, bin by bin, all around the cell.
+static void makeCyclic(unsigned int NBO, unsigned int NBP, BenchRandom& rnd, bool first,
+                       double cyclic_frac, double* d) {
+    for (unsigned int c=0; c<NBP*NBP; ++c, d+= NBO) {
+        bool cyclic= rnd.uniform()<cyclic_frac;
+        for (unsigned int b=0; b<NBO; ++b) {
+            double low= rnd.below(64), high= low+1+rnd.below(64);
+            if (cyclic) {
+                d[b]= ((b%2)!=0)==first ? high : low;
+            } else {
+                d[b]= rnd.below(128);
+            }
+        }
+    }
+}
+
+/// Two sets of num descriptors of distribution dist. For sift and sqrt, the
+/// first matched_frac of the second set are noisy copies of descriptors of the
+/// first set (so that SiftRatioMatch has matches to find), the rest are distractors.
+static void makeSets(const std::string& dist, unsigned int NBO, unsigned int NBP, unsigned int num,
+                     BenchDescrs& set1, BenchDescrs& set2) {
+    const double matched_frac= 0.5;
+    unsigned int sift_dim= NBO*NBP*NBP;
+    BenchDescrs* sets[2]= {&set1, &set2};
+    for (unsigned int s=0; s<2; ++s) {
+        BenchRandom rnd(s+1);
+        sets[s]->num= num;
+        sets[s]->descr.assign(static_cast<size_t>(num)*sift_dim, 0);
+        makeFrames(num, rnd, sets[s]->frames);
+        for (unsigned int i=0; i<num; ++i) {
+            double* d= &sets[s]->descr[static_cast<size_t>(i)*sift_dim];
+            if (dist=="cyclic") {
+                makeCyclic(NBO, NBP, rnd, s==0, 0.5, d);
+                continue;
+            }
+            if (s==1 && i<matched_frac*num) {
+                unsigned int j= (i*7919u)%num;
+                const double* orig= &set1.descr[static_cast<size_t>(j)*sift_dim];
+                for (unsigned int k=0; k<sift_dim; ++k) {
+                    d[k]= std::max(0.0, floor(orig[k]*(0.8+0.4*rnd.uniform())));
+                }
+                continue;
+            }
+            makeSiftLike(NBO, NBP, rnd, d);
+            if (dist=="sqrt") sqrtNormalize(sift_dim, d);
+        }
+        if (s==1 && dist=="sqrt") {
+            for (unsigned int i=0; i<matched_frac*num; ++i) {
+                sqrtNormalize(sift_dim, &set2.descr[static_cast<size_t>(i)*sift_dim]);
+            }
+        }
+    }
+}
+
+
+/// One measurement: the fastest of the repetitions. ns/cell is per computed
+/// cell when it is known (pruned runs), otherwise per cell of the full
+/// distances. A negative prune_rate is not relevant (not written).
+struct BenchResult {
+    /// seconds is the minimum over the repetitions, so it starts huge;
+    /// prune_rate is -1 where nothing is pruned.
+    BenchResult(const std::string& bench_, const std::string& dist_,
+                unsigned int NBO_, unsigned int NBP_,
+                unsigned long long pairs_, double cells_per_pair_)
+        : bench(bench_), dist(dist_), NBO(NBO_), NBP(NBP_), pairs(pairs_),
+          seconds(1e300), cells_per_pair(cells_per_pair_), prune_rate(-1), allocs_per_pair(0) {}
+    std::string bench, dist;
+    unsigned int NBO, NBP;
+    unsigned long long pairs;
+    double seconds;
+    double cells_per_pair;
+    double prune_rate;
+    double allocs_per_pair;
+    /// SiftRatioMatchCounters as json, if counted
+    std::string counters;
+};
+
+static std::vector<BenchResult> g_results;
+
+static void report(const BenchResult& r) {
+    double pairs_per_s= r.pairs/r.seconds;
+    printf("%-28s %-7s NBO %3u NBP %u: %12.0f pairs/s", r.bench.c_str(), r.dist.c_str(), r.NBO, r.NBP, pairs_per_s);
+    if (r.cells_per_pair>0) printf(" %8.2f ns/cell", 1e9*r.seconds/(r.pairs*r.cells_per_pair));
+    else printf("        - ns/cell");
+    if (r.prune_rate>=0) printf(" %5.1f%% pruned", 100*r.prune_rate);
+    printf(" %6.2f allocs/pair\n", r.allocs_per_pair);
+    g_results.push_back(r);
+}
+
+static bool writeJson(const char* path) {
+    FILE* f= fopen(path, "w");
+    if (f==NULL) return false;
+#ifdef __VERSION__
+    fprintf(f, "{\n  \"compiler\": \"%s\",\n  \"results\": [\n", __VERSION__);
+#else
+    fprintf(f, "{\n  \"results\": [\n");
+#endif
+    for (size_t i=0; i<g_results.size(); ++i) {
+        const BenchResult& r= g_results[i];
+        fprintf(f, "    {\"bench\": \"%s\", \"dist\": \"%s\", \"NBO\": %u, \"NBP\": %u, "
+                "\"pairs\": %llu, \"seconds\": %.6g, \"pairs_per_s\": %.6g, ",
+                r.bench.c_str(), r.dist.c_str(), r.NBO, r.NBP,
+                r.pairs, r.seconds, r.pairs/r.seconds);
+        if (r.cells_per_pair>0) fprintf(f, "\"ns_per_cell\": %.6g, ", 1e9*r.seconds/(r.pairs*r.cells_per_pair));
+        if (r.prune_rate>=0) fprintf(f, "\"prune_rate\": %.6g, ", r.prune_rate);
+        if (!r.counters.empty()) fprintf(f, "\"counters\": %s, ", r.counters.c_str());
+        fprintf(f, "\"allocs_per_pair\": %.6g}%s\n", r.allocs_per_pair, i+1<g_results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f)==0;
+}
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// SiftDist between the descriptors of the same index (operator()), and with
+/// the prunedDist stop thresholds of SiftRatioMatch against a close distance.
+struct BenchSiftDist {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        const unsigned int CELLS_NUM= NBP*NBP, sift_dim= NBO*CELLS_NUM;
+        unsigned int n= std::min(set1->num, set2->num);
+        std::vector<double> masses1(n*CELLS_NUM), masses2(n*CELLS_NUM);
+        for (unsigned int i=0; i<n*CELLS_NUM; ++i) {
+            masses1[i]= SiftDist<double>::cellMass(&set1->descr[i*NBO], NBO);
+            masses2[i]= SiftDist<double>::cellMass(&set2->descr[i*NBO], NBO);
+        }
+        // The stop thresholds of SiftRatioMatch (ratio 1.25, gamma 0.7) for a
+        // best distance of 0.8 of the average distance
+        double avg= 0;
+        for (unsigned int i=0; i<n; ++i) avg+= sd(&set1->descr[i*sift_dim], &set2->descr[i*sift_dim]);
+        avg/= n;
+        std::vector<double> thresholds(CELLS_NUM);
+        for (unsigned int c=0; c<CELLS_NUM; ++c) thresholds[c]= avg*pow((c+1.0)/CELLS_NUM, 0.7);
+
+        for (int pruned=0; pruned<2; ++pruned) {
+            BenchResult r(pruned ? "SiftDist::prunedDist" : "SiftDist", dist, NBO, NBP,
+                          static_cast<unsigned long long>(n), static_cast<double>(CELLS_NUM));
+            double sum= 0;
+            for (unsigned int rep=0; rep<reps; ++rep) {
+                sd.resetPruneStats();
+                unsigned long long allocs0= g_allocs;
+                double t0= now();
+                for (unsigned int i=0; i<n; ++i) {
+                    const double* d1= &set1->descr[i*sift_dim];
+                    const double* d2= &set2->descr[i*sift_dim];
+                    sum+= pruned ? sd.prunedDist(d1, d2, &thresholds[0],
+                                                 &masses1[i*CELLS_NUM], &masses2[i*CELLS_NUM], NULL)
+                                 : sd(d1, d2);
+                }
+                r.seconds= std::min(r.seconds, now()-t0);
+                r.allocs_per_pair= static_cast<double>(g_allocs-allocs0)/n;
+            }
+            if (pruned) {
+                const SiftDistPruneStats& st= sd.pruneStats();
+                r.prune_rate= static_cast<double>(st.boundStops+st.thresholdStops)/st.pairs;
+                r.cells_per_pair= static_cast<double>(st.cellsComputed)/st.pairs;
+            }
+            if (sum<0) printf("%g\n", sum); // keeps the loops
+            report(r);
+        }
+    }
+
+    const BenchDescrs* set1;
+    const BenchDescrs* set2;
+    std::string dist;
+    unsigned int NBO, NBP, reps;
+};
+
+
+/// SiftRatioMatchImpl of all the descriptors of set1 against set2, plain,
+/// with prunedDist and with the cascade (whose prune rate is of the skipped pairs).
+/// name is SiftRatioMatch, or SiftRatioMatchEmdMod for SiftEmdModDist.
+struct BenchSiftRatioMatch {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        const char* modes[]= {"", "+bounds", "+cascade"};
+        for (int mode=0; mode<3; ++mode) {
+            bool pruned= mode==1, cascade= mode==2;
+            unsigned long long pairs= static_cast<unsigned long long>(set1->num)*set2->num;
+            BenchResult r(name+modes[mode], dist, NBO, NBP, pairs, static_cast<double>(NBP*NBP));
+            std::vector<double> inds(set1->num), ratios(set1->num);
+            for (unsigned int rep=0; rep<reps; ++rep) {
+                std::fill(inds.begin(), inds.end(), 0.0);
+                std::fill(ratios.begin(), ratios.end(), 0.0);
+                SiftDistPruneStats stats(NBP*NBP);
+                SiftRatioMatchCounters counters(NBP*NBP);
+                unsigned long long allocs0= g_allocs;
+                double t0= now();
+                SiftRatioMatchImpl<DISTANCE_T>(&set1->descr[0], &set1->frames[0], set1->num,
+                                               &set2->descr[0], &set2->frames[0], set2->num,
+                                               1.25, 0.7, NBO, NBP, 3.0, 0.5, sd,
+                                               4, 0, 1, 2,
+                                               &inds[0], &ratios[0], 1,
+                                               4*1024*1024, pruned, false, &stats, cascade,
+                                               NULL, &counters);
+                r.seconds= std::min(r.seconds, now()-t0);
+                r.allocs_per_pair= static_cast<double>(g_allocs-allocs0)/pairs;
+                if (pruned) {
+                    r.prune_rate= static_cast<double>(stats.boundStops+stats.thresholdStops)/stats.pairs;
+                    r.cells_per_pair= static_cast<double>(stats.cellsComputed)/stats.pairs;
+                }
+                if (cascade) {
+                    r.prune_rate= static_cast<double>(stats.cascadeSkips)/stats.cascadePairs;
+                }
+                if (SiftDistCounters::enabled) {
+                    std::ostringstream json;
+                    counters.writeJson(json);
+                    r.counters= json.str();
+                }
+            }
+            report(r);
+        }
+    }
+
+    const BenchDescrs* set1;
+    const BenchDescrs* set2;
+    std::string dist;
+    unsigned int NBO, NBP, reps;
+    std::string name;
+};
+
+
+/// EMD_MOD between the cells of the descriptors of the same index,
+/// with a reused EmdModWorkspace
+static void benchEmdMod(const BenchDescrs& set1, const BenchDescrs& set2, const std::string& dist,
+                        unsigned int NBO, unsigned int NBP, unsigned int reps) {
+    unsigned int cells= std::min(set1.num, set2.num)*NBP*NBP;
+    // EMD_MOD needs equal masses: the second cell gets the mass difference in its first bin
+    std::vector<double> A(set1.descr.begin(), set1.descr.begin()+cells*NBO);
+    std::vector<double> B(set2.descr.begin(), set2.descr.begin()+cells*NBO);
+    for (unsigned int c=0; c<cells; ++c) {
+        double mA= 0, mB= 0;
+        for (unsigned int b=0; b<NBO; ++b) {
+            mA+= A[c*NBO+b];
+            mB+= B[c*NBO+b];
+        }
+        if (mA>mB) B[c*NBO]+= mA-mB;
+        else A[c*NBO]+= mB-mA;
+    }
+    EmdModWorkspace ws(false, NBO);
+    BenchResult r("EMD_MOD", dist, NBO, NBP, static_cast<unsigned long long>(cells),
+                  static_cast<double>(NBO));
+    double sum= 0;
+    for (unsigned int rep=0; rep<reps; ++rep) {
+        unsigned long long allocs0= g_allocs;
+        double t0= now();
+        for (unsigned int c=0; c<cells; ++c) sum+= EMD_MOD<false>(&A[c*NBO], &B[c*NBO], NBO, ws, NULL);
+        r.seconds= std::min(r.seconds, now()-t0);
+        r.allocs_per_pair= static_cast<double>(g_allocs-allocs0)/cells;
+    }
+    if (sum<0) printf("%g\n", sum);
+    report(r);
+}
+
+
+static void benchAll(const BenchDescrs& set1, const BenchDescrs& set2, const std::string& dist,
+                     unsigned int NBO, unsigned int NBP, unsigned int match_num, unsigned int reps) {
+    BenchSiftDist bsd= { &set1, &set2, dist, NBO, NBP, reps };
+    dispatchSiftDist<double>(NBO, NBP*NBP, bsd);
+
+    // SiftRatioMatch is quadratic, so it gets a prefix of the sets
+    BenchDescrs sub1, sub2;
+    const BenchDescrs* sets[2]= {&set1, &set2};
+    BenchDescrs* subs[2]= {&sub1, &sub2};
+    for (unsigned int s=0; s<2; ++s) {
+        subs[s]->num= std::min(match_num, sets[s]->num);
+        subs[s]->descr.assign(sets[s]->descr.begin(), sets[s]->descr.begin()+subs[s]->num*NBO*NBP*NBP);
+        subs[s]->frames.assign(sets[s]->frames.begin(), sets[s]->frames.begin()+subs[s]->num*4);
+    }
+    BenchSiftRatioMatch bsrm= { &sub1, &sub2, dist, NBO, NBP, reps, "SiftRatioMatch" };
+    dispatchSiftDist<double>(NBO, NBP*NBP, bsrm);
+    // The same matching with EMD_MOD of the cells, for comparing the two
+    SiftEmdModDist emd(NBO, NBP*NBP);
+    BenchSiftRatioMatch bemd= { &sub1, &sub2, dist, NBO, NBP, reps, "SiftRatioMatchEmdMod" };
+    bemd(emd);
+
+    benchEmdMod(set1, set2, dist, NBO, NBP, reps);
+}
+
+static bool loadStore(const char* path, BenchDescrs& set, unsigned int& NBO, unsigned int& NBP) {
+    SiftDescrStore store;
+    if (!store.open(path) || store.elemType()!=SiftDescrStoreHeader::ELEM_DOUBLE) {
+        fprintf(stderr, "%s: %s\n", path, store.isOpen() ? "not double descriptors" : store.error().c_str());
+        return false;
+    }
+    NBO= store.NBO();
+    NBP= store.NBP();
+    set.num= store.size();
+    set.descr.assign(store.descr(), store.descr()+static_cast<size_t>(set.num)*store.siftDim());
+    set.frames.assign(store.frames(), store.frames()+static_cast<size_t>(set.num)*4);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* json_path= NULL;
+    const char* real_paths[2]= {NULL, NULL};
+    bool quick= false;
+    for (int a=1; a<argc; ++a) {
+        if (strcmp(argv[a], "--json")==0 && a+1<argc) {
+            json_path= argv[++a];
+        } else if (strcmp(argv[a], "--real")==0 && a+2<argc) {
+            real_paths[0]= argv[++a];
+            real_paths[1]= argv[++a];
+        } else if (strcmp(argv[a], "--quick")==0) {
+            quick= true;
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--json results.json] [--real descrs1.sds descrs2.sds]\n", argv[0]);
+            return 1;
+        }
+    }
+    const unsigned int num= quick ? 200 : 2000;
+    const unsigned int match_num= quick ? 100 : 500;
+    const unsigned int reps= quick ? 1 : 5;
+
+    const char* dists[]= {"sift", "sqrt", "cyclic"};
+    const unsigned int shapes[][2]= { {8, 4}, {16, 4}, {8, 2}, {36, 4} };
+    for (unsigned int s=0; s<sizeof(shapes)/sizeof(shapes[0]); ++s) {
+        for (unsigned int d=0; d<sizeof(dists)/sizeof(dists[0]); ++d) {
+            BenchDescrs set1, set2;
+            makeSets(dists[d], shapes[s][0], shapes[s][1], num, set1, set2);
+            benchAll(set1, set2, dists[d], shapes[s][0], shapes[s][1], match_num, reps);
+        }
+    }
+
+    if (real_paths[0]!=NULL) {
+        BenchDescrs set1, set2;
+        unsigned int NBO1, NBP1, NBO2, NBP2;
+        if (!loadStore(real_paths[0], set1, NBO1, NBP1) || !loadStore(real_paths[1], set2, NBO2, NBP2)) return 1;
+        if (NBO1!=NBO2 || NBP1!=NBP2) {
+            fprintf(stderr, "The two stores have different NBO or NBP\n");
+            return 1;
+        }
+        benchAll(set1, set2, "real", NBO1, NBP1, match_num, reps);
+    }
+
+    if (json_path!=NULL && !writeJson(json_path)) {
+        fprintf(stderr, "Could not write %s\n", json_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DIST_COUNTERS__HXX
+#define _OFIRPELE_SIFT_DIST_COUNTERS__HXX
+
+#include <vector>
+#include <ostream>
+
+// Define SIFT_DIST_COUNTERS (or configure cmake with -DSIFTDIST_COUNTERS=ON)
+// to count what the hot paths of SiftDist and SiftRatioMatcher do. Without
+// it nothing is counted, the counters stay 0 and there is no cost at all.
+#ifdef SIFT_DIST_COUNTERS
+#define SIFT_DIST_COUNT(x) x
+#else
+#define SIFT_DIST_COUNT(x)
+#endif
+
+
+/// What SiftDist (and SiftDistMulti) computed, for finding out why some
+/// pairs of images are slower than others. Only with SIFT_DIST_COUNTERS.
+struct SiftDistCounters {
+
+    explicit SiftDistCounters(unsigned int CELLS_NUM= 0)
+        : pairs(0), cells(0), stopsAtCell(CELLS_NUM, 0), cyclicEdges(0),
+          smallFlowsCarry(0), smallFlowsAbsorb(0), smallFlowsFlip(0) {}
+
+#ifdef SIFT_DIST_COUNTERS
+    static const bool enabled= true;
+#else
+    static const bool enabled= false;
+#endif
+
+    /// Number of pairs (operator(), prunedDist and the groups of SiftDistMulti)
+    unsigned long long pairs;
+    /// Number of cells (addEmdTModForWindow) computed for all the pairs
+    unsigned long long cells;
+    /// stopsAtCell[i] is the number of pairs that were stopped (by a stop
+    /// threshold or by the bound of prunedDist) after computing i cells
+    std::vector<unsigned long long> stopsAtCell;
+    /// Cells that went through the cyclic edge case
+    unsigned long long cyclicEdges;
+    /// The branches of addSmallFlows: the mass left grows (Q[j]>=P[j]), the
+    /// mass left covers P[j] (one-cost flows), or it does not and the
+    /// direction flips.
+    unsigned long long smallFlowsCarry;
+    unsigned long long smallFlowsAbsorb;
+    unsigned long long smallFlowsFlip;
+
+    void add(const SiftDistCounters& o) {
+        pairs+= o.pairs;
+        cells+= o.cells;
+        if (stopsAtCell.size()<o.stopsAtCell.size()) stopsAtCell.resize(o.stopsAtCell.size(), 0);
+        for (unsigned int i=0; i<o.stopsAtCell.size(); ++i) stopsAtCell[i]+= o.stopsAtCell[i];
+        cyclicEdges+= o.cyclicEdges;
+        smallFlowsCarry+= o.smallFlowsCarry;
+        smallFlowsAbsorb+= o.smallFlowsAbsorb;
+        smallFlowsFlip+= o.smallFlowsFlip;
+    }
+
+    /// Writes the counters as a JSON object
+    void writeJson(std::ostream& out) const {
+        out << "{\"enabled\": " << (enabled ? "true" : "false")
+            << ", \"pairs\": " << pairs
+            << ", \"cells\": " << cells
+            << ", \"stopsAtCell\": [";
+        for (unsigned int i=0; i<stopsAtCell.size(); ++i) out << (i>0 ? ", " : "") << stopsAtCell[i];
+        out << "], \"cyclicEdges\": " << cyclicEdges
+            << ", \"smallFlowsCarry\": " << smallFlowsCarry
+            << ", \"smallFlowsAbsorb\": " << smallFlowsAbsorb
+            << ", \"smallFlowsFlip\": " << smallFlowsFlip << "}";
+    }
+
+}; // end SiftDistCounters
+
+
+/// What SiftRatioMatcher did, summed over its threads, for tuning distRatio,
+/// stopThresholdsFactorGamma and maxOverlap. Only with SIFT_DIST_COUNTERS.
+struct SiftRatioMatchCounters {
+
+    explicit SiftRatioMatchCounters(unsigned int CELLS_NUM= 0)
+        : matches(0), queries(0), reverseScans(0), reverseScansCached(0),
+          thresholdUpdates(0), recomputedPairs(0), overlapTests(0), overlapRejects(0),
+          symmetricRejects(0), ratioRejects(0), dist(CELLS_NUM) {}
+
+    /// Number of SiftRatioMatcher::match calls
+    unsigned long long matches;
+    /// Scans of a descr1 descriptor over descr2
+    unsigned long long queries;
+    /// Scans of a nearest descr2 descriptor over descr1, and the nearest
+    /// descr2 descriptors whose scan was already cached
+    unsigned long long reverseScans;
+    unsigned long long reverseScansCached;
+    /// Times the stop thresholds of a scan changed (a new minimum or neighbor),
+    /// and the pairs that were computed again because of that
+    unsigned long long thresholdUpdates;
+    unsigned long long recomputedPairs;
+    /// Frames near the nearest one whose overlap was tested, and the ones that
+    /// overlap more than maxOverlap (not counting the nearest itself)
+    unsigned long long overlapTests;
+    unsigned long long overlapRejects;
+    /// descr1 descriptors whose nearest neighbor is not symmetric, and the
+    /// symmetric ones whose ratio is below distRatio
+    unsigned long long symmetricRejects;
+    unsigned long long ratioRejects;
+    /// The distances of all the scans
+    SiftDistCounters dist;
+
+    void add(const SiftRatioMatchCounters& o) {
+        matches+= o.matches;
+        queries+= o.queries;
+        reverseScans+= o.reverseScans;
+        reverseScansCached+= o.reverseScansCached;
+        thresholdUpdates+= o.thresholdUpdates;
+        recomputedPairs+= o.recomputedPairs;
+        overlapTests+= o.overlapTests;
+        overlapRejects+= o.overlapRejects;
+        symmetricRejects+= o.symmetricRejects;
+        ratioRejects+= o.ratioRejects;
+        dist.add(o.dist);
+    }
+
+    /// Writes the counters as a JSON object
+    void writeJson(std::ostream& out) const {
+        out << "{\"matches\": " << matches
+            << ", \"queries\": " << queries
+            << ", \"reverseScans\": " << reverseScans
+            << ", \"reverseScansCached\": " << reverseScansCached
+            << ", \"thresholdUpdates\": " << thresholdUpdates
+            << ", \"recomputedPairs\": " << recomputedPairs
+            << ", \"overlapTests\": " << overlapTests
+            << ", \"overlapRejects\": " << overlapRejects
+            << ", \"symmetricRejects\": " << symmetricRejects
+            << ", \"ratioRejects\": " << ratioRejects
+            << ", \"dist\": ";
+        dist.writeJson(out);
+        out << "}";
+    }
+
+}; // end SiftRatioMatchCounters
+
+#endif
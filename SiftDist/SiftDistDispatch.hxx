@@ -0,0 +1,62 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DIST_DISPATCH__HXX
+#define _OFIRPELE_SIFT_DIST_DISPATCH__HXX
+
+#include "SiftDistMulti.hxx"
+
+
+/// Calls f(sd), where sd is a SiftDistMulti<NUM_T,NBO,CELLS_NUM> with
+/// NBO and CELLS_NUM known at compile time for the common SIFT shapes:
+/// 16 or 8 orientation bins and 4x4 spatial cells.
+/// For other shapes sd is the generic SiftDistMulti<NUM_T>.
+/// FUNCTOR should have a template<typename DISTANCE_T> operator()(DISTANCE_T& sd).
+template<typename NUM_T, typename FUNCTOR>
+void dispatchSiftDist(unsigned int NBO, unsigned int CELLS_NUM,
+                      FUNCTOR& f) {
+
+    if (CELLS_NUM==16) {
+        if (NBO==16) {
+            SiftDistMulti<NUM_T, 16, 16> sd(NBO, CELLS_NUM);
+            f(sd);
+            return;
+        }
+        if (NBO==8) {
+            SiftDistMulti<NUM_T, 8, 16> sd(NBO, CELLS_NUM);
+            f(sd);
+            return;
+        }
+    }
+    
+    SiftDistMulti<NUM_T> sd(NBO, CELLS_NUM);
+    f(sd);
+    
+} // dispatchSiftDist
+
+#endif
@@ -0,0 +1,617 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DIST_MULTI__HXX
+#define _OFIRPELE_SIFT_DIST_MULTI__HXX
+
+#include "SiftDist.hxx"
+#include "SiftDistBatch.hxx"
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Define SIFT_DIST_NO_SIMD to compile only the scalar code.
+#if !defined(SIFT_DIST_NO_SIMD) && (defined(__GNUC__)||defined(__clang__)) && (defined(__x86_64__)||defined(__i386__))
+#define SIFT_DIST_SIMD_X86
+#endif
+
+
+#ifdef SIFT_DIST_SIMD_X86
+
+template<unsigned int W>
+struct SiftDistSimdVec;
+
+template<>
+struct SiftDistSimdVec<4> {
+    typedef double V __attribute__((vector_size(4*sizeof(double))));
+    typedef __typeof__(V()<V()) M;
+};
+
+template<>
+struct SiftDistSimdVec<8> {
+    typedef double V __attribute__((vector_size(8*sizeof(double))));
+    typedef __typeof__(V()<V()) M;
+};
+
+#define SIFT_DIST_SIMD_INLINE inline __attribute__((always_inline))
+
+/// Types of descriptors entries that SiftDistSimdKernel computes exactly
+template<typename NUM_T> struct SiftDistSimdInput { static const bool value= false; };
+template<> struct SiftDistSimdInput<double> { static const bool value= true; };
+template<> struct SiftDistSimdInput<unsigned char> { static const bool value= true; };
+template<> struct SiftDistSimdInput<unsigned short> { static const bool value= true; };
+
+
+/// Computes the SiftDist of W pairs at once, one pair in each lane.
+/// It does exactly the same floating point operations as SiftDist<double>,
+/// in the same order, thus the results are bit-identical.
+/// Quantized descriptors (see SiftDistAccum) are widened to double lanes;
+/// all their intermediate values are integers that double holds exactly,
+/// so the results are equal to SiftDist<unsigned char> etc. as well.
+/// Branches of addEmdTModForWindow and addSmallFlows are replaced with
+/// blends. The cyclic edge case is rare and is done by SiftDist for each
+/// lane that needs it.
+/// All functions are always inlined, so they get the instruction set
+/// of their caller (see SiftDistMulti::groupAvx2 and groupAvx512).
+template<unsigned int W>
+struct SiftDistSimdKernel {
+
+    typedef typename SiftDistSimdVec<W>::V V;
+    typedef typename SiftDistSimdVec<W>::M M;
+
+    static SIFT_DIST_SIMD_INLINE void blend(V& r, const M& m, const V& a, const V& b) {
+        r= (V)(((M)a&m)|((M)b&~m));
+    }
+    static SIFT_DIST_SIMD_INLINE void blendMask(M& r, const M& m, const M& a, const M& b) {
+        r= (a&m)|(b&~m);
+    }
+
+    /// buf should have 4*(NBO+1)*W doubles and be aligned to W*sizeof(double)
+    /// If bounds is not NULL, this is SiftDist::prunedDist of each lane, where
+    /// bounds[l] is cellsBound of lane l (that did not stop before the first cell),
+    /// and the stops are counted in sd.pruneStats().
+    template<typename SIFT_DIST_T, typename NUM_T, typename DIST_T>
+    static SIFT_DIST_SIMD_INLINE void dists(SIFT_DIST_T& sd,
+                                            unsigned int NBO, unsigned int CELLS_NUM,
+                                            const NUM_T* const* sifts1, const NUM_T* const* sifts2,
+                                            unsigned int pairs_num,
+                                            const DIST_T* stopThresholdsArr,
+                                            double* buf,
+
+                                            DIST_T* dists,
+
+                                            const DIST_T* bounds= NULL,
+                                            const DIST_T* const* cellsMass1= NULL,
+                                            const DIST_T* const* cellsMass2= NULL,
+                                            const unsigned int* cellsOrder= NULL) {
+        assert(pairs_num<=W);
+        assert(bounds==NULL||stopThresholdsArr!=NULL);
+
+        // Lane interleaved cells: Qb[b*W+l] is bin b of lane l.
+        // Qr,Pr are the same cells rotated so each lane starts at its first phase index.
+        double* Qb= buf;
+        double* Pb= Qb + NBO*W;
+        double* Qr= Pb + NBO*W;
+        double* Pr= Qr + (NBO+1)*W;
+
+        const V ZERO= V()*0.0;
+        const M ALL= (ZERO==ZERO);
+        const M NONE= ~ALL;
+
+        V dist= ZERO;
+        M active= NONE;
+        for (unsigned int l=0; l<pairs_num; ++l) active[l]= -1;
+
+        V bound= ZERO;
+        if (bounds!=NULL) {
+            for (unsigned int l=0; l<pairs_num; ++l) bound[l]= bounds[l];
+        }
+        // The pairs of prunedDists are counted when they are grouped
+        SIFT_DIST_COUNT(if (bounds==NULL) sd._counters.pairs+= pairs_num);
+
+        for (unsigned int c=0; c<CELLS_NUM; ++c) {
+
+            unsigned int cell= cellsOrder!=NULL ? cellsOrder[c] : c;
+            unsigned int cell_offset= cell*NBO;
+            for (unsigned int l=0; l<W; ++l) {
+                if (l<pairs_num) {
+                    const NUM_T* Q= sifts1[l] + cell_offset;
+                    const NUM_T* P= sifts2[l] + cell_offset;
+                    for (unsigned int b=0; b<NBO; ++b) {
+                        Qb[b*W+l]= Q[b];
+                        Pb[b*W+l]= P[b];
+                    }
+                } else {
+                    for (unsigned int b=0; b<NBO; ++b) {
+                        Qb[b*W+l]= 0.0;
+                        Pb[b*W+l]= 0.0;
+                    }
+                }
+            }
+
+            //-----------------------------------------------------------
+            // Find the index the first phase starts from (see
+            // SiftDist::addEmdTModForWindow)
+            //-----------------------------------------------------------
+            const V Q0= *reinterpret_cast<const V*>(Qb);
+            const V P0= *reinterpret_cast<const V*>(Pb);
+            M Q_old_zero= (Q0<=P0);
+            M P_old_zero= (P0<=Q0);
+            M found= NONE;
+            M start= NONE;
+            for (unsigned int i=1; i<NBO; ++i) {
+                const V Qi= *reinterpret_cast<const V*>(Qb+i*W);
+                const V Pi= *reinterpret_cast<const V*>(Pb+i*W);
+                M Q_zero= (Qi<=Pi);
+                M P_zero= (Pi<=Qi);
+                M hit= ((Q_zero&Q_old_zero)|(P_zero&P_old_zero))&~found;
+                M i_vec= NONE+static_cast<long long>(i);
+                blendMask(start, hit, i_vec, start);
+                found|= hit;
+                Q_old_zero= Q_zero;
+                P_old_zero= P_zero;
+            }
+            const V QL= *reinterpret_cast<const V*>(Qb+(NBO-1)*W);
+            const V PL= *reinterpret_cast<const V*>(Pb+(NBO-1)*W);
+            // edge between last P and first Q
+            M cyclic_PQ= (PL>QL)&(Q0>P0)&~found;
+            // edge between last Q and first P
+            M cyclic_QP= (QL>PL)&(P0>Q0)&~found;
+            M cyclic= (cyclic_PQ|cyclic_QP)&active;
+            M flowing= active&~cyclic;
+#ifdef SIFT_DIST_COUNTERS
+            for (unsigned int l=0; l<pairs_num; ++l) {
+                if (active[l]) ++sd._counters.cells;
+            }
+#endif
+
+            for (unsigned int l=0; l<W; ++l) {
+                unsigned int b= static_cast<unsigned int>(start[l]);
+                for (unsigned int k=0; k<=NBO; ++k) {
+                    Qr[k*W+l]= Qb[b*W+l];
+                    Pr[k*W+l]= Pb[b*W+l];
+                    if (++b==NBO) b= 0;
+                }
+            }
+
+            //-----------------------------------------------------------
+            // Flowing from the start index all around the circle
+            // (see SiftDist::checkDirectionAndAddSmallFlows and addSmallFlows)
+            //-----------------------------------------------------------
+            V cell_dist= dist;
+            V sumQ= ZERO;
+            V sumP= ZERO;
+            V old_Q= *reinterpret_cast<const V*>(Qr);
+            V old_P= *reinterpret_cast<const V*>(Pr);
+            for (unsigned int k=1; k<=NBO; ++k) {
+                const V Qk= *reinterpret_cast<const V*>(Qr+k*W);
+                const V Pk= *reinterpret_cast<const V*>(Pr+k*W);
+
+                // Q,P in addSmallFlows are A,B here
+                M dir= (old_Q>=old_P);
+                V A, B, old_A, old_B, sumA;
+                blend(A, dir, Qk, Pk);
+                blend(B, dir, Pk, Qk);
+                blend(old_A, dir, old_Q, old_P);
+                blend(old_B, dir, old_P, old_Q);
+                blend(sumA, dir, sumQ, sumP);
+
+                V old_dab= old_A-old_B;
+                V dba= B-A;
+                M A_ge_B= (A>=B);
+                M small= (old_dab>=dba);
+#ifdef SIFT_DIST_COUNTERS
+                for (unsigned int l=0; l<pairs_num; ++l) {
+                    if (!flowing[l]) continue;
+                    if (A_ge_B[l]) ++sd._counters.smallFlowsCarry;
+                    else if (small[l]) ++sd._counters.smallFlowsAbsorb;
+                    else ++sd._counters.smallFlowsFlip;
+                }
+#endif
+
+                V sumA_not_ge;
+                blend(sumA_not_ge, small, sumA+(old_dab-dba), sumA);
+                V new_sumA;
+                blend(new_sumA, A_ge_B, sumA+old_dab, sumA_not_ge);
+
+                V dist_add;
+                blend(dist_add, small, dba, old_dab);
+                blend(cell_dist, A_ge_B, cell_dist, cell_dist+dist_add);
+
+                V new_old_A;
+                blend(new_old_A, A_ge_B, A, ZERO);
+                V new_old_B_not_ge;
+                blend(new_old_B_not_ge, small, ZERO, dba-old_dab);
+                V new_old_B;
+                blend(new_old_B, A_ge_B, B, new_old_B_not_ge);
+
+                blend(sumQ, dir, new_sumA, sumQ);
+                blend(sumP, dir, sumP, new_sumA);
+                blend(old_Q, dir, new_old_A, new_old_B);
+                blend(old_P, dir, new_old_B, new_old_A);
+            }
+            V maxSum;
+            blend(maxSum, (sumQ>=sumP), sumQ, sumP);
+            cell_dist= (cell_dist+maxSum)+maxSum;
+            blend(dist, flowing, cell_dist, dist);
+
+            for (unsigned int l=0; l<W; ++l) {
+                if (cyclic[l]) {
+                    const NUM_T* Q= sifts1[l] + cell_offset;
+                    const NUM_T* P= sifts2[l] + cell_offset;
+                    sd._dist= static_cast<DIST_T>(dist[l]);
+                    if (cyclic_PQ[l]) {
+                        sd.cyclicEdgeAddEmdTModForWindow(P,Q);
+                    } else {
+                        sd.cyclicEdgeAddEmdTModForWindow(Q,P);
+                    }
+                    dist[l]= sd._dist;
+                }
+            }
+
+            if (bounds!=NULL) {
+                for (unsigned int l=0; l<pairs_num; ++l) {
+                    bound[l]-= SIFT_DIST_T::cellBound(cellsMass1[l][cell], cellsMass2[l][cell]);
+                }
+            }
+
+            if (stopThresholdsArr&&c<CELLS_NUM-1) {
+                const V threshold= ZERO+static_cast<double>(stopThresholdsArr[c]);
+                M stop= active&(dist>=threshold);
+                M bound_stop= NONE;
+                if (bounds!=NULL) {
+                    const V last_threshold= ZERO+static_cast<double>(stopThresholdsArr[CELLS_NUM-1]);
+                    bound_stop= active&~stop&((dist+bound)>=last_threshold);
+                    for (unsigned int l=0; l<pairs_num; ++l) {
+                        if (stop[l]|bound_stop[l]) {
+                            if (stop[l]) ++sd._pruneStats.thresholdStops;
+                            else ++sd._pruneStats.boundStops;
+                            ++sd._pruneStats.stopsAtCell[c+1];
+                            sd._pruneStats.cellsComputed+= c+1;
+                        }
+                    }
+                    stop|= bound_stop;
+                }
+#ifdef SIFT_DIST_COUNTERS
+                for (unsigned int l=0; l<pairs_num; ++l) {
+                    if (stop[l]) ++sd._counters.stopsAtCell[c+1];
+                }
+#endif
+                bool any_active= false;
+                for (unsigned int l=0; l<W; ++l) {
+                    if (stop[l]) dists[l]= stopThresholdsArr[CELLS_NUM-1];
+                    any_active= any_active||(active[l]&&!stop[l]);
+                }
+                if (!any_active) return;
+                active&= ~stop;
+            }
+
+        } // c
+
+        for (unsigned int l=0; l<pairs_num; ++l) {
+            if (active[l]) {
+                dists[l]= static_cast<DIST_T>(dist[l]);
+                if (bounds!=NULL) sd._pruneStats.cellsComputed+= CELLS_NUM;
+            }
+        }
+
+    } // dists
+
+}; // end SiftDistSimdKernel
+
+#endif // SIFT_DIST_SIMD_X86
+
+
+/// SiftDist that can also compute several pairs at once
+/// (see SiftDistGroup in SiftDistBatch.hxx).
+/// For double, unsigned char and unsigned short, the pairs are computed in
+/// the lanes of AVX-512 (8 pairs) or AVX2 (4 pairs) registers, chosen at
+/// runtime according to the CPU. The results are bit-identical to SiftDist<NUM_T>.
+/// Otherwise (or if there is no SIMD support) the pairs are computed one by one.
+///@param FIXED_NBO, FIXED_CELLS_NUM see SiftDist
+template<typename NUM_T, unsigned int FIXED_NBO=0, unsigned int FIXED_CELLS_NUM=0>
+class SiftDistMulti {
+
+public:
+
+    typedef typename SiftDistAccum<NUM_T>::DIST_T DIST_T;
+
+    /// @param maxLanes maximum number of pairs computed at once.
+    /// 1 disables the SIMD code.
+    SiftDistMulti(unsigned int NBO,
+                  unsigned int CELLS_NUM,
+                  unsigned int maxLanes= 8)
+
+        : _sd(NBO, CELLS_NUM),
+          _NBO(NBO),
+          _CELLS_NUM(CELLS_NUM),
+          _lanes(1)
+        {
+            selectLanes(maxLanes);
+        }
+
+    /// Number of pairs computed at once
+    unsigned int lanes() const { return _lanes; }
+
+    /// Same as SiftDist::operator()
+    DIST_T operator()(const NUM_T* sift1,
+                      const NUM_T* sift2,
+                      const DIST_T* stopThresholdsArr=NULL) {
+        return _sd(sift1, sift2, stopThresholdsArr);
+    }
+
+    /// Same as SiftDist::prunedDist (one pair at a time)
+    DIST_T prunedDist(const NUM_T* sift1,
+                      const NUM_T* sift2,
+                      const DIST_T* stopThresholdsArr,
+                      const DIST_T* cellsMass1,
+                      const DIST_T* cellsMass2,
+                      const unsigned int* cellsOrder) {
+        return _sd.prunedDist(sift1, sift2, stopThresholdsArr, cellsMass1, cellsMass2, cellsOrder);
+    }
+
+    const SiftDistPruneStats& pruneStats() const { return _sd.pruneStats(); }
+    void resetPruneStats() { _sd.resetPruneStats(); }
+
+    const SiftDistCounters& counters() const { return _sd.counters(); }
+    void resetCounters() { _sd.resetCounters(); }
+
+    /// dists[l]= prunedDist(sifts1[l], sifts2[l], stopThresholdsArr,
+    ///                      cellsMass1[l], cellsMass2[l], cellsOrder) for l<pairs_num
+    /// The pairs that are stopped by their bound before the first cell are
+    /// left out of the groups, so the lanes are used by pairs that are computed.
+    void prunedDists(const NUM_T* const* sifts1,
+                     const NUM_T* const* sifts2,
+                     unsigned int pairs_num,
+                     const DIST_T* stopThresholdsArr,
+                     const DIST_T* const* cellsMass1,
+                     const DIST_T* const* cellsMass2,
+                     const unsigned int* cellsOrder,
+
+                     DIST_T* dists) {
+        if (_lanes==1) {
+            for (unsigned int l=0; l<pairs_num; ++l) {
+                dists[l]= _sd.prunedDist(sifts1[l], sifts2[l], stopThresholdsArr,
+                                         cellsMass1[l], cellsMass2[l], cellsOrder);
+            }
+            return;
+        }
+        
+        const DIST_T stopThreshold= stopThresholdsArr[cellsNum()-1];
+        SiftDistPruneStats& stats= _sd._pruneStats;
+        const NUM_T* group_sifts1[MAX_LANES];
+        const NUM_T* group_sifts2[MAX_LANES];
+        const DIST_T* group_cellsMass1[MAX_LANES];
+        const DIST_T* group_cellsMass2[MAX_LANES];
+        DIST_T group_bounds[MAX_LANES];
+        DIST_T group_dists[MAX_LANES];
+        unsigned int group_pairs[MAX_LANES];
+        
+        unsigned int l= 0;
+        while (l<pairs_num) {
+            unsigned int n= 0;
+            for (; l<pairs_num && n<_lanes; ++l) {
+                ++stats.pairs;
+                SIFT_DIST_COUNT(++_sd._counters.pairs);
+                DIST_T bound= _sd.cellsBound(cellsMass1[l], cellsMass2[l]);
+                if (bound>=stopThreshold) {
+                    ++stats.boundStops;
+                    ++stats.stopsAtCell[0];
+                    SIFT_DIST_COUNT(++_sd._counters.stopsAtCell[0]);
+                    dists[l]= stopThreshold;
+                    continue;
+                }
+                group_sifts1[n]= sifts1[l];
+                group_sifts2[n]= sifts2[l];
+                group_cellsMass1[n]= cellsMass1[l];
+                group_cellsMass2[n]= cellsMass2[l];
+                group_bounds[n]= bound;
+                group_pairs[n]= l;
+                ++n;
+            }
+            if (n==0) continue;
+            prunedGroup(group_sifts1, group_sifts2, n, stopThresholdsArr,
+                        group_bounds, group_cellsMass1, group_cellsMass2, cellsOrder,
+                        group_dists);
+            for (unsigned int g=0; g<n; ++g) dists[group_pairs[g]]= group_dists[g];
+        }
+    }
+
+    /// dists[l]= SiftDist(sifts1[l], sifts2[l], stopThresholdsArr) for l<pairs_num
+    void operator()(const NUM_T* const* sifts1,
+                    const NUM_T* const* sifts2,
+                    unsigned int pairs_num,
+                    const DIST_T* stopThresholdsArr,
+
+                    DIST_T* dists) {
+        while (pairs_num>0) {
+            unsigned int n= myMin(pairs_num, _lanes);
+            group(sifts1, sifts2, n, stopThresholdsArr, dists);
+            sifts1+= n;
+            sifts2+= n;
+            dists+= n;
+            pairs_num-= n;
+        }
+    }
+
+private:
+
+    static const unsigned int MAX_LANES= 8;
+
+    unsigned int nbo() const { return FIXED_NBO>0 ? FIXED_NBO : _NBO; }
+    unsigned int cellsNum() const { return FIXED_CELLS_NUM>0 ? FIXED_CELLS_NUM : _CELLS_NUM; }
+
+    // The sizes the AVX-512 kernel is inlined with. Constant sizes make it
+    // faster only when the whole file is compiled for AVX-512 (e.g.
+    // SIFTDIST_MARCH=native). In a target("avx512f") function of a generic
+    // build they made it about 1.4x slower than the generic SiftDistMulti
+    // (SiftDistBench), so there the fixed instances give it their sizes at
+    // runtime and keep the constant sizes only for the scalar and AVX2 code.
+#ifdef __AVX512F__
+    unsigned int avx512Nbo() const { return nbo(); }
+    unsigned int avx512CellsNum() const { return cellsNum(); }
+#else
+    unsigned int avx512Nbo() const { return _NBO; }
+    unsigned int avx512CellsNum() const { return _CELLS_NUM; }
+#endif
+
+    void selectLanes(unsigned int maxLanes) {
+#ifdef SIFT_DIST_SIMD_X86
+        if (!SiftDistSimdInput<NUM_T>::value) return;
+        __builtin_cpu_init();
+        if (maxLanes>=8&&__builtin_cpu_supports("avx512f")) {
+            _lanes= 8;
+        } else if (maxLanes>=4&&__builtin_cpu_supports("avx2")) {
+            _lanes= 4;
+        }
+        if (_lanes>1) {
+            // + one more row for alignment
+            _buf.resize(4*(_NBO+2)*_lanes);
+        }
+#else
+        (void)maxLanes;
+#endif
+    }
+
+    double* alignedBuf() {
+        size_t alignment= _lanes*sizeof(double);
+        size_t addr= reinterpret_cast<size_t>(&_buf[0]);
+        return reinterpret_cast<double*>( ((addr+alignment-1)/alignment)*alignment );
+    }
+
+    void group(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+               const DIST_T* stopThresholdsArr, DIST_T* dists) {
+#ifdef SIFT_DIST_SIMD_X86
+        if (_lanes==8) {
+            groupAvx512(sifts1, sifts2, n, stopThresholdsArr, dists);
+            return;
+        }
+        if (_lanes==4) {
+            groupAvx2(sifts1, sifts2, n, stopThresholdsArr, dists);
+            return;
+        }
+#endif
+        for (unsigned int l=0; l<n; ++l) {
+            dists[l]= _sd(sifts1[l], sifts2[l], stopThresholdsArr);
+        }
+    }
+
+    // Only called with _lanes>1
+    void prunedGroup(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+                     const DIST_T* stopThresholdsArr,
+                     const DIST_T* bounds, const DIST_T* const* cellsMass1, const DIST_T* const* cellsMass2,
+                     const unsigned int* cellsOrder,
+                     DIST_T* dists) {
+#ifdef SIFT_DIST_SIMD_X86
+        if (_lanes==8) {
+            prunedGroupAvx512(sifts1, sifts2, n, stopThresholdsArr, bounds, cellsMass1, cellsMass2, cellsOrder, dists);
+        } else {
+            prunedGroupAvx2(sifts1, sifts2, n, stopThresholdsArr, bounds, cellsMass1, cellsMass2, cellsOrder, dists);
+        }
+#else
+        (void)sifts1; (void)sifts2; (void)n; (void)stopThresholdsArr; (void)bounds;
+        (void)cellsMass1; (void)cellsMass2; (void)cellsOrder; (void)dists;
+        assert(false);
+#endif
+    }
+
+#ifdef SIFT_DIST_SIMD_X86
+    __attribute__((target("avx2")))
+    void prunedGroupAvx2(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+                         const DIST_T* stopThresholdsArr,
+                         const DIST_T* bounds, const DIST_T* const* cellsMass1, const DIST_T* const* cellsMass2,
+                         const unsigned int* cellsOrder,
+                         DIST_T* dists) {
+        SiftDistSimdKernel<4>::dists(_sd, nbo(), cellsNum(), sifts1, sifts2, n, stopThresholdsArr,
+                                     alignedBuf(), dists, bounds, cellsMass1, cellsMass2, cellsOrder);
+    }
+
+    __attribute__((target("avx512f")))
+    void prunedGroupAvx512(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+                           const DIST_T* stopThresholdsArr,
+                           const DIST_T* bounds, const DIST_T* const* cellsMass1, const DIST_T* const* cellsMass2,
+                           const unsigned int* cellsOrder,
+                           DIST_T* dists) {
+        SiftDistSimdKernel<8>::dists(_sd, avx512Nbo(), avx512CellsNum(), sifts1, sifts2, n, stopThresholdsArr,
+                                     alignedBuf(), dists, bounds, cellsMass1, cellsMass2, cellsOrder);
+    }
+
+    __attribute__((target("avx2")))
+    void groupAvx2(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+                   const DIST_T* stopThresholdsArr, DIST_T* dists) {
+        // With FIXED_NBO, FIXED_CELLS_NUM the kernel is inlined with constant sizes
+        SiftDistSimdKernel<4>::dists(_sd, nbo(), cellsNum(), sifts1, sifts2, n, stopThresholdsArr,
+                                     alignedBuf(), dists);
+    }
+
+    __attribute__((target("avx512f")))
+    void groupAvx512(const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int n,
+                     const DIST_T* stopThresholdsArr, DIST_T* dists) {
+        SiftDistSimdKernel<8>::dists(_sd, avx512Nbo(), avx512CellsNum(), sifts1, sifts2, n, stopThresholdsArr,
+                                     alignedBuf(), dists);
+    }
+#endif
+
+    SiftDist<NUM_T, FIXED_NBO, FIXED_CELLS_NUM> _sd;
+    unsigned int _NBO, _CELLS_NUM;
+    unsigned int _lanes;
+    std::vector<double> _buf;
+
+}; // end class SiftDistMulti
+
+
+template<typename NUM_T, unsigned int FIXED_NBO, unsigned int FIXED_CELLS_NUM>
+struct SiftDistGroup< SiftDistMulti<NUM_T, FIXED_NBO, FIXED_CELLS_NUM> > {
+
+    typedef SiftDistMulti<NUM_T, FIXED_NBO, FIXED_CELLS_NUM> DISTANCE_T;
+
+    static unsigned int lanes(const DISTANCE_T& sd) { return sd.lanes(); }
+
+    typedef typename DISTANCE_T::DIST_T DIST_T;
+
+    static void dists(DISTANCE_T& sd,
+                      const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int pairs_num,
+                      const DIST_T* stopThresholdsArr,
+
+                      DIST_T* dists) {
+        sd(sifts1, sifts2, pairs_num, stopThresholdsArr, dists);
+    }
+
+    static void prunedDists(DISTANCE_T& sd,
+                            const NUM_T* const* sifts1, const NUM_T* const* sifts2, unsigned int pairs_num,
+                            const DIST_T* stopThresholdsArr,
+                            const DIST_T* const* cellsMass1, const DIST_T* const* cellsMass2,
+                            const unsigned int* cellsOrder,
+
+                            DIST_T* dists) {
+        sd.prunedDists(sifts1, sifts2, pairs_num, stopThresholdsArr, cellsMass1, cellsMass2, cellsOrder, dists);
+    }
+
+}; // end SiftDistGroup< SiftDistMulti >
+
+#endif
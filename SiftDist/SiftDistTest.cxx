@@ -27,7 +27,1030 @@
 // MODIFICATIONS.
 
 #include "SiftDist.hxx"
+#include "SiftDistMulti.hxx"
+#include "SiftDistBatch.hxx"
+#include "SiftDistDispatch.hxx"
+#include "SiftDistVpTree.hxx"
+#include "SiftRatioMatchImpl.hxx"
+#include "SiftMatch.hxx"
+#include "FramesGrid.hxx"
+#include "SiftDescrSet.hxx"
+#include "SiftEmdModDist.hxx"
+#include "SiftDescrStore.hxx"
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+// n random real valued descriptors. Every third cell is cyclic: the even
+// descriptors are larger in its even bins and the odd ones in its odd bins,
+// so a pair of an even and an odd descriptor goes through the cyclic edge
+// case of SiftDist in these cells.
+static void makeRealDescrs(unsigned int n, unsigned int NBO, unsigned int CELLS_NUM, std::vector<double>& descr) {
+      descr.resize(n*NBO*CELLS_NUM);
+      for (unsigned int i=0; i<n; ++i) {
+          for (unsigned int c=0; c<CELLS_NUM; ++c) {
+              for (unsigned int b=0; b<NBO; ++b) {
+                  double r= rand()/(RAND_MAX+1.0);
+                  double v= r*100;
+                  if (c%3==0) v= (b%2)==(i%2) ? 64+r*64 : r*32;
+                  descr[(i*CELLS_NUM+c)*NBO+b]= v;
+              }
+          }
+      }
+}
+
+// Two images: n1 random descriptors, with entries in 0..values_num-1, then
+// n2 noisy copies of them, so that there are matches. The j-th copy is the
+// descriptor (j*7)%n1 plus noise_min..noise_max in each entry (clamped to
+// 0..255). The frames of each image are on a row 40 pixels apart, with scale 1.
+template<typename NUM_T>
+static void makeFixture(unsigned int n1, unsigned int n2, unsigned int NBO, unsigned int NBP,
+                        unsigned int seed,
+                        std::vector<NUM_T>& descr, std::vector<double>& frames,
+                        int values_num= 256, int noise_min= -10, int noise_max= 10) {
+      const unsigned int sift_dim= NBO*NBP*NBP;
+      srand(seed);
+      descr.assign((n1+n2)*sift_dim, 0);
+      frames.assign(4*(n1+n2), 0.0);
+      for (unsigned int i=0; i<n1+n2; ++i) {
+          for (unsigned int k=0; k<sift_dim; ++k) {
+              int v= i<n1 ? rand()%values_num
+                          : static_cast<int>(descr[(((i-n1)*7)%n1)*sift_dim+k]) + noise_min + rand()%(noise_max-noise_min+1);
+              descr[i*sift_dim+k]= static_cast<NUM_T>(v<0 ? 0 : (v>255 ? 255 : v));
+          }
+          frames[4*i]= (i<n1 ? i : i-n1)*40.0;
+          frames[4*i+2]= 1.0;
+      }
+}
+
+// The tiled matrix of SiftDistBatch is the plain loop of SiftDist, also for
+// sizes that are not multiples of the tiles and of the groups.
+static void testSiftDistBatch() {
+
+      const unsigned int NBO= 8;
+      const unsigned int CELLS_NUM= 16;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int sizes[]= {1, 15, 17, 33};
+
+      srand(11);
+      std::vector<double> descr1, descr2;
+      makeRealDescrs(33, NBO, CELLS_NUM, descr1);
+      makeRealDescrs(34, NBO, CELLS_NUM, descr2);
+      // descr2 starts at an odd descriptor, so that pairs of the same index are cyclic
+      const double* d2= &descr2[sift_dim];
+
+      SiftDist<double> sd(NBO, CELLS_NUM);
+      SiftDistMulti<double> sdm(NBO, CELLS_NUM);
+      std::vector<double> stopThresholdsArr(CELLS_NUM);
+      const double dist= sd(&descr1[0], d2);
+      for (unsigned int c=0; c<CELLS_NUM; ++c) stopThresholdsArr[c]= dist*(c+1)/CELLS_NUM;
+
+      // Tiles of 7 descr2 and 10 queries, and the default ones
+      SiftDistBatch small(sift_dim, sizeof(double), 7*sift_dim*sizeof(double), 10*sift_dim*sizeof(double));
+      SiftDistBatch def(sift_dim);
+      assert(small.descrTileSize()==7 && small.queriesTileSize()==10);
+      // Tiles of unsigned char descriptors hold 8 times as many
+      SiftDistBatch bytes(sift_dim, sizeof(unsigned char));
+      assert(bytes.descrTileSize()==8*def.descrTileSize() && bytes.queriesTileSize()==8*def.queriesTileSize());
+      for (unsigned int a=0; a<4; ++a) {
+          for (unsigned int b=0; b<4; ++b) {
+              const unsigned int n1= sizes[a], n2= sizes[b];
+              for (int stop=0; stop<2; ++stop) {
+                  const double* stops= stop==1 ? &stopThresholdsArr[0] : NULL;
+                  std::vector<double> expected(n1*n2);
+                  for (unsigned int i=0; i<n1; ++i) {
+                      for (unsigned int j=0; j<n2; ++j) {
+                          expected[i+j*n1]= sd(&descr1[i*sift_dim], d2+j*sift_dim, stops);
+                      }
+                  }
+                  for (int tiles=0; tiles<2; ++tiles) {
+                      const SiftDistBatch& sdb= tiles==0 ? small : def;
+                      std::vector<double> dists(n1*n2, -1), multi_dists(n1*n2, -1);
+                      sdb.computeDistsMatrix(sd, &descr1[0], n1, d2, n2, stops, &dists[0]);
+                      sdb.computeDistsMatrix(sdm, &descr1[0], n1, d2, n2, stops, &multi_dists[0]);
+                      assert(dists==expected);
+                      assert(multi_dists==expected);
+                  }
+              }
+          }
+      }
+
+} // testSiftDistBatch
+
+// SiftDistMulti gives exactly the SiftDist distances of its pairs, with
+// every lane width that the CPU supports and with the scalar fallback,
+// also for groups that do not fill the lanes.
+static void testSiftDistMulti() {
+
+      const unsigned int NBO= 8;
+      const unsigned int CELLS_NUM= 16;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n= 19;
+
+      srand(12);
+      std::vector<double> descr1, descr2;
+      makeRealDescrs(n, NBO, CELLS_NUM, descr1);
+      makeRealDescrs(n+1, NBO, CELLS_NUM, descr2);
+      std::vector<const double*> sifts1(n), sifts2(n);
+      std::vector<double> cellsMass1(n*CELLS_NUM, 0.0), cellsMass2(n*CELLS_NUM, 0.0);
+      std::vector<const double*> masses1(n), masses2(n);
+      for (unsigned int l=0; l<n; ++l) {
+          // descr2 starts at an odd descriptor, so that pairs of the same index are cyclic
+          sifts1[l]= &descr1[l*sift_dim];
+          sifts2[l]= &descr2[(l+1)*sift_dim];
+          for (unsigned int k=0; k<sift_dim; ++k) {
+              cellsMass1[l*CELLS_NUM+k/NBO]+= sifts1[l][k];
+              cellsMass2[l*CELLS_NUM+k/NBO]+= sifts2[l][k];
+          }
+          masses1[l]= &cellsMass1[l*CELLS_NUM];
+          masses2[l]= &cellsMass2[l*CELLS_NUM];
+      }
+      std::vector<unsigned int> cellsOrder(CELLS_NUM);
+      for (unsigned int c=0; c<CELLS_NUM; ++c) cellsOrder[c]= CELLS_NUM-1-c;
+
+      SiftDist<double> sd(NBO, CELLS_NUM);
+      std::vector<double> stopThresholdsArr(CELLS_NUM);
+      const double dist= sd(sifts1[0], sifts2[0]);
+      for (unsigned int c=0; c<CELLS_NUM; ++c) stopThresholdsArr[c]= dist*(c+1)/CELLS_NUM;
+
+      const unsigned int maxLanes[]= {1, 4, 8};
+      for (unsigned int m=0; m<3; ++m) {
+          SiftDistMulti<double> sdm(NBO, CELLS_NUM, maxLanes[m]);
+          // A lane width that the CPU does not support
+          if (sdm.lanes()!=maxLanes[m]) continue;
+          // All the group sizes up to 19, e.g. 5 and 13 that are not multiples of 4 or 8
+          for (unsigned int pairs_num=1; pairs_num<=n; ++pairs_num) {
+              for (int stop=0; stop<2; ++stop) {
+                  const double* stops= stop==1 ? &stopThresholdsArr[0] : NULL;
+                  std::vector<double> dists(pairs_num, -1);
+                  sdm(&sifts1[0], &sifts2[0], pairs_num, stops, &dists[0]);
+                  for (unsigned int l=0; l<pairs_num; ++l) {
+                      assert(dists[l]==sd(sifts1[l], sifts2[l], stops));
+                  }
+              }
+              std::vector<double> pruned(pairs_num, -1);
+              sdm.prunedDists(&sifts1[0], &sifts2[0], pairs_num, &stopThresholdsArr[0],
+                              &masses1[0], &masses2[0], &cellsOrder[0], &pruned[0]);
+              for (unsigned int l=0; l<pairs_num; ++l) {
+                  assert(pruned[l]==sd.prunedDist(sifts1[l], sifts2[l], &stopThresholdsArr[0],
+                                                  masses1[l], masses2[l], &cellsOrder[0]));
+              }
+          }
+      }
+
+} // testSiftDistMulti
+
+// The instances with NBO and CELLS_NUM fixed at compile time give exactly
+// the distances of the generic SiftDist.
+template<unsigned int FIXED_NBO, unsigned int FIXED_CELLS_NUM>
+static void testFixedSiftDist() {
+
+      const unsigned int sift_dim= FIXED_NBO*FIXED_CELLS_NUM;
+      const unsigned int n= 40;
+
+      std::vector<double> descr1, descr2;
+      makeRealDescrs(n, FIXED_NBO, FIXED_CELLS_NUM, descr1);
+      makeRealDescrs(n+1, FIXED_NBO, FIXED_CELLS_NUM, descr2);
+
+      SiftDist<double> sd(FIXED_NBO, FIXED_CELLS_NUM);
+      SiftDist<double, FIXED_NBO, FIXED_CELLS_NUM> fixed_sd(FIXED_NBO, FIXED_CELLS_NUM);
+      std::vector<double> stopThresholdsArr(FIXED_CELLS_NUM);
+      const double dist= sd(&descr1[0], &descr2[sift_dim]);
+      for (unsigned int c=0; c<FIXED_CELLS_NUM; ++c) stopThresholdsArr[c]= dist*(c+1)/FIXED_CELLS_NUM;
+
+      // Shifted by one descriptor, so that both the cyclic (even with odd)
+      // and the usual pairs are compared
+      for (unsigned int shift=0; shift<2; ++shift) {
+          for (unsigned int i=0; i<n; ++i) {
+              const double* sift1= &descr1[i*sift_dim];
+              const double* sift2= &descr2[(i+shift)*sift_dim];
+              assert(fixed_sd(sift1, sift2)==sd(sift1, sift2));
+              assert(fixed_sd(sift1, sift2, &stopThresholdsArr[0])==sd(sift1, sift2, &stopThresholdsArr[0]));
+          }
+      }
+
+} // testFixedSiftDist
+
+// Records which SiftDistMulti dispatchSiftDist chose, and its distance
+struct RecordSiftDist {
+    const double* sift1;
+    const double* sift2;
+    unsigned int fixedNBO;
+    unsigned int fixedCellsNum;
+    double dist;
+    template<unsigned int FIXED_NBO, unsigned int FIXED_CELLS_NUM>
+    void operator()(SiftDistMulti<double, FIXED_NBO, FIXED_CELLS_NUM>& sd) {
+        fixedNBO= FIXED_NBO;
+        fixedCellsNum= FIXED_CELLS_NUM;
+        dist= sd(sift1, sift2);
+    }
+}; // end RecordSiftDist
+
+// dispatchSiftDist uses the fixed instances for 16/16 and 8/16, and the
+// generic SiftDistMulti for the other shapes.
+static void testDispatchSiftDist() {
+
+      srand(13);
+      testFixedSiftDist<16, 16>();
+      testFixedSiftDist<8, 16>();
+
+      const unsigned int shapes[][4]= { // NBO, CELLS_NUM, expected FIXED_NBO, FIXED_CELLS_NUM
+          {16, 16, 16, 16}, {8, 16, 8, 16}, {8, 9, 0, 0}, {4, 16, 0, 0}, {16, 4, 0, 0}, {12, 16, 0, 0}};
+      for (unsigned int s=0; s<6; ++s) {
+          const unsigned int NBO= shapes[s][0], CELLS_NUM= shapes[s][1];
+          std::vector<double> descr;
+          makeRealDescrs(2, NBO, CELLS_NUM, descr);
+          RecordSiftDist f;
+          f.sift1= &descr[0];
+          f.sift2= &descr[NBO*CELLS_NUM];
+          dispatchSiftDist<double>(NBO, CELLS_NUM, f);
+          assert(f.fixedNBO==shapes[s][2] && f.fixedCellsNum==shapes[s][3]);
+          SiftDist<double> sd(NBO, CELLS_NUM);
+          assert(f.dist==sd(f.sift1, f.sift2));
+      }
+
+} // testDispatchSiftDist
+
+// Quantized (unsigned char) descriptors give the same distances and
+// matches as the same values in double, also through siftRatioMatch.
+static void testQuantized() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n1= 60, n2= 50;
+
+      std::vector<unsigned char> descr_u8;
+      std::vector<double> frames;
+      makeFixture(n1, n2, NBO, NBP, 1, descr_u8, frames);
+      const std::vector<double> descr(descr_u8.begin(), descr_u8.end());
+      const unsigned char* descr1_u8= &descr_u8[0];
+      const unsigned char* descr2_u8= &descr_u8[n1*sift_dim];
+      const double* descr1= &descr[0];
+      const double* descr2= &descr[n1*sift_dim];
+      const double* frames1= &frames[0];
+      const double* frames2= &frames[4*n1];
+
+      SiftDist<double> sd(NBO, CELLS_NUM);
+      SiftDist<unsigned char> sd_u8(NBO, CELLS_NUM);
+      SiftDistMulti<unsigned char> sdm_u8(NBO, CELLS_NUM);
+      for (unsigned int i=0; i<n1; ++i) {
+          for (unsigned int j=0; j<n2; ++j) {
+              unsigned int d= sd_u8(descr1_u8+i*sift_dim, descr2_u8+j*sift_dim);
+              assert(d==sd(descr1+i*sift_dim, descr2+j*sift_dim));
+              assert(d==sdm_u8(descr1_u8+i*sift_dim, descr2_u8+j*sift_dim));
+          }
+      }
+
+      for (int prune=0; prune<2; ++prune) {
+          std::vector<double> inds(n1, 0), ratios(n1, 0), inds_u8(n1, 0), ratios_u8(n1, 0);
+          SiftDistMulti<double> sdm(NBO, CELLS_NUM);
+          SiftRatioMatchImpl< SiftDistMulti<double> >(descr1, frames1, n1, descr2, frames2, n2,
+                                                       1.25, 0.7, NBO, NBP, 3.0, 0.5, sdm, 4, 0, 1, 2,
+                                                       &inds[0], &ratios[0], 1, 4*1024*1024, prune==1);
+          SiftRatioMatchImpl< SiftDistMulti<unsigned char>, unsigned char >
+              (descr1_u8, frames1, n1, descr2_u8, frames2, n2,
+               1.25, 0.7, NBO, NBP, 3.0, 0.5, sdm_u8, 4, 0, 1, 2,
+               &inds_u8[0], &ratios_u8[0], 1, 4*1024*1024, prune==1);
+          // The ratios might differ slightly, as integer stop thresholds are rounded up
+          assert(inds==inds_u8);
+
+          // The library interface gives the same matches, 0-based
+          SiftMatchParams params;
+          params.NBO= NBO;
+          params.NBP= NBP;
+          params.pruneWithCellsBounds= prune==1;
+          SiftMatchResult result;
+          assert(siftRatioMatch(descr1_u8, frames1, n1, descr2_u8, frames2, n2,
+                                params, result));
+          for (unsigned int i=0; i<n1; ++i) assert(result.inds[i]==inds_u8[i]-1);
+          assert(result.ratios==ratios_u8);
+          assert(result.matchesNum()>0);
+      }
+
+} // testQuantized
+
+// FramesGrid finds all the frames whose circles intersect a frame, with
+// a few large frames and a frame with a non finite position.
+static void testFramesGrid() {
+
+      const unsigned int n= 500;
+      srand(2);
+      std::vector<double> frames(4*n), radius_vec(n);
+      for (unsigned int i=0; i<n; ++i) {
+          frames[4*i]= rand()%1000;
+          frames[4*i+1]= rand()%700;
+          radius_vec[i]= (i%50==0) ? 400 : 1+rand()%40;
+      }
+      frames[4*7]= HUGE_VAL;
+      FramesGrid grid;
+      grid.build(&frames[0], 4, 0, 1, radius_vec);
+      std::vector<unsigned int> near;
+      for (unsigned int m=0; m<n; ++m) {
+          grid.candidates(frames[4*m], frames[4*m+1], radius_vec[m], near);
+          std::vector<bool> is_near(n, false);
+          for (unsigned int k=0; k<near.size(); ++k) {
+              assert(!is_near[near[k]]);
+              is_near[near[k]]= true;
+          }
+          for (unsigned int i=0; i<n; ++i) {
+              if (!(circleFuncs::circleOverlap(frames[4*i], frames[4*i+1], radius_vec[i],
+                                                frames[4*m], frames[4*m+1], radius_vec[m])<=0.0)) {
+                  assert(is_near[i]);
+              }
+          }
+      }
+
+} // testFramesGrid
+
+// A SiftRatioMatcher of SiftDescrSets, appended in batches and with some
+// descriptors removed, matches as SiftRatioMatchImpl of the same arrays,
+// also when the same matcher is used again with other sets.
+static void testSiftRatioMatcher() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n= 80;
+
+      std::vector<unsigned char> descr;
+      std::vector<double> frames;
+      makeFixture(n/2, n/2, NBO, NBP, 3, descr, frames);
+
+      typedef SiftDistMulti<unsigned char> SD;
+      SD sd(NBO, CELLS_NUM);
+
+      // An empty set (e.g. an image without descriptors) has no matches
+      {
+          SiftDescrSet<unsigned char> full(NBO, NBP), empty(NBO, NBP);
+          full.append(&descr[0], &frames[0], n/2);
+          SiftRatioMatcher<SD, unsigned char> matcher(1.25, 0.7, NBO, NBP, 0.5, sd, 4, 0, 1);
+          std::vector<double> inds(n/2, 7), ratios(n/2, 7);
+          matcher.match(full, empty, &inds[0], &ratios[0]);
+          assert(inds==std::vector<double>(n/2, 0.0) && ratios==inds);
+          matcher.match(empty, full, NULL, NULL);
+      }
+
+      for (int prune=0; prune<2; ++prune) {
+          SiftRatioMatcher<SD, unsigned char> matcher(1.25, 0.7, NBO, NBP, 0.5, sd, 4, 0, 1, 1, 4*1024*1024, prune==1);
+          for (unsigned int removed=0; removed<2; ++removed) {
+              // set1 is the first half, set2 the second half in two batches
+              SiftDescrSet<unsigned char> set1(NBO, NBP), set2(NBO, NBP);
+              set1.append(&descr[0], &frames[0], n/2);
+              assert(set2.append(&descr[n/2*sift_dim], &frames[4*n/2], n/4)==0);
+              assert(set2.append(&descr[3*n/4*sift_dim], &frames[4*3*n/4], n/4)==n/4);
+              std::vector<unsigned int> ids;
+              if (removed==1) {
+                  for (unsigned int j=0; j<n/2; j+=3) ids.push_back(j);
+                  assert(set2.remove(&ids[0], static_cast<unsigned int>(ids.size()))==ids.size());
+                  assert(set2.remove(&ids[0], 1)==0);
+              }
+              // The arrays of set2 as they are after the removal
+              std::vector<unsigned char> descr2;
+              std::vector<double> frames2;
+              for (unsigned int j=0; j<n/2; ++j) {
+                  if (std::find(ids.begin(), ids.end(), j)!=ids.end()) continue;
+                  unsigned int i;
+                  assert(set2.find(j, i) && set2.id(i)==j && i==descr2.size()/sift_dim);
+                  descr2.insert(descr2.end(), &descr[(n/2+j)*sift_dim], &descr[(n/2+j+1)*sift_dim]);
+                  frames2.insert(frames2.end(), &frames[4*(n/2+j)], &frames[4*(n/2+j+1)]);
+              }
+              assert(set2.size()*sift_dim==descr2.size());
+              assert(std::equal(descr2.begin(), descr2.end(), set2.descr()));
+
+              std::vector<double> inds(n/2, 0), ratios(n/2, 0), matcher_inds(n/2, 7), matcher_ratios(n/2, 7);
+              SiftRatioMatchImpl<SD, unsigned char>(&descr[0], &frames[0], n/2, &descr2[0], &frames2[0], set2.size(),
+                                                    1.25, 0.7, NBO, NBP, 3.0, 0.5, sd, 4, 0, 1, 2,
+                                                    &inds[0], &ratios[0], 1, 4*1024*1024, prune==1);
+              matcher.match(set1, set2, &matcher_inds[0], &matcher_ratios[0]);
+              assert(inds==matcher_inds);
+              assert(ratios==matcher_ratios);
+
+              SiftMatchParams params;
+              params.NBO= NBO;
+              params.NBP= NBP;
+              params.pruneWithCellsBounds= prune==1;
+              SiftMatchResult result;
+              assert(siftRatioMatch(set1, set2, params, result));
+              for (unsigned int i=0; i<n/2; ++i) assert(result.inds[i]==inds[i]-1);
+              assert(result.matchesNum()>0);
+              params.magnif= 2.0;
+              assert(!siftRatioMatch(set1, set2, params, result) && !result.error.empty());
+          }
+      }
+
+      // With stopThresholdsFactorGamma 0 only the last stop threshold stops
+      // pairs, which is exact, so the cascade skips pairs but not matches
+      SiftDescrSet<unsigned char> set1(NBO, NBP), set2(NBO, NBP);
+      set1.append(&descr[0], &frames[0], n/2);
+      set2.append(&descr[n/2*sift_dim], &frames[4*n/2], n/2);
+      SiftRatioMatcher<SD, unsigned char> matcher(1.25, 0.0, NBO, NBP, 0.5, sd, 4, 0, 1);
+      std::vector<double> inds(n/2), ratios(n/2), cascade_inds(n/2), cascade_ratios(n/2);
+      matcher.match(set1, set2, &inds[0], &ratios[0]);
+      matcher.setCascadeWithCellsBounds(true);
+      SiftDistPruneStats stats(CELLS_NUM);
+      matcher.match(set1, set2, &cascade_inds[0], &cascade_ratios[0], &stats);
+      assert(inds==cascade_inds);
+      assert(stats.cascadeSkips>0);
+
+      // Neighbors, which are also exact with gamma 0, and do not change the matches
+      std::vector< std::vector< std::pair<unsigned int,unsigned int> > > all(n/2);
+      for (unsigned int i=0; i<n/2; ++i) {
+          for (unsigned int j=0; j<n/2; ++j) {
+              all[i].push_back(std::make_pair(sd(set1.descr()+i*sift_dim, set2.descr()+j*sift_dim), j));
+          }
+          std::sort(all[i].begin(), all[i].end());
+      }
+      const double radius= all[0][n/4].first;
+      for (int cascade=0; cascade<2; ++cascade) {
+          for (unsigned int k=0; k<4; k+=3) {
+              SiftMatchParams params;
+              params.NBO= NBO;
+              params.NBP= NBP;
+              params.stopThresholdsFactorGamma= 0.0;
+              params.cascadeWithCellsBounds= cascade==1;
+              params.neighborsK= k;
+              params.neighborsRadius= k==0 ? radius : HUGE_VAL;
+              SiftMatchResult result;
+              assert(siftRatioMatch(set1, set2, params, result));
+              const SiftNeighbors& nb= result.neighbors;
+              assert(nb.starts.size()==n/2+1 && nb.inds.size()==nb.dists.size());
+              for (unsigned int i=0; i<n/2; ++i) {
+                  assert(result.inds[i]==inds[i]-1);
+                  unsigned int expected_num= 0;
+                  while (expected_num<all[i].size() && all[i][expected_num].first<params.neighborsRadius &&
+                         (k==0 || expected_num<k)) ++expected_num;
+                  assert(nb.num(i)==expected_num);
+                  for (unsigned int l=0; l<expected_num; ++l) {
+                      assert(nb.inds[nb.starts[i]+l]==all[i][l].second);
+                      assert(nb.dists[nb.starts[i]+l]==all[i][l].first);
+                  }
+              }
+          }
+      }
+
+} // testSiftRatioMatcher
+
+// The counters of the hot paths add up (with SIFT_DIST_COUNTERS), or stay 0.
+static void testCounters() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n= 60;
+
+      std::vector<unsigned char> descr;
+      std::vector<double> frames;
+      makeFixture(n/2, n/2, NBO, NBP, 4, descr, frames);
+
+      SiftDist<unsigned char> sd(NBO, CELLS_NUM);
+      sd(&descr[0], &descr[sift_dim]);
+      const SiftDistCounters& dc= sd.counters();
+      assert(dc.pairs==(SiftDistCounters::enabled ? 1u : 0u));
+      assert(dc.cells==dc.pairs*CELLS_NUM);
+      assert(dc.smallFlowsCarry+dc.smallFlowsAbsorb+dc.smallFlowsFlip+dc.cyclicEdges>0 || !SiftDistCounters::enabled);
+      sd.resetCounters();
+      assert(sd.counters().pairs==0);
+
+      for (int prune=0; prune<2; ++prune) {
+          SiftMatchParams params;
+          params.NBO= NBO;
+          params.NBP= NBP;
+          params.pruneWithCellsBounds= prune==1;
+          SiftMatchResult result;
+          assert(siftRatioMatch(&descr[0], &frames[0], n/2, &descr[n/2*sift_dim], &frames[4*n/2], n/2,
+                                params, result));
+          const SiftRatioMatchCounters& c= result.counters;
+          if (!SiftDistCounters::enabled) {
+              assert(c.matches==0 && c.queries==0 && c.dist.pairs==0);
+              continue;
+          }
+          assert(c.matches==1 && c.queries==n/2);
+          assert(c.symmetricRejects+c.ratioRejects+result.matchesNum()==n/2);
+          assert(c.reverseScans+c.reverseScansCached>=n/2-c.symmetricRejects);
+          assert(c.dist.pairs>=n/2*(n/2)+c.reverseScans*(n/2));
+          // Each pair computed all the cells, or was stopped after some
+          unsigned long long not_computed= 0;
+          for (unsigned int i=0; i<CELLS_NUM; ++i) not_computed+= c.dist.stopsAtCell[i]*(CELLS_NUM-i);
+          assert(c.dist.cells+not_computed==c.dist.pairs*CELLS_NUM);
+          std::ostringstream json;
+          c.writeJson(json);
+          assert(json.str().find("{\"matches\": 1, \"queries\": 30")==0);
+      }
+
+} // testCounters
+
+// Raw descriptors appended with a SiftDescrPrep are the prepared ones, and
+// match as the caller's own preparation.
+static void testSiftDescrPrep() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int sift_dim= NBO*NBP*NBP;
+      const unsigned int n= 40;
+
+      std::vector<double> raw, frames;
+      makeFixture(n/2, n/2, NBO, NBP, 5, raw, frames, 256, 0, 4);
+      // The last one is empty
+      std::fill(raw.end()-sift_dim, raw.end(), 0.0);
+      std::vector<double> sqrt_raw(n*sift_dim);
+      for (unsigned int k=0; k<n*sift_dim; ++k) sqrt_raw[k]= std::sqrt(raw[k]);
+
+      SiftDescrPrep prep;
+      SiftDescrSet<double> set1(NBO, NBP), set2(NBO, NBP);
+      set1.append(&raw[0], &frames[0], n/2, prep);
+      set2.append(&raw[n/2*sift_dim], &frames[4*n/2], n/2, prep);
+      assert(std::equal(sqrt_raw.begin(), sqrt_raw.begin()+n/2*sift_dim, set1.descr()));
+      SiftMatchParams params;
+      params.NBO= NBO;
+      params.NBP= NBP;
+      SiftMatchResult result, expected;
+      assert(siftRatioMatch(set1, set2, params, result));
+      assert(siftRatioMatch(&sqrt_raw[0], &frames[0], n/2, &sqrt_raw[n/2*sift_dim], &frames[4*n/2], n/2,
+                            params, expected));
+      assert(result.inds==expected.inds && result.ratios==expected.ratios);
+      assert(result.matchesNum()>0);
+
+      // RootSIFT quantized to unsigned char
+      prep.l1Normalize= true;
+      prep.scale= 255.0;
+      SiftDescrSet<unsigned char> set3(NBO, NBP);
+      set3.append(&raw[0], &frames[0], n, prep);
+      for (unsigned int i=0; i<n; ++i) {
+          double sum= 0.0;
+          for (unsigned int k=0; k<sift_dim; ++k) sum+= raw[i*sift_dim+k];
+          for (unsigned int k=0; k<sift_dim; ++k) {
+              double v= sum>0.0 ? std::sqrt(raw[i*sift_dim+k]/sum)*255.0 : 0.0;
+              assert(std::fabs(set3.descr()[i*sift_dim+k]-v)<=0.5+1e-9);
+          }
+      }
+
+} // testSiftDescrPrep
+
+// SiftEmdModDist is EMD_MOD of each cell, plus 2 for each unit of the mass
+// difference, and matches through siftRatioMatch (distType EmdModType).
+static void testSiftEmdModDist() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n= 40;
+
+      std::vector<double> descr, frames;
+      makeFixture(n/2, n/2, NBO, NBP, 6, descr, frames, 16, 0, 2);
+
+      SiftEmdModDist sd(NBO, CELLS_NUM);
+      const double* sift1= &descr[0];
+      const double* sift2= &descr[n/2*sift_dim];
+      double expected= 0.0;
+      std::vector<double> scaled(NBO), cellsMass1(CELLS_NUM), cellsMass2(CELLS_NUM);
+      for (unsigned int c=0; c<CELLS_NUM; ++c) {
+          cellsMass1[c]= SiftDist<double>::cellMass(sift1+c*NBO, NBO);
+          cellsMass2[c]= SiftDist<double>::cellMass(sift2+c*NBO, NBO);
+          // The copies are at least as heavy
+          assert(cellsMass2[c]>=cellsMass1[c]);
+          for (unsigned int k=0; k<NBO; ++k) scaled[k]= sift2[c*NBO+k]*(cellsMass1[c]/cellsMass2[c]);
+          expected+= EMD_MOD<false>(sift1+c*NBO, &scaled[0], NBO) + 2*(cellsMass2[c]-cellsMass1[c]);
+      }
+      const double dist= sd(sift1, sift2);
+      assert(std::fabs(dist-expected)<1e-9*expected);
+      assert(dist>=sd.cellsBound(&cellsMass1[0], &cellsMass2[0]));
+      assert(sd(sift1, sift1)==0.0);
+
+      std::vector<double> stopThresholdsArr(CELLS_NUM, 1e300);
+      assert(sd.prunedDist(sift1, sift2, &stopThresholdsArr[0], &cellsMass1[0], &cellsMass2[0], NULL)==dist);
+      stopThresholdsArr[0]= 0.0;
+      stopThresholdsArr[CELLS_NUM-1]= 4242;
+      assert(sd(sift1, sift2, &stopThresholdsArr[0])==4242);
+      assert(sd.prunedDist(sift1, sift2, &stopThresholdsArr[0], &cellsMass1[0], &cellsMass2[0], NULL)==4242);
+      assert(sd.pruneStats().pairs==2 && sd.pruneStats().thresholdStops==1);
+
+      // With stopThresholdsFactorGamma 0 the cascade skips pairs but not matches
+      SiftMatchParams params;
+      params.NBO= NBO;
+      params.NBP= NBP;
+      params.distType= SiftMatchParams::EmdModType;
+      params.stopThresholdsFactorGamma= 0.0;
+      SiftMatchResult result, cascade_result;
+      assert(siftRatioMatch(&descr[0], &frames[0], n/2, &descr[n/2*sift_dim], &frames[4*n/2], n/2,
+                            params, result));
+      assert(result.matchesNum()>0);
+      params.cascadeWithCellsBounds= true;
+      assert(siftRatioMatch(&descr[0], &frames[0], n/2, &descr[n/2*sift_dim], &frames[4*n/2], n/2,
+                            params, cascade_result));
+      assert(result.inds==cascade_result.inds);
+
+      std::vector<unsigned char> quantized(descr.begin(), descr.end());
+      assert(!siftRatioMatch(&quantized[0], &frames[0], n/2, &quantized[n/2*sift_dim], &frames[4*n/2], n/2,
+                             params, result) && !result.error.empty());
+
+} // testSiftEmdModDist
+
+// The k nearest neighbors of SiftDistVpTree are the ones of a scan of all
+// the descriptors, also when the search is stopped by max_dists_num, and
+// siftRatioMatch with useVpTree matches as the scan does.
+static void testSiftDistVpTree() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n= 300, queries_num= 20, k= 5;
+
+      srand(10);
+      std::vector<double> descr, queries;
+      makeRealDescrs(n, NBO, CELLS_NUM, descr);
+      makeRealDescrs(queries_num, NBO, CELLS_NUM, queries);
+      SiftDist<double> sd(NBO, CELLS_NUM);
+      SiftDistVpTree< SiftDist<double> > tree(&descr[0], n, NBO, CELLS_NUM, sd, 4);
+      assert(tree.size()==n);
+      for (unsigned int q=0; q<queries_num; ++q) {
+          const double* query= &queries[q*sift_dim];
+          std::vector< std::pair<double,unsigned int> > all(n);
+          for (unsigned int i=0; i<n; ++i) all[i]= std::make_pair(sd(&descr[i*sift_dim], query), i);
+          std::sort(all.begin(), all.end());
+
+          std::vector<unsigned int> inds(k);
+          std::vector<double> dists(k);
+          assert(tree.knn(query, k, &inds[0], &dists[0])==k);
+          for (unsigned int l=0; l<k; ++l) {
+              assert(inds[l]==all[l].second && dists[l]==all[l].first);
+          }
+          assert(tree.lastDistsNum()<=n);
+
+          // Stopped after max_dists_num distances: the distances found are
+          // exact, but of neighbors that might be farther
+          const unsigned int max_dists_num= 30;
+          assert(tree.knn(query, k, &inds[0], &dists[0], 0.0, max_dists_num)==k);
+          assert(tree.lastDistsNum()<=max_dists_num);
+          for (unsigned int l=0; l<k; ++l) {
+              assert(dists[l]==sd(&descr[inds[l]*sift_dim], query));
+              assert(dists[l]>=all[l].first && (l==0 || dists[l]>=dists[l-1]));
+          }
+          assert(tree.knn(query, k, &inds[0], &dists[0], 0.0, n)==k);
+          for (unsigned int l=0; l<k; ++l) assert(inds[l]==all[l].second);
+      }
+
+      // With all the descriptors as neighbors and no stop thresholds (distRatio
+      // -1) the ratios are exact, as the ones of the scan
+      const unsigned int n1= 60, n2= 50;
+      std::vector<double> fixture, frames;
+      makeFixture(n1, n2, NBO, NBP, 10, fixture, frames);
+      SiftMatchParams params;
+      params.NBO= NBO;
+      params.NBP= NBP;
+      params.distRatio= -1;
+      SiftMatchResult result, vp_result;
+      assert(siftRatioMatch(&fixture[0], &frames[0], n1, &fixture[n1*sift_dim], &frames[4*n1], n2,
+                            params, result));
+      params.useVpTree= true;
+      params.vpTreeNeighborsNum= n1;
+      assert(siftRatioMatch(&fixture[0], &frames[0], n1, &fixture[n1*sift_dim], &frames[4*n1], n2,
+                            params, vp_result));
+      assert(vp_result.inds==result.inds && vp_result.ratios==result.ratios);
+      assert(vp_result.matchesNum()>0);
+
+      params.neighborsK= 2;
+      assert(!siftRatioMatch(&fixture[0], &frames[0], n1, &fixture[n1*sift_dim], &frames[4*n1], n2,
+                             params, vp_result) && !vp_result.error.empty());
+      params.neighborsK= 0;
+      std::vector<unsigned char> quantized(fixture.begin(), fixture.end());
+      assert(!siftRatioMatch(&quantized[0], &frames[0], n1, &quantized[n1*sift_dim], &frames[4*n1], n2,
+                             params, vp_result) && !vp_result.error.empty());
+
+} // testSiftDistVpTree
+
+// A repetitive texture: many queries have the same nearest descriptor, whose
+// reverse scan is then cached. The matches are the same without the cache,
+// with a tiny one (where the descriptors collide and evict each other) and
+// with a large one.
+static void testReverseScanCache() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      // descr2 are the n2 textons, the queries are 15 noisy copies of each
+      const unsigned int n2= 40, n1= 15*n2;
+
+      std::vector<unsigned char> descr;
+      std::vector<double> frames;
+      makeFixture(n2, n1, NBO, NBP, 9, descr, frames);
+      // The first copy of each texton is almost exact, so it is the one that
+      // matches; for the other copies the texton is the nearest, but they
+      // are not its nearest
+      for (unsigned int j=0; j<n2; ++j) {
+          for (unsigned int k=0; k<sift_dim; ++k) {
+              unsigned int v= descr[((j*7)%n2)*sift_dim+k] + k%2;
+              descr[(n2+j)*sift_dim+k]= static_cast<unsigned char>(v>255 ? 255 : v);
+          }
+      }
+      const unsigned char* descr1= &descr[n2*sift_dim];
+      const double* frames1= &frames[4*n2];
+      typedef SiftDistMulti<unsigned char> SD;
+      SD sd(NBO, CELLS_NUM);
+
+      // No cache, 3 scans (of a key, an index and two distances) and 4MB
+      const size_t cache_bytes[]= {0, 3*(2*sizeof(unsigned int)+2*sizeof(double)), 4*1024*1024};
+      for (unsigned int threads=1; threads<=3; threads+=2) {
+          std::vector<double> inds0, ratios0;
+          for (unsigned int c=0; c<3; ++c) {
+              std::vector<double> inds(n1, 0), ratios(n1, 0);
+              SiftRatioMatchCounters counters;
+              SiftRatioMatchImpl<SD, unsigned char>(descr1, frames1, n1, &descr[0], &frames[0], n2,
+                                                    1.25, 0.7, NBO, NBP, 3.0, 0.5, sd, 4, 0, 1, 2,
+                                                    &inds[0], &ratios[0], threads, cache_bytes[c],
+                                                    false, false, NULL, false, NULL, &counters);
+              assert(counters.reverseScansCached>0 || c==0 || !SiftDistCounters::enabled);
+              assert(counters.reverseScansCached==0 || c>0);
+              if (c==0) {
+                  inds0= inds;
+                  ratios0= ratios;
+                  // Only the first copies match
+                  assert(std::count(inds.begin(), inds.end(), 0.0)==static_cast<long>(n1-n2));
+                  continue;
+              }
+              assert(inds==inds0 && ratios==ratios0);
+          }
+      }
+
+} // testReverseScanCache
+
+// Counts how many times each task ran, and on which threads
+struct CountTasks {
+    std::vector<unsigned int> runs;
+    std::vector<unsigned int> threadRuns;
+    unsigned int threadsNum;
+    void operator()(unsigned int thread_ind, unsigned int task) {
+        assert(thread_ind<threadsNum && task<runs.size());
+        // Each task is run once, so no two threads write the same element
+        ++runs[task];
+        ++threadRuns[thread_ind];
+    }
+}; // end CountTasks
+
+// WorkStealingPool runs every task exactly once, with fewer tasks than
+// threads and with more, and the matches and prune counts of
+// SiftRatioMatchImpl do not depend on the number of threads.
+static void testThreads() {
+
+      const unsigned int threads[]= {1, 3, 8};
+      const unsigned int tasks[]= {0, 2, 7, 1000};
+      for (unsigned int t=0; t<3; ++t) {
+          WorkStealingPool pool(threads[t]);
+          assert(pool.threadsNum()==threads[t]);
+          // The same pool runs all of them, one after the other
+          for (unsigned int k=0; k<4; ++k) {
+              CountTasks f;
+              f.runs.assign(tasks[k], 0);
+              f.threadRuns.assign(threads[t], 0);
+              f.threadsNum= threads[t];
+              pool.run(tasks[k], f);
+              assert(f.runs==std::vector<unsigned int>(tasks[k], 1));
+              unsigned int runs_num= 0;
+              for (unsigned int i=0; i<threads[t]; ++i) runs_num+= f.threadRuns[i];
+              assert(runs_num==tasks[k]);
+          }
+      }
+      assert(WorkStealingPool::resolveThreadsNum(0)>=1);
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int CELLS_NUM= NBP*NBP;
+      const unsigned int sift_dim= NBO*CELLS_NUM;
+      const unsigned int n1= 600, n2= 300;
+
+      std::vector<unsigned char> descr;
+      std::vector<double> frames;
+      makeFixture(n1, n2, NBO, NBP, 8, descr, frames);
+      typedef SiftDistMulti<unsigned char> SD;
+      SD sd(NBO, CELLS_NUM);
+      // Enough blocks for all the threads
+      typedef SiftRatioMatcher<SD, unsigned char> Matcher;
+      assert(Matcher::blocksNum(sift_dim, n1, n2)>=8);
+
+      // The reverse scans are cached per thread, so the prune counts are
+      // compared without the cache (with it, a scan might be computed by
+      // several threads)
+      const size_t cache_bytes[]= {0, 4*1024*1024};
+      for (int prune=0; prune<2; ++prune) {
+          for (unsigned int c=0; c<2; ++c) {
+              std::vector<double> inds1, ratios1;
+              SiftDistPruneStats stats1;
+              for (unsigned int t=0; t<3; ++t) {
+                  std::vector<double> inds(n1, 0), ratios(n1, 0);
+                  SiftDistPruneStats stats(CELLS_NUM);
+                  SiftRatioMatchImpl<SD, unsigned char>(&descr[0], &frames[0], n1, &descr[n1*sift_dim], &frames[4*n1], n2,
+                                                        1.25, 0.7, NBO, NBP, 3.0, 0.5, sd, 4, 0, 1, 2,
+                                                        &inds[0], &ratios[0], threads[t], cache_bytes[c],
+                                                        prune==1, false, &stats, prune==1);
+                  if (t==0) {
+                      inds1= inds;
+                      ratios1= ratios;
+                      stats1= stats;
+                      continue;
+                  }
+                  assert(inds==inds1 && ratios==ratios1);
+                  if (cache_bytes[c]>0) continue;
+                  assert(stats.pairs==stats1.pairs && stats.boundStops==stats1.boundStops);
+                  assert(stats.thresholdStops==stats1.thresholdStops && stats.cellsComputed==stats1.cellsComputed);
+                  assert(stats.stopsAtCell==stats1.stopsAtCell);
+                  assert(stats.cascadePairs==stats1.cascadePairs && stats.cascadeSkips==stats1.cascadeSkips);
+              }
+              assert(std::count(inds1.begin(), inds1.end(), 0.0)<n1);
+          }
+      }
+
+} // testThreads
+
+// The bytes of a file, read or written whole
+static std::vector<char> readFile(const char* path) {
+      std::vector<char> bytes;
+      FILE* f= fopen(path, "rb");
+      assert(f!=NULL);
+      char chunk[4096];
+      size_t n;
+      while ((n= fread(chunk, 1, sizeof(chunk), f))>0) bytes.insert(bytes.end(), chunk, chunk+n);
+      fclose(f);
+      return bytes;
+}
+static void writeFile(const char* path, const std::vector<char>& bytes) {
+      FILE* f= fopen(path, "wb");
+      assert(f!=NULL);
+      assert(fwrite(&bytes[0], 1, bytes.size(), f)==bytes.size());
+      fclose(f);
+}
+
+// A store of NUM_T descriptors written in two appends reads back as they were
+template<typename NUM_T>
+static void testSiftDescrStoreRoundTrip(const char* path) {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 2;
+      const unsigned int sift_dim= NBO*NBP*NBP;
+      const unsigned int n= 7;
+
+      std::vector<NUM_T> descr;
+      std::vector<double> frames;
+      makeFixture(4, n-4, NBO, NBP, 14, descr, frames);
+      for (unsigned int i=0; i<n; ++i) frames[4*i+3]= i*0.5;
+
+      SiftDescrStoreWriter writer;
+      assert(writer.open(path, NBO, NBP, SiftDescrStoreElem<NUM_T>::TYPE));
+      assert(writer.append(&descr[0], &frames[0], 3));
+      assert(writer.append(&descr[3*sift_dim], &frames[4*3], n-3));
+      assert(writer.size()==n);
+      assert(writer.close());
+
+      SiftDescrStore store;
+      assert(store.open(path));
+      assert(store.NBO()==NBO && store.NBP()==NBP && store.siftDim()==sift_dim && store.size()==n);
+      assert(store.elemType()==static_cast<unsigned int>(SiftDescrStoreElem<NUM_T>::TYPE));
+      assert(std::equal(descr.begin(), descr.end(), store.descr<NUM_T>()));
+      assert(std::equal(frames.begin(), frames.end(), store.frames()));
+      assert(store.descr<NUM_T>(2)==store.descr<NUM_T>()+2*sift_dim);
+      // Both sections are aligned, so they can be used as they are
+      assert(reinterpret_cast<size_t>(store.descr<NUM_T>())%SiftDescrStoreHeader::ALIGNMENT==0);
+      assert(reinterpret_cast<size_t>(store.frames())%SiftDescrStoreHeader::ALIGNMENT==0);
+
+} // testSiftDescrStoreRoundTrip
+
+// SiftDescrStore reads what SiftDescrStoreWriter wrote, and rejects files
+// that are not valid stores.
+static void testSiftDescrStore() {
+
+      const char* path= "SiftDistTest.sds";
+      testSiftDescrStoreRoundTrip<unsigned char>(path);
+      testSiftDescrStoreRoundTrip<unsigned short>(path);
+      testSiftDescrStoreRoundTrip<double>(path);
+
+      // Appending descriptors of another type fails
+      SiftDescrStoreWriter writer;
+      assert(!writer.open(path, 8, 2, 7) && !writer.error().empty());
+      assert(writer.open(path, 8, 2, SiftDescrStoreHeader::ELEM_UINT8));
+      std::vector<double> descr(8*2*2, 1.0), frames(4, 1.0);
+      assert(!writer.append(&descr[0], &frames[0]) && !writer.error().empty());
+      assert(!writer.close());
+
+      // A valid file to break in each of the ways below (the last read was of doubles)
+      testSiftDescrStoreRoundTrip<double>(path);
+      const std::vector<char> valid= readFile(path);
+      SiftDescrStoreHeader header;
+      memcpy(&header, &valid[0], sizeof(header));
+      assert(header.check(valid.size())==NULL);
+      SiftDescrStore store;
+
+      std::vector<char> bytes= valid;
+      bytes[0]= 'X';
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("not a SIFT descriptors store file")!=std::string::npos);
+
+      bytes= valid;
+      uint32_t elem_type= 7;
+      memcpy(&bytes[offsetof(SiftDescrStoreHeader, elemType)], &elem_type, sizeof(elem_type));
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("unsupported element type")!=std::string::npos);
+
+      bytes.assign(valid.begin(), valid.end()-1);
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("truncated file")!=std::string::npos);
+      bytes.assign(valid.begin(), valid.begin()+sizeof(SiftDescrStoreHeader)/2);
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("too short for a header")!=std::string::npos);
+
+      // More descriptors than the file has, by one and by far
+      const uint64_t counts[]= {header.count+1, 1ull<<40};
+      for (int c=0; c<2; ++c) {
+          bytes= valid;
+          memcpy(&bytes[offsetof(SiftDescrStoreHeader, count)], &counts[c], sizeof(counts[c]));
+          writeFile(path, bytes);
+          assert(!store.open(path) && !store.error().empty() && !store.isOpen());
+      }
+
+      // Offsets and shapes whose sizes overflow 64 bits
+      bytes= valid;
+      const uint64_t frames_offset= 0xFFFFFFFFFFFFFFC0ull, count= 2;
+      memcpy(&bytes[offsetof(SiftDescrStoreHeader, framesOffset)], &frames_offset, sizeof(frames_offset));
+      memcpy(&bytes[offsetof(SiftDescrStoreHeader, count)], &count, sizeof(count));
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("truncated file")!=std::string::npos);
+      bytes= valid;
+      const uint32_t nbo= 2, nbp= 0x80000000u;
+      memcpy(&bytes[offsetof(SiftDescrStoreHeader, NBO)], &nbo, sizeof(nbo));
+      memcpy(&bytes[offsetof(SiftDescrStoreHeader, NBP)], &nbp, sizeof(nbp));
+      writeFile(path, bytes);
+      assert(!store.open(path) && store.error().find("invalid NBO or NBP")!=std::string::npos);
+
+      writeFile(path, valid);
+      assert(store.open(path) && store.isOpen());
+      store.close();
+      remove(path);
+      assert(!store.open(path));
+
+} // testSiftDescrStore
+
+// siftRatioMatchBatch gives each candidate the result of siftRatioMatch,
+// with any number of threads.
+static void testSiftRatioMatchBatch() {
+
+      const unsigned int NBO= 8;
+      const unsigned int NBP= 4;
+      const unsigned int sift_dim= NBO*NBP*NBP;
+      const unsigned int n= 30;
+      const unsigned int candidates_num= 5;
+
+      // The query, then the candidates, which are noisy copies of parts of it
+      // (the third is empty)
+      std::vector<unsigned char> descr;
+      std::vector<double> frames;
+      makeFixture(n, candidates_num*n, NBO, NBP, 7, descr, frames);
+      SiftMatchImage<unsigned char> query(&descr[0], &frames[0], n);
+      std::vector< SiftMatchImage<unsigned char> > candidates;
+      for (unsigned int c=0; c<candidates_num; ++c) {
+          unsigned int i= (c+1)*n;
+          candidates.push_back(SiftMatchImage<unsigned char>(&descr[i*sift_dim], &frames[4*i],
+                                                             c==2 ? 0 : n-3*c));
+      }
+
+      for (unsigned int threads=1; threads<=4; threads+=3) {
+          SiftMatchParams params;
+          params.NBO= NBO;
+          params.NBP= NBP;
+          params.threadsNum= threads;
+          params.pruneWithCellsBounds= threads>1;
+          params.neighborsK= 2;
+          SiftMatchBatchResult batch;
+          assert(siftRatioMatchBatch(query, candidates, params, batch));
+          assert(batch.results.size()==candidates_num);
+          for (unsigned int c=0; c<candidates_num; ++c) {
+              SiftMatchResult result;
+              assert(siftRatioMatch(query.descr, query.frames, query.num,
+                                    candidates[c].descr, candidates[c].frames, candidates[c].num,
+                                    params, result));
+              const SiftMatchResult& r= batch.results[c];
+              assert(r.inds==result.inds && r.ratios==result.ratios);
+              assert(r.pruneStats.pairs==result.pruneStats.pairs);
+              assert(r.neighbors.inds==result.neighbors.inds && r.neighbors.dists==result.neighbors.dists);
+              assert(c==2 || r.matchesNum()>0);
+          }
+          const SiftMatchBatchTimings& tm= batch.timings;
+          assert(tm.querySeconds>=0 && tm.prepareSeconds>=0 && tm.matchSeconds>=0);
+          assert(tm.wallSeconds>=tm.querySeconds);
+          params.maxOverlap= -1;
+          assert(!siftRatioMatchBatch(query, candidates, params, batch) && !batch.error.empty());
+      }
+
+} // testSiftRatioMatchBatch
 
 int main() {
 
@@ -61,5 +1084,53 @@ int main() {
       
       assert(sd(sift1, sift2,stopThresholdsArr)==4242);
       
+      // The cells masses differ by 17,5,3,11 thus the lower bound
+      // of prunedDist is 2*(17+5+3+11)=72
+      double cellsMass1[4], cellsMass2[4];
+      for (int c=0; c<CELLS_NUM; ++c) {
+          cellsMass1[c]= SiftDist<double>::cellMass(sift1+c*NBO, NBO);
+          cellsMass2[c]= SiftDist<double>::cellMass(sift2+c*NBO, NBO);
+      }
+      assert(sd.cellsBound(cellsMass1, cellsMass2)==72.0);
+
+      unsigned int cellsOrder[]= {3,2,1,0};
+      double farStopThresholdsArr[]=
+          {1000,1000,1000,1000};
+      assert(sd.prunedDist(sift1, sift2, farStopThresholdsArr, cellsMass1, cellsMass2, NULL)==110.0);
+      assert(sd.prunedDist(sift1, sift2, farStopThresholdsArr, cellsMass1, cellsMass2, cellsOrder)==110.0);
+      
+      double boundStopThresholdsArr[]=
+          {1000,1000,1000,72};
+      assert(sd.prunedDist(sift1, sift2, boundStopThresholdsArr, cellsMass1, cellsMass2, NULL)==72);
+      assert(sd.pruneStats().pairs==3);
+      assert(sd.pruneStats().boundStops==1);
+      assert(sd.pruneStats().stopsAtCell[0]==1);
+      assert(sd.pruneStats().cellsComputed==2*4);
+
+      unsigned char sift1_u8[32], sift2_u8[32];
+      unsigned int stopThresholdsArr_u8[]= {39,39,39,4242};
+      for (int i=0; i<NBO*CELLS_NUM; ++i) {
+          sift1_u8[i]= static_cast<unsigned char>(sift1[i]);
+          sift2_u8[i]= static_cast<unsigned char>(sift2[i]);
+      }
+      SiftDist<unsigned char> sd_u8(NBO, CELLS_NUM);
+      assert(sd_u8(sift1_u8, sift2_u8)==110u);
+      assert(sd_u8(sift1_u8, sift2_u8, stopThresholdsArr_u8)==4242u);
+
+      testSiftDistBatch();
+      testSiftDistMulti();
+      testDispatchSiftDist();
+      testQuantized();
+      testFramesGrid();
+      testSiftRatioMatcher();
+      testThreads();
+      testReverseScanCache();
+      testSiftDistVpTree();
+      testCounters();
+      testSiftDescrPrep();
+      testSiftEmdModDist();
+      testSiftRatioMatchBatch();
+      testSiftDescrStore();
+      
       return 0;
 }
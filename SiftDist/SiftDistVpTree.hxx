@@ -0,0 +1,251 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_DIST_VP_TREE__HXX
+#define _OFIRPELE_SIFT_DIST_VP_TREE__HXX
+
+#include "MyMinMax.hxx"
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+
+/// A vantage point tree over a set of SIFT-like descriptors, for finding
+/// nearest neighbors without computing the distance to all of them.
+/// SiftDist is a metric (see the ECCV 2008 paper), thus a subtree whose
+/// descriptors are all at distance >= tau from the query (by the triangle
+/// inequality) can be skipped, where tau is the k'th distance found so far.
+/// Distances to descriptors are computed with stop thresholds of tau,
+/// so far descriptors usually stop after a few cells.
+///
+/// The descriptors are not copied, descr should live as long as the tree.
+///@param DISTANCE_T SiftDist or any other metric functor with
+/// operator()(sift1, sift2, stopThresholdsArr) and the same stop semantics.
+template<typename DISTANCE_T>
+class SiftDistVpTree {
+
+public:
+
+    /// @param descr sift_num descriptors of NBO*CELLS_NUM entries each (as in SiftRatioMatchImpl).
+    /// @param leaf_size maximum number of descriptors in a leaf.
+    /// @param seed for choosing the vantage points.
+    SiftDistVpTree(const double* descr, unsigned int sift_num,
+                   unsigned int NBO, unsigned int CELLS_NUM,
+                   const DISTANCE_T& sd,
+                   unsigned int leaf_size= 8,
+                   unsigned int seed= 1)
+
+        : _descr(descr), _sift_num(sift_num), _sift_dim(NBO*CELLS_NUM), _CELLS_NUM(CELLS_NUM),
+          _sd(sd), _leaf_size(myMax(1u, leaf_size)), _seed(seed),
+          _points(sift_num), _stopThresholdsArr(CELLS_NUM), _dists_num(0) {
+
+        for (unsigned int i=0; i<sift_num; ++i) _points[i]= i;
+        std::vector< std::pair<double,unsigned int> > dists_scratch(sift_num);
+        _root= build(0, sift_num, dists_scratch);
+
+    } // end Ctor
+
+    unsigned int size() const { return _sift_num; }
+
+    /// Finds the k nearest descriptors to query.
+    /// Fills inds (0-based) and dists with n=min(k,size()) of them, sorted by
+    /// increasing distance, and returns n. Ties are broken arbitrarily.
+    /// @param eps if >0, subtrees are skipped if their lower bound times (1+eps)
+    /// is >= tau, i.e. the distances found are at most (1+eps) times the exact ones.
+    /// @param max_dists_num if >0, the search stops after this many distances
+    /// are computed. With eps, this is the recall/speed knob.
+    unsigned int knn(const double* query, unsigned int k,
+                     unsigned int* inds, double* dists,
+                     double eps= 0.0, unsigned int max_dists_num= 0) {
+
+        _heap.clear();
+        _k= myMin(k, _sift_num);
+        _eps_factor= 1.0/(1.0+eps);
+        _max_dists_num= max_dists_num;
+        _dists_num= 0;
+        if (_k==0) return 0;
+
+        search(_root, query);
+
+        std::sort_heap(_heap.begin(), _heap.end());
+        unsigned int n= static_cast<unsigned int>(_heap.size());
+        for (unsigned int i=0; i<n; ++i) {
+            dists[i]= _heap[i].first;
+            inds[i]= _heap[i].second;
+        }
+        return n;
+
+    } // knn
+
+    /// Number of distances computed in the last knn
+    unsigned int lastDistsNum() const { return _dists_num; }
+
+private:
+
+    static const unsigned int NONE= 0xFFFFFFFFu;
+
+    // A leaf if _vp==NONE, then its descriptors are _points[_begin.._end-1]
+    struct Node {
+        unsigned int _vp;
+        // Descriptors in _inside are at distance <= _mu from _vp,
+        // descriptors in _outside are at distance >= _mu
+        double _mu;
+        unsigned int _inside, _outside;
+        unsigned int _begin, _end;
+    };
+
+    const double* sift(unsigned int i) const { return _descr + static_cast<size_t>(i)*_sift_dim; }
+
+    unsigned int nextRandom(unsigned int n) {
+        _seed= _seed*1103515245u + 12345u;
+        return (_seed>>8)%n;
+    }
+
+    unsigned int build(unsigned int begin, unsigned int end,
+                       std::vector< std::pair<double,unsigned int> >& dists_scratch) {
+
+        if (begin==end) return NONE;
+
+        Node node;
+        node._mu= 0.0;
+        node._inside= node._outside= NONE;
+        node._begin= begin;
+        node._end= end;
+
+        if (end-begin<=_leaf_size) {
+            node._vp= NONE;
+            _nodes.push_back(node);
+            return static_cast<unsigned int>(_nodes.size()-1);
+        }
+
+        std::swap(_points[begin], _points[begin+nextRandom(end-begin)]);
+        node._vp= _points[begin];
+
+        // Median split of the rest by their distance to the vantage point
+        unsigned int n= end-begin-1;
+        for (unsigned int i=0; i<n; ++i) {
+            unsigned int p= _points[begin+1+i];
+            dists_scratch[i]= std::make_pair(_sd(sift(p), sift(node._vp)), p);
+        }
+        unsigned int mid= n/2;
+        std::nth_element(dists_scratch.begin(), dists_scratch.begin()+mid, dists_scratch.begin()+n);
+        node._mu= dists_scratch[mid].first;
+        for (unsigned int i=0; i<n; ++i) _points[begin+1+i]= dists_scratch[i].second;
+
+        unsigned int node_ind= static_cast<unsigned int>(_nodes.size());
+        _nodes.push_back(node);
+        // [begin+1, begin+1+mid] are <= mu, the rest are >= mu
+        unsigned int inside= build(begin+1, begin+2+mid, dists_scratch);
+        unsigned int outside= build(begin+2+mid, end, dists_scratch);
+        _nodes[node_ind]._inside= inside;
+        _nodes[node_ind]._outside= outside;
+        return node_ind;
+
+    } // build
+
+    double tau() const {
+        return _heap.size()<_k ? std::numeric_limits<double>::infinity() : _heap.front().first;
+    }
+
+    bool exhausted() const { return _max_dists_num>0 && _dists_num>=_max_dists_num; }
+
+    /// The distance, or a value >=stop_threshold (but <= the distance)
+    /// if the distance is >=stop_threshold.
+    double dist(const double* query, unsigned int p, double stop_threshold) {
+        ++_dists_num;
+        if (stop_threshold==std::numeric_limits<double>::infinity()) {
+            return _sd(sift(p), query);
+        }
+        for (unsigned int c=0; c<_CELLS_NUM; ++c) _stopThresholdsArr[c]= stop_threshold;
+        return _sd(sift(p), query, &_stopThresholdsArr[0]);
+    }
+
+    void consider(unsigned int p, double d) {
+        if (_heap.size()<_k) {
+            _heap.push_back(std::make_pair(d, p));
+            std::push_heap(_heap.begin(), _heap.end());
+        } else if (d<_heap.front().first) {
+            std::pop_heap(_heap.begin(), _heap.end());
+            _heap.back()= std::make_pair(d, p);
+            std::push_heap(_heap.begin(), _heap.end());
+        }
+    }
+
+    void search(unsigned int node_ind, const double* query) {
+
+        if (node_ind==NONE||exhausted()) return;
+        const Node& node= _nodes[node_ind];
+
+        if (node._vp==NONE) {
+            for (unsigned int i=node._begin; i<node._end && !exhausted(); ++i) {
+                unsigned int p= _points[i];
+                consider(p, dist(query, p, tau()));
+            }
+            return;
+        }
+
+        // Only needed exactly if it might be in the knn or
+        // the inside subtree might have them
+        double d= dist(query, node._vp, node._mu+tau());
+        consider(node._vp, d);
+
+        if (d<node._mu) {
+            search(node._inside, query);
+            if ((node._mu-d)<tau()*_eps_factor) search(node._outside, query);
+        } else {
+            search(node._outside, query);
+            if ((d-node._mu)<tau()*_eps_factor) search(node._inside, query);
+        }
+
+    } // search
+
+    const double* _descr;
+    unsigned int _sift_num, _sift_dim, _CELLS_NUM;
+    DISTANCE_T _sd;
+    unsigned int _leaf_size;
+    unsigned int _seed;
+    // A permutation of the descriptors, each node's are consecutive
+    std::vector<unsigned int> _points;
+    std::vector<Node> _nodes;
+    unsigned int _root;
+
+    // Search state
+    std::vector<double> _stopThresholdsArr;
+    // Max heap of the k best (distance,index) so far
+    std::vector< std::pair<double,unsigned int> > _heap;
+    unsigned int _k;
+    double _eps_factor;
+    unsigned int _max_dists_num;
+    unsigned int _dists_num;
+
+}; // end class SiftDistVpTree
+
+#endif
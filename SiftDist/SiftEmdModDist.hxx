@@ -0,0 +1,175 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_EMD_MOD_DIST__HXX
+#define _OFIRPELE_SIFT_EMD_MOD_DIST__HXX
+
+#include "SiftDist.hxx"
+#include "EMD_MOD.hpp"
+#include <cassert>
+#include <vector>
+
+
+/// The sum over the cells of SIFT-like descriptors of EMD_MOD (EMD with
+/// modulo L1 as the ground distance, see EMD_MOD.hpp) with the operator()
+/// and prunedDist of SiftDist, so that SiftRatioMatchImpl and
+/// SiftRatioMatcher can match with it (SiftMatchParams::EmdModType) and
+/// the two distances can be compared at the same throughput.
+/// EMD_MOD needs cells of equal masses, so the heavier cell of each pair
+/// is scaled down to the mass of the lighter one and each unit of the mass
+/// difference costs 2, as a unit that SiftDist does not match. A cell is
+/// thus at least cellBound (2*|mass1-mass2|) and the cells bounds of
+/// SiftDist (prunedDist, the cascade of SiftRatioMatcher) hold as they are.
+/// Only double descriptors. Each instance has its own EmdModWorkspace, so
+/// it does not allocate after the construction, and is not thread safe
+/// (SiftRatioMatchImpl copies it for each thread).
+class SiftEmdModDist {
+
+public:
+
+    typedef double DIST_T;
+
+    /// NBO and CELLS_NUM are as in SiftDist.
+    /// @param worstCaseLinearSelection see EmdModWorkspace.
+    SiftEmdModDist(unsigned int NBO,
+                   unsigned int CELLS_NUM,
+                   bool worstCaseLinearSelection= false)
+
+        : _NBO(NBO),
+          _CELLS_NUM(CELLS_NUM),
+          _pruneStats(CELLS_NUM),
+          _counters(CELLS_NUM),
+          _ws(worstCaseLinearSelection, NBO),
+          _scaled(NBO)
+        {
+            assert(NBO>1);
+            assert(CELLS_NUM>0);
+        }
+
+    /// As SiftDist::operator(): if the distance after cell i is at least
+    /// stopThresholdsArr[i], stopThresholdsArr[CELLS_NUM-1] is returned.
+    DIST_T operator()(const double* sift1,
+                      const double* sift2,
+                      const DIST_T* stopThresholdsArr=NULL) {
+
+        DIST_T dist= 0.0;
+        SIFT_DIST_COUNT(++_counters.pairs);
+        for (unsigned int i=0; i<_CELLS_NUM; ++i, sift1+=_NBO, sift2+=_NBO) {
+            dist+= cellDist(sift1, sift2,
+                            SiftDist<double>::cellMass(sift1, _NBO), SiftDist<double>::cellMass(sift2, _NBO));
+            if (stopThresholdsArr && i<_CELLS_NUM-1 && dist>=stopThresholdsArr[i]) {
+                SIFT_DIST_COUNT(++_counters.stopsAtCell[i+1]);
+                return stopThresholdsArr[_CELLS_NUM-1];
+            }
+        } // i
+        return dist;
+
+    } // operator()
+
+    /// As SiftDist::prunedDist, with the same cells bound.
+    DIST_T prunedDist(const double* sift1,
+                      const double* sift2,
+                      const DIST_T* stopThresholdsArr,
+                      const DIST_T* cellsMass1,
+                      const DIST_T* cellsMass2,
+                      const unsigned int* cellsOrder) {
+
+        assert(stopThresholdsArr!=NULL);
+        const DIST_T stopThreshold= stopThresholdsArr[_CELLS_NUM-1];
+        ++_pruneStats.pairs;
+        SIFT_DIST_COUNT(++_counters.pairs);
+
+        DIST_T bound= cellsBound(cellsMass1, cellsMass2);
+
+        DIST_T dist= 0.0;
+        for (unsigned int i=0; i<_CELLS_NUM; ++i) {
+            if (dist+bound>=stopThreshold) {
+                ++_pruneStats.boundStops;
+                ++_pruneStats.stopsAtCell[i];
+                SIFT_DIST_COUNT(++_counters.stopsAtCell[i]);
+                _pruneStats.cellsComputed+= i;
+                return stopThreshold;
+            }
+            unsigned int c= cellsOrder!=NULL ? cellsOrder[i] : i;
+            dist+= cellDist(sift1+c*_NBO, sift2+c*_NBO, cellsMass1[c], cellsMass2[c]);
+            bound-= SiftDist<double>::cellBound(cellsMass1[c], cellsMass2[c]);
+            if (i<_CELLS_NUM-1 && dist>=stopThresholdsArr[i]) {
+                ++_pruneStats.thresholdStops;
+                ++_pruneStats.stopsAtCell[i+1];
+                SIFT_DIST_COUNT(++_counters.stopsAtCell[i+1]);
+                _pruneStats.cellsComputed+= i+1;
+                return stopThreshold;
+            }
+        } // i
+        _pruneStats.cellsComputed+= _CELLS_NUM;
+
+        return dist;
+
+    } // prunedDist
+
+    const SiftDistPruneStats& pruneStats() const { return _pruneStats; }
+    void resetPruneStats() { _pruneStats= SiftDistPruneStats(_CELLS_NUM); }
+
+    /// Only pairs, cells and stopsAtCell are counted (with SIFT_DIST_COUNTERS)
+    const SiftDistCounters& counters() const { return _counters; }
+    void resetCounters() { _counters= SiftDistCounters(_CELLS_NUM); }
+
+    DIST_T cellsBound(const DIST_T* cellsMass1, const DIST_T* cellsMass2) const {
+        DIST_T bound= 0.0;
+        for (unsigned int c=0; c<_CELLS_NUM; ++c) {
+            bound+= SiftDist<double>::cellBound(cellsMass1[c], cellsMass2[c]);
+        }
+        return bound;
+    }
+
+private:
+
+    // EMD_MOD of the cells, the heavier scaled to the mass of the lighter,
+    // plus the cost of the mass difference
+    DIST_T cellDist(const double* Q, const double* P, double massQ, double massP) {
+        SIFT_DIST_COUNT(++_counters.cells);
+        if (massQ==massP) return EMD_MOD<false>(Q, P, _NBO, _ws, NULL);
+        const bool QHeavier= massQ>massP;
+        const double* heavy= QHeavier ? Q : P;
+        const double factor= QHeavier ? massP/massQ : massQ/massP;
+        for (unsigned int k=0; k<_NBO; ++k) _scaled[k]= heavy[k]*factor;
+        const double emd= QHeavier ? EMD_MOD<false>(&_scaled[0], P, _NBO, _ws, NULL)
+                                   : EMD_MOD<false>(Q, &_scaled[0], _NBO, _ws, NULL);
+        return emd + SiftDist<double>::cellBound(massQ, massP);
+    } // cellDist
+
+    unsigned int _NBO;
+    unsigned int _CELLS_NUM;
+    SiftDistPruneStats _pruneStats;
+    SiftDistCounters _counters;
+    EmdModWorkspace _ws;
+    std::vector<double> _scaled;
+
+}; // end class SiftEmdModDist
+
+#endif
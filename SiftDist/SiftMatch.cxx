@@ -0,0 +1,540 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#include "SiftMatch.hxx"
+#include "SiftDistDispatch.hxx"
+#include "SiftEmdModDist.hxx"
+#include "SiftDistBatch.hxx"
+#include "SiftRatioMatchImpl.hxx"
+#include "SiftRatioMatchVpTreeImpl.hxx"
+#include "WorkStealingPool.hxx"
+#include <deque>
+#include <chrono>
+
+// The hot loops of the library are instantiated here, so that the flags this
+// file is compiled with (-O3, -march, LTO) apply to them.
+
+
+const char* SiftMatchParams::check() const {
+    if (NBO<2) return "NBO should be at least 2";
+    if (NBP<1) return "NBP should be at least 1";
+    if (distRatio!=-1 && distRatio<1) return "distRatio should be -1 or at least 1";
+    if (magnif<=0) return "magnif should be positive";
+    if (maxOverlap<0) return "maxOverlap should be non negative";
+    if (distType!=SiftDistType && distType!=EmdModType) return "distType should be SiftDistType or EmdModType";
+    if (!(neighborsRadius>=0)) return "neighborsRadius should be non negative";
+    if (!(vpTreeEps>=0)) return "vpTreeEps should be non negative";
+    if (useVpTree && findNeighbors()) return "the neighbors can not be found with useVpTree";
+    if (framesColSize<1 ||
+        framesXInd<0 || framesXInd>=framesColSize ||
+        framesYInd<0 || framesYInd>=framesColSize ||
+        framesScaleInd<0 || framesScaleInd>=framesColSize) {
+        return "the frames indices should be smaller than framesColSize";
+    }
+    return NULL;
+} // check
+
+
+unsigned int SiftMatchResult::matchesNum() const {
+    unsigned int n= 0;
+    for (size_t i=0; i<inds.size(); ++i) if (inds[i]>=0) ++n;
+    return n;
+} // matchesNum
+
+
+namespace {
+
+// Calls f(sd) with the distance of params.distType.
+// SiftEmdModDist is only for double, see check().
+template<typename DESCR_T>
+struct DispatchDist {
+    static const char* check(const SiftMatchParams& params) {
+        if (params.distType==SiftMatchParams::EmdModType) return "distType EmdModType is only for double descriptors";
+        if (params.useVpTree) return "useVpTree is only for double descriptors";
+        return NULL;
+    }
+    template<typename FUNCTOR>
+    static void run(const SiftMatchParams& params, FUNCTOR& f) {
+        dispatchSiftDist<DESCR_T>(params.NBO, params.NBP*params.NBP, f);
+    }
+};
+
+template<>
+struct DispatchDist<double> {
+    static const char* check(const SiftMatchParams& params) {
+        if (params.useVpTree && params.distType!=SiftMatchParams::SiftDistType) return "useVpTree is only for distType SiftDistType";
+        return NULL;
+    }
+    template<typename FUNCTOR>
+    static void run(const SiftMatchParams& params, FUNCTOR& f) {
+        if (params.distType==SiftMatchParams::EmdModType) {
+            SiftEmdModDist sd(params.NBO, params.NBP*params.NBP);
+            f(sd);
+            return;
+        }
+        dispatchSiftDist<double>(params.NBO, params.NBP*params.NBP, f);
+    }
+};
+
+// Runs SiftRatioMatchImpl with the distance chosen by DispatchDist
+template<typename DESCR_T>
+struct RunSiftRatioMatch {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        SiftRatioMatchImpl<DISTANCE_T, DESCR_T>
+            (descr1, frames1, sift_num1,
+             descr2, frames2, sift_num2,
+             p.distRatio,
+             p.stopThresholdsFactorGamma,
+             p.NBO, p.NBP, p.magnif,
+             p.maxOverlap,
+             sd,
+             p.framesColSize, p.framesXInd, p.framesYInd, p.framesScaleInd,
+             inds, ratios,
+             p.threadsNum, p.reverseScanCacheBytes,
+             p.pruneWithCellsBounds, p.orderCellsByMass,
+             prune_stats,
+             p.cascadeWithCellsBounds,
+             neighbors,
+             counters);
+    }
+
+    const DESCR_T* descr1;
+    const double* frames1;
+    unsigned int sift_num1;
+    const DESCR_T* descr2;
+    const double* frames2;
+    unsigned int sift_num2;
+    SiftMatchParams p;
+    double* inds;
+    double* ratios;
+    SiftDistPruneStats* prune_stats;
+    SiftNeighbors* neighbors;
+    SiftRatioMatchCounters* counters;
+};
+
+// Runs SiftRatioMatchVpTreeImpl with the SiftDist chosen by dispatchSiftDist
+struct RunSiftRatioMatchVpTree {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        SiftRatioMatchVpTreeImpl<DISTANCE_T>
+            (descr1, frames1, sift_num1,
+             descr2, frames2, sift_num2,
+             p.distRatio,
+             p.NBO, p.NBP, p.magnif,
+             p.maxOverlap,
+             sd,
+             p.framesColSize, p.framesXInd, p.framesYInd, p.framesScaleInd,
+             inds, ratios,
+             p.vpTreeNeighborsNum, p.vpTreeEps, p.vpTreeMaxDistsNum);
+    }
+
+    const double* descr1;
+    const double* frames1;
+    unsigned int sift_num1;
+    const double* descr2;
+    const double* frames2;
+    unsigned int sift_num2;
+    SiftMatchParams p;
+    double* inds;
+    double* ratios;
+};
+
+// siftRatioMatch with useVpTree, which DispatchDist::check() allows only
+// for double descriptors
+template<typename DESCR_T>
+void matchWithVpTree(const DESCR_T*, const double*, unsigned int,
+                     const DESCR_T*, const double*, unsigned int,
+                     const SiftMatchParams&, double*, double*) {
+    assert(false);
+}
+
+void matchWithVpTree(const double* descr1, const double* frames1, unsigned int sift_num1,
+                     const double* descr2, const double* frames2, unsigned int sift_num2,
+                     const SiftMatchParams& params, double* inds, double* ratios) {
+    RunSiftRatioMatchVpTree run;
+    run.descr1= descr1;
+    run.frames1= frames1;
+    run.sift_num1= sift_num1;
+    run.descr2= descr2;
+    run.frames2= frames2;
+    run.sift_num2= sift_num2;
+    run.p= params;
+    run.inds= inds;
+    run.ratios= ratios;
+    dispatchSiftDist<double>(params.NBO, params.NBP*params.NBP, run);
+}
+
+// Runs a SiftRatioMatcher of two prepared sets with the distance chosen by DispatchDist
+template<typename DESCR_T>
+struct RunSiftRatioMatcher {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        unsigned int blocks_num= SiftRatioMatcher<DISTANCE_T, DESCR_T>::blocksNum(p.NBO*p.NBP*p.NBP,
+                                                                                  set1->size(), set2->size());
+        SiftRatioMatcher<DISTANCE_T, DESCR_T>
+            matcher(p.distRatio,
+                    p.stopThresholdsFactorGamma,
+                    p.NBO, p.NBP,
+                    p.maxOverlap,
+                    sd,
+                    p.framesColSize, p.framesXInd, p.framesYInd,
+                    myMin(WorkStealingPool::resolveThreadsNum(p.threadsNum), myMax(1u, blocks_num)),
+                    p.reverseScanCacheBytes,
+                    p.pruneWithCellsBounds, p.orderCellsByMass,
+                    p.cascadeWithCellsBounds);
+        matcher.match(*set1, *set2, inds, ratios, prune_stats, neighbors);
+        counters->add(matcher.counters());
+    }
+
+    const SiftDescrSet<DESCR_T>* set1;
+    const SiftDescrSet<DESCR_T>* set2;
+    SiftMatchParams p;
+    double* inds;
+    double* ratios;
+    SiftDistPruneStats* prune_stats;
+    SiftNeighbors* neighbors;
+    SiftRatioMatchCounters* counters;
+};
+
+// Fills dists with the SiftDist chosen by dispatchSiftDist
+struct FillDistsMatrix {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        SiftDistBatch sdb(sift_dim);
+        sdb.computeDistsMatrix(sd,
+                               descr1, sift_num1,
+                               descr2, sift_num2,
+                               stopThresholdsArr,
+                               
+                               dists);
+    }
+
+    unsigned int sift_dim;
+    const double* descr1;
+    unsigned int sift_num1;
+    const double* descr2;
+    unsigned int sift_num2;
+    const double* stopThresholdsArr;
+    double* dists;
+};
+
+// SiftRatioMatcher writes Matlab 1-based indices, 0 for no match
+void setZeroBasedInds(const std::vector<double>& inds, SiftMatchResult& result) {
+    result.inds.resize(inds.size());
+    for (size_t i=0; i<inds.size(); ++i) {
+        result.inds[i]= static_cast<int>(inds[i])-1;
+    }
+}
+
+// The neighbors to find, if any
+SiftNeighbors* neighborsOf(const SiftMatchParams& params, SiftMatchResult& result) {
+    result.neighbors= SiftNeighbors(params.neighborsK, params.neighborsRadius);
+    return params.findNeighbors() ? &result.neighbors : NULL;
+}
+
+// A thread of siftRatioMatchBatch: its matcher, the candidate set it prepares
+// and its timings
+template<typename DISTANCE_T, typename DESCR_T>
+struct BatchThread {
+
+    BatchThread(const SiftMatchParams& p, const DISTANCE_T& sd, unsigned int match_threads_num)
+        : matcher(p.distRatio,
+                  p.stopThresholdsFactorGamma,
+                  p.NBO, p.NBP,
+                  p.maxOverlap,
+                  sd,
+                  p.framesColSize, p.framesXInd, p.framesYInd,
+                  match_threads_num,
+                  p.reverseScanCacheBytes,
+                  p.pruneWithCellsBounds, p.orderCellsByMass,
+                  p.cascadeWithCellsBounds),
+          set(p.NBO, p.NBP, p.magnif, p.framesColSize, p.framesXInd, p.framesYInd, p.framesScaleInd),
+          prepareSeconds(0), matchSeconds(0) {}
+
+    SiftRatioMatcher<DISTANCE_T, DESCR_T> matcher;
+    SiftDescrSet<DESCR_T> set;
+    std::vector<double> inds;
+    double prepareSeconds, matchSeconds;
+};
+
+double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The candidates of siftRatioMatchBatch are the tasks of a WorkStealingPool
+template<typename DISTANCE_T, typename DESCR_T>
+struct BatchTask {
+
+    void operator()(unsigned int thread_ind, unsigned int c) {
+        BatchThread<DISTANCE_T, DESCR_T>& th= (*threads)[thread_ind];
+        const SiftMatchImage<DESCR_T>& image= (*candidates)[c];
+        SiftMatchResult& r= (*results)[c];
+
+        double t0= nowSeconds();
+        th.set.clear();
+        th.set.append(image.descr, image.frames, image.num);
+        double t1= nowSeconds();
+
+        unsigned int num1= query->size();
+        th.inds.assign(num1, 0.0);
+        r.ratios.assign(num1, 0.0);
+        r.pruneStats= SiftDistPruneStats(p->NBP*p->NBP);
+        r.counters= SiftRatioMatchCounters(p->NBP*p->NBP);
+        th.matcher.resetCounters();
+        th.matcher.match(*query, th.set,
+                         num1>0 ? &th.inds[0] : NULL, num1>0 ? &r.ratios[0] : NULL,
+                         &r.pruneStats, neighborsOf(*p, r));
+        r.counters.add(th.matcher.counters());
+        setZeroBasedInds(th.inds, r);
+
+        th.prepareSeconds+= t1-t0;
+        th.matchSeconds+= nowSeconds()-t1;
+    }
+
+    const SiftMatchParams* p;
+    const SiftDescrSet<DESCR_T>* query;
+    const std::vector< SiftMatchImage<DESCR_T> >* candidates;
+    std::deque< BatchThread<DISTANCE_T, DESCR_T> >* threads;
+    std::vector<SiftMatchResult>* results;
+};
+
+// Runs siftRatioMatchBatch with the distance chosen by DispatchDist
+template<typename DESCR_T>
+struct RunSiftRatioMatchBatch {
+
+    template<typename DISTANCE_T>
+    void operator()(DISTANCE_T& sd) {
+        unsigned int threads_num= WorkStealingPool::resolveThreadsNum(p.threadsNum);
+        unsigned int candidates_num= static_cast<unsigned int>(candidates->size());
+        unsigned int batch_threads_num= myMax(1u, myMin(threads_num, candidates_num));
+        // The matchers are not movable, and a deque does not move them
+        std::deque< BatchThread<DISTANCE_T, DESCR_T> > threads;
+        for (unsigned int t=0; t<batch_threads_num; ++t) {
+            threads.emplace_back(p, sd, threads_num/batch_threads_num);
+        }
+        BatchTask<DISTANCE_T, DESCR_T> task= { &p, query, candidates, &threads, &result->results };
+        WorkStealingPool pool(batch_threads_num);
+        pool.run(candidates_num, task);
+        for (unsigned int t=0; t<batch_threads_num; ++t) {
+            result->timings.prepareSeconds+= threads[t].prepareSeconds;
+            result->timings.matchSeconds+= threads[t].matchSeconds;
+        }
+    }
+
+    const SiftDescrSet<DESCR_T>* query;
+    const std::vector< SiftMatchImage<DESCR_T> >* candidates;
+    SiftMatchParams p;
+    SiftMatchBatchResult* result;
+};
+
+} // namespace
+
+
+template<typename DESCR_T>
+bool siftRatioMatch(const DESCR_T* descr1, const double* frames1, unsigned int sift_num1,
+                    const DESCR_T* descr2, const double* frames2, unsigned int sift_num2,
+                    const SiftMatchParams& params,
+                    SiftMatchResult& result) {
+
+    const char* err= params.check();
+    if (err==NULL) err= DispatchDist<DESCR_T>::check(params);
+    if (err!=NULL) {
+        result.error= err;
+        return false;
+    }
+    result.error.clear();
+
+    std::vector<double> inds(sift_num1, 0.0);
+    result.ratios.assign(sift_num1, 0.0);
+    result.pruneStats= SiftDistPruneStats(params.NBP*params.NBP);
+    result.counters= SiftRatioMatchCounters(params.NBP*params.NBP);
+
+    if (params.useVpTree) {
+        result.neighbors= SiftNeighbors();
+        matchWithVpTree(descr1, frames1, sift_num1, descr2, frames2, sift_num2, params,
+                        sift_num1>0 ? &inds[0] : NULL, sift_num1>0 ? &result.ratios[0] : NULL);
+        setZeroBasedInds(inds, result);
+        return true;
+    }
+
+    RunSiftRatioMatch<DESCR_T> run;
+    run.descr1= descr1;
+    run.frames1= frames1;
+    run.sift_num1= sift_num1;
+    run.descr2= descr2;
+    run.frames2= frames2;
+    run.sift_num2= sift_num2;
+    run.p= params;
+    run.inds= sift_num1>0 ? &inds[0] : NULL;
+    run.ratios= sift_num1>0 ? &result.ratios[0] : NULL;
+    run.prune_stats= &result.pruneStats;
+    run.counters= &result.counters;
+    run.neighbors= neighborsOf(params, result);
+    DispatchDist<DESCR_T>::run(params, run);
+
+    setZeroBasedInds(inds, result);
+    return true;
+
+} // siftRatioMatch
+
+template bool siftRatioMatch<double>(const double*, const double*, unsigned int,
+                                     const double*, const double*, unsigned int,
+                                     const SiftMatchParams&, SiftMatchResult&);
+template bool siftRatioMatch<unsigned char>(const unsigned char*, const double*, unsigned int,
+                                            const unsigned char*, const double*, unsigned int,
+                                            const SiftMatchParams&, SiftMatchResult&);
+template bool siftRatioMatch<unsigned short>(const unsigned short*, const double*, unsigned int,
+                                             const unsigned short*, const double*, unsigned int,
+                                             const SiftMatchParams&, SiftMatchResult&);
+
+
+template<typename DESCR_T>
+bool siftRatioMatch(const SiftDescrSet<DESCR_T>& set1, const SiftDescrSet<DESCR_T>& set2,
+                    const SiftMatchParams& params,
+                    SiftMatchResult& result) {
+
+    const char* err= params.check();
+    if (err==NULL) err= DispatchDist<DESCR_T>::check(params);
+    if (err==NULL) {
+        for (int s=0; s<2; ++s) {
+            const SiftDescrSet<DESCR_T>& set= s==0 ? set1 : set2;
+            if (set.NBO()!=params.NBO || set.NBP()!=params.NBP || set.Magnif()!=params.magnif ||
+                set.FRAMES_COL_SIZE()!=params.framesColSize || set.FRAMES_X_IND()!=params.framesXInd ||
+                set.FRAMES_Y_IND()!=params.framesYInd || set.FRAMES_SCALE_IND()!=params.framesScaleInd) {
+                err= "the sets should be constructed with the NBO, NBP, magnif and frames layout of params";
+            }
+        }
+    }
+    if (err!=NULL) {
+        result.error= err;
+        return false;
+    }
+    // The trees are built over the descriptors of the sets as they are
+    if (params.useVpTree) {
+        return siftRatioMatch(set1.descr(), set1.frames(), set1.size(),
+                              set2.descr(), set2.frames(), set2.size(),
+                              params, result);
+    }
+    result.error.clear();
+
+    std::vector<double> inds(set1.size(), 0.0);
+    result.ratios.assign(set1.size(), 0.0);
+    result.pruneStats= SiftDistPruneStats(params.NBP*params.NBP);
+    result.counters= SiftRatioMatchCounters(params.NBP*params.NBP);
+
+    RunSiftRatioMatcher<DESCR_T> run;
+    run.set1= &set1;
+    run.set2= &set2;
+    run.p= params;
+    run.inds= set1.size()>0 ? &inds[0] : NULL;
+    run.ratios= set1.size()>0 ? &result.ratios[0] : NULL;
+    run.prune_stats= &result.pruneStats;
+    run.counters= &result.counters;
+    run.neighbors= neighborsOf(params, result);
+    DispatchDist<DESCR_T>::run(params, run);
+
+    setZeroBasedInds(inds, result);
+    return true;
+
+} // siftRatioMatch
+
+template bool siftRatioMatch<double>(const SiftDescrSet<double>&, const SiftDescrSet<double>&,
+                                     const SiftMatchParams&, SiftMatchResult&);
+template bool siftRatioMatch<unsigned char>(const SiftDescrSet<unsigned char>&, const SiftDescrSet<unsigned char>&,
+                                            const SiftMatchParams&, SiftMatchResult&);
+template bool siftRatioMatch<unsigned short>(const SiftDescrSet<unsigned short>&, const SiftDescrSet<unsigned short>&,
+                                             const SiftMatchParams&, SiftMatchResult&);
+
+
+template<typename DESCR_T>
+bool siftRatioMatchBatch(const SiftMatchImage<DESCR_T>& query,
+                         const std::vector< SiftMatchImage<DESCR_T> >& candidates,
+                         const SiftMatchParams& params,
+                         SiftMatchBatchResult& result) {
+
+    const char* err= params.check();
+    if (err==NULL) err= DispatchDist<DESCR_T>::check(params);
+    if (err==NULL && params.useVpTree) err= "useVpTree is not supported by siftRatioMatchBatch";
+    if (err!=NULL) {
+        result.error= err;
+        return false;
+    }
+    result.error.clear();
+    result.results.assign(candidates.size(), SiftMatchResult());
+    result.timings= SiftMatchBatchTimings();
+
+    double t0= nowSeconds();
+    SiftDescrSet<DESCR_T> query_set(params.NBO, params.NBP, params.magnif,
+                                    params.framesColSize, params.framesXInd, params.framesYInd,
+                                    params.framesScaleInd);
+    query_set.append(query.descr, query.frames, query.num);
+    result.timings.querySeconds= nowSeconds()-t0;
+
+    RunSiftRatioMatchBatch<DESCR_T> run;
+    run.query= &query_set;
+    run.candidates= &candidates;
+    run.p= params;
+    run.result= &result;
+    DispatchDist<DESCR_T>::run(params, run);
+
+    result.timings.wallSeconds= nowSeconds()-t0;
+    return true;
+
+} // siftRatioMatchBatch
+
+template bool siftRatioMatchBatch<double>(const SiftMatchImage<double>&,
+                                          const std::vector< SiftMatchImage<double> >&,
+                                          const SiftMatchParams&, SiftMatchBatchResult&);
+template bool siftRatioMatchBatch<unsigned char>(const SiftMatchImage<unsigned char>&,
+                                                 const std::vector< SiftMatchImage<unsigned char> >&,
+                                                 const SiftMatchParams&, SiftMatchBatchResult&);
+template bool siftRatioMatchBatch<unsigned short>(const SiftMatchImage<unsigned short>&,
+                                                  const std::vector< SiftMatchImage<unsigned short> >&,
+                                                  const SiftMatchParams&, SiftMatchBatchResult&);
+
+
+void siftDistMatrix(const double* descr1, unsigned int sift_num1,
+                    const double* descr2, unsigned int sift_num2,
+                    unsigned int NBO, unsigned int CELLS_NUM,
+                    const double* stopThresholdsArr,
+                    double* dists) {
+    FillDistsMatrix fill;
+    fill.sift_dim= NBO*CELLS_NUM;
+    fill.descr1= descr1;
+    fill.sift_num1= sift_num1;
+    fill.descr2= descr2;
+    fill.sift_num2= sift_num2;
+    fill.stopThresholdsArr= stopThresholdsArr;
+    fill.dists= dists;
+    dispatchSiftDist<double>(NBO, CELLS_NUM, fill);
+} // siftDistMatrix
@@ -0,0 +1,212 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_MATCH__HXX
+#define _OFIRPELE_SIFT_MATCH__HXX
+
+#include "SiftDist.hxx"
+#include "SiftDescrSet.hxx"
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The C++ interface of the compiled library (SiftMatch.cxx): SIFT ratio
+// matching and SiftDist matrices with typed results, without Matlab.
+// The matches are the ones of SiftRatioMatch.m, with 0-based indices.
+
+
+/// Parameters of siftRatioMatch. The defaults are the ones of SiftRatioMatch.m.
+/// See SiftRatioMatch.m and SiftRatioMatchImpl.hxx for their meaning.
+struct SiftMatchParams {
+
+    /// The distance of the matching: SiftDist, or the sum of EMD_MOD over
+    /// the cells (SiftEmdModDist, only for double descriptors).
+    enum DistType { SiftDistType, EmdModType };
+
+    SiftMatchParams()
+        : distType(SiftDistType), distRatio(1.25), stopThresholdsFactorGamma(0.7),
+          NBO(16), NBP(4), magnif(3.0), maxOverlap(0.5),
+          framesColSize(4), framesXInd(0), framesYInd(1), framesScaleInd(2),
+          threadsNum(1), reverseScanCacheBytes(4*1024*1024),
+          pruneWithCellsBounds(false), orderCellsByMass(false), cascadeWithCellsBounds(false),
+          neighborsK(0), neighborsRadius(HUGE_VAL),
+          useVpTree(false), vpTreeNeighborsNum(8), vpTreeEps(0.0), vpTreeMaxDistsNum(0) {}
+
+    DistType distType;
+    double distRatio;
+    double stopThresholdsFactorGamma;
+    unsigned int NBO;
+    unsigned int NBP;
+    double magnif;
+    double maxOverlap;
+    /// The frames are framesColSize doubles per descriptor, with the x, y and
+    /// scale at these indices.
+    int framesColSize, framesXInd, framesYInd, framesScaleInd;
+    /// 0 means the number of cores
+    unsigned int threadsNum;
+    size_t reverseScanCacheBytes;
+    bool pruneWithCellsBounds;
+    bool orderCellsByMass;
+    bool cascadeWithCellsBounds;
+    /// If either is set, SiftMatchResult::neighbors gets the neighborsK nearest
+    /// descr2 descriptors (all if 0) of each descr1 descriptor, whose distance
+    /// is smaller than neighborsRadius (HUGE_VAL for any), see SiftNeighbors.
+    unsigned int neighborsK;
+    double neighborsRadius;
+
+    /// If set, the nearest neighbors are found with a SiftDistVpTree over each
+    /// image instead of scanning all the descriptors (SiftRatioMatchVpTreeImpl.hxx).
+    /// Only for double descriptors with distType SiftDistType, and not by
+    /// siftRatioMatchBatch. The second nearest is searched among the
+    /// vpTreeNeighborsNum nearest, vpTreeEps and vpTreeMaxDistsNum make the
+    /// search approximate (see SiftDistVpTree::knn). stopThresholdsFactorGamma,
+    /// threadsNum, the reverse scan cache, the pruning and the cascade are not
+    /// used, and the neighbors can not be found.
+    bool useVpTree;
+    unsigned int vpTreeNeighborsNum;
+    double vpTreeEps;
+    unsigned int vpTreeMaxDistsNum;
+
+    bool findNeighbors() const { return neighborsK>0 || neighborsRadius<HUGE_VAL; }
+
+    /// NULL if the parameters are valid, otherwise what is wrong with them.
+    const char* check() const;
+
+}; // end SiftMatchParams
+
+
+/// What siftRatioMatch found for each of the descr1 descriptors.
+struct SiftMatchResult {
+
+    SiftMatchResult() {}
+
+    /// inds[i] is the 0-based index of the descr2 descriptor matched to
+    /// descr1 descriptor i, or -1 if it has no match.
+    std::vector<int> inds;
+    /// ratios[i] is the ratio of the second nearest distance to the nearest,
+    /// or distRatio if it was stopped (see SiftRatioMatch.m).
+    std::vector<double> ratios;
+    /// The prunedDist counts of all the threads (if pruneWithCellsBounds),
+    /// and the pairs the cascade skipped (if cascadeWithCellsBounds).
+    SiftDistPruneStats pruneStats;
+    /// Only if SiftMatchParams::findNeighbors()
+    SiftNeighbors neighbors;
+    /// Only if the library was built with SIFT_DIST_COUNTERS (SIFTDIST_COUNTERS
+    /// in cmake), otherwise 0.
+    SiftRatioMatchCounters counters;
+    /// Set when siftRatioMatch fails.
+    std::string error;
+
+    unsigned int matchesNum() const;
+
+}; // end SiftMatchResult
+
+
+/// Matches each of the sift_num1 descriptors of descr1 to one of descr2
+/// (or to none) as SiftRatioMatch.m does, with the SiftDist instance chosen
+/// by dispatchSiftDist (or SiftEmdModDist, see distType). Descriptors are NBO*NBP*NBP values each, one after
+/// the other. Instantiated for double, unsigned char and unsigned short.
+/// Returns false (with result.error set) if params are not valid.
+template<typename DESCR_T>
+bool siftRatioMatch(const DESCR_T* descr1, const double* frames1, unsigned int sift_num1,
+                    const DESCR_T* descr2, const double* frames2, unsigned int sift_num2,
+                    const SiftMatchParams& params,
+                    SiftMatchResult& result);
+
+/// siftRatioMatch of two prepared sets (e.g. video frames, each matched to the
+/// previous and the next one), whose radiuses, grids and cells masses are
+/// not computed again. The sets should have params' NBO, NBP, magnif and
+/// frames layout. result.inds are indices of set2, set2.id() gives their ids.
+template<typename DESCR_T>
+bool siftRatioMatch(const SiftDescrSet<DESCR_T>& set1, const SiftDescrSet<DESCR_T>& set2,
+                    const SiftMatchParams& params,
+                    SiftMatchResult& result);
+
+/// The descriptors and frames of one image of siftRatioMatchBatch (not owned),
+/// laid out as in siftRatioMatch.
+template<typename DESCR_T>
+struct SiftMatchImage {
+    SiftMatchImage() : descr(NULL), frames(NULL), num(0) {}
+    SiftMatchImage(const DESCR_T* descr_, const double* frames_, unsigned int num_)
+        : descr(descr_), frames(frames_), num(num_) {}
+    const DESCR_T* descr;
+    const double* frames;
+    unsigned int num;
+};
+
+/// Where siftRatioMatchBatch spent its time, in seconds. prepareSeconds and
+/// matchSeconds are summed over the threads.
+struct SiftMatchBatchTimings {
+    SiftMatchBatchTimings() : querySeconds(0), prepareSeconds(0), matchSeconds(0), wallSeconds(0) {}
+    /// Preparing the query set (once)
+    double querySeconds;
+    /// Preparing the candidate sets: radiuses, grids and cells masses
+    double prepareSeconds;
+    /// The scans, the ratio tests and the overlap filter (of findMin2), which
+    /// run together for each query descriptor
+    double matchSeconds;
+    double wallSeconds;
+};
+
+/// What siftRatioMatchBatch found for each of the candidates.
+struct SiftMatchBatchResult {
+    /// results[c] is the SiftMatchResult of candidates[c]
+    std::vector<SiftMatchResult> results;
+    SiftMatchBatchTimings timings;
+    /// Set when siftRatioMatchBatch fails.
+    std::string error;
+};
+
+/// Matches query to each of the candidates, exactly as siftRatioMatch of
+/// each pair, for matching one image against many. The query is prepared
+/// once (as a SiftDescrSet) and the candidates are split into contiguous
+/// shards, one per thread (params.threadsNum of them, at most one per
+/// candidate), each with its own SiftRatioMatcher and candidate set, so that
+/// a thread keeps its buffers and its part of the candidates. A thread that
+/// is done with its shard takes candidates from another (see WorkStealingPool).
+/// Each thread prepares a candidate and then matches it, so the preparation
+/// of some candidates overlaps the matching of others. If there are fewer
+/// candidates than threads, each match gets the threads that are left.
+/// Returns false (with result.error set) if params are not valid.
+template<typename DESCR_T>
+bool siftRatioMatchBatch(const SiftMatchImage<DESCR_T>& query,
+                         const std::vector< SiftMatchImage<DESCR_T> >& candidates,
+                         const SiftMatchParams& params,
+                         SiftMatchBatchResult& result);
+
+/// dists[i+j*sift_num1] is the SiftDist between descr1 descriptor i and descr2
+/// descriptor j (a column major sift_num1 x sift_num2 matrix, as SiftDist.m).
+/// stopThresholdsArr is as in SiftDist::operator(), or NULL.
+void siftDistMatrix(const double* descr1, unsigned int sift_num1,
+                    const double* descr2, unsigned int sift_num2,
+                    unsigned int NBO, unsigned int CELLS_NUM,
+                    const double* stopThresholdsArr,
+                    double* dists);
+
+#endif
@@ -29,10 +29,7 @@
 #include <mex.h>
 
 #include "mexCheckAndExtractInputs.hxx"
-#include "SiftRatioMatchImpl.hxx"
-
-// Distances used:
-#include "SiftDist.hxx"
+#include "SiftMatch.hxx"
 
 
 void mexFunction(int nout, mxArray *out[], 
@@ -56,6 +53,9 @@ void mexFunction(int nout, mxArray *out[],
       
       distType dt= SiftDistType;
       double maxOverlap= 0.5;
+      unsigned int numThreads= 1;
+      unsigned int neighborsK= 0;
+      double neighborsRadius= HUGE_VAL;
       //-------------------------------------------------------
 
       
@@ -65,8 +65,8 @@ void mexFunction(int nout, mxArray *out[],
       if (nin<4) {
 	    mexErrMsgTxt("At least 4 arguments are required.");
       }
-      if (nout!=2) {
-	    mexErrMsgTxt("There should be exactly two output arguments.");
+      if (nout!=2&&nout!=3) {
+	    mexErrMsgTxt("There should be two or three output arguments.");
       }
       //-------------------------------------------------------
 
@@ -127,6 +127,21 @@ void mexFunction(int nout, mxArray *out[],
 	    mexCheckAndExtractInputs::checkAndExtract_distType(in[10],
 							       dt);
       }
+
+      if (nin>11) {
+	    mexCheckAndExtractInputs::checkAndExtract_numThreads(in[11],
+								 numThreads);
+      }
+
+      if (nin>12) {
+	    mexCheckAndExtractInputs::checkAndExtract_neighborsK(in[12],
+								 neighborsK);
+      }
+
+      if (nin>13) {
+	    mexCheckAndExtractInputs::checkAndExtract_neighborsRadius(in[13],
+								      neighborsRadius);
+      }
       //------------------------------------------------------- 
       
       
@@ -138,25 +153,54 @@ void mexFunction(int nout, mxArray *out[],
       double* inds=  (double*)mxGetData(out[0]);
       double* ratios= (double*)mxGetData(out[1]);
       
-      SiftDist<double> sd(NBO,NBP*NBP);
-            
+      SiftMatchParams params;
       switch(dt) {
-
       case SiftDistType:
-          
-          SiftRatioMatchImpl< SiftDist<double> >
-              (descr1, frames1, sift_num1,
-               descr2, frames2, sift_num2,
-               distRatio,
-               stopThresholdsFactorGamma,
-               NBO, NBP, Magnif,
-               maxOverlap,
-               sd,
-               FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND, FRAMES_SCALE_IND,
-               inds, ratios);
+          params.distType= SiftMatchParams::SiftDistType;
+          break;
+      case EmdModType:
+          params.distType= SiftMatchParams::EmdModType;
           break;
-          
       } // switch(dt)
+      params.distRatio= distRatio;
+      params.stopThresholdsFactorGamma= stopThresholdsFactorGamma;
+      params.NBO= NBO;
+      params.NBP= NBP;
+      params.magnif= Magnif;
+      params.maxOverlap= maxOverlap;
+      params.framesColSize= FRAMES_COL_SIZE;
+      params.framesXInd= FRAMES_X_IND;
+      params.framesYInd= FRAMES_Y_IND;
+      params.framesScaleInd= FRAMES_SCALE_IND;
+      params.threadsNum= numThreads;
+      params.neighborsK= neighborsK;
+      params.neighborsRadius= neighborsRadius;
+      SiftMatchResult result;
+      if (!siftRatioMatch(descr1, frames1, sift_num1,
+                          descr2, frames2, sift_num2,
+                          params, result)) {
+          mexErrMsgTxt(result.error.c_str());
+      }
+      // Matlab indices are 1-based, 0 for no match
+      for (unsigned int i=0; i<sift_num1; ++i) {
+          inds[i]= result.inds[i]+1;
+          ratios[i]= result.ratios[i];
+      }
+      if (nout==3) {
+          // One [query; index; dist] column per neighbor, 1-based
+          // (none if neither K nor Radius is given)
+          const SiftNeighbors& nb= result.neighbors;
+          unsigned int neighbors_num= static_cast<unsigned int>(nb.inds.size());
+          out[2]= mxCreateDoubleMatrix(3, neighbors_num, mxREAL);
+          double* neighbors= (double*)mxGetData(out[2]);
+          for (unsigned int i=0; i<sift_num1 && !nb.starts.empty(); ++i) {
+              for (unsigned int j=nb.starts[i]; j<nb.starts[i+1]; ++j) {
+                  neighbors[3*j  ]= i+1;
+                  neighbors[3*j+1]= nb.inds[j]+1;
+                  neighbors[3*j+2]= nb.dists[j];
+              }
+          }
+      }
       //-------------------------------------------------------
       
       
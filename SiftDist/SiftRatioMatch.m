@@ -1,6 +1,6 @@
 %SiftRatioMatch     Returns the symmetric ratio nearest neighbor matching.
 %                   
-% [inds ratios] = SiftRatioMatch(descr1, frames1,
+% [inds ratios neighbors] = SiftRatioMatch(descr1, frames1,
 %                                descr2, frames2,
 %
 %                                DistRatio, StopThresholdsFactorGamma
@@ -9,7 +9,10 @@
 %                                Magnif,
 % 
 %                                MaxOverlap,
-%                                DistType)
+%                                DistType,
+%                                NumThreads,
+%
+%                                K, Radius)
 % 
 %-------------------------------------------------------------------------------------------------
 % Output:
@@ -31,6 +34,16 @@
 %                 the default) this function does not compute the exact value of
 %                 ratios that are probably bigger than the given DistRatio 
 %
+% neighbors       Optional. A 3 x N matrix with one column [k; index; dist] per neighbor:
+%                 the index (into descr2) and the distance of a neighbor of descr1(:,k).
+%                 Given K and/or Radius, these are the K nearest neighbors of each
+%                 feature (all if K==0) whose distance is smaller than Radius.
+%                 Columns are sorted by k and then by dist.
+%                 Found in the same scan as inds, with stop thresholds that are based
+%                 on the K-th best distance, so neighbors are exact if DistRatio==-1
+%                 or StopThresholdsFactorGamma==0, and otherwise distances that are
+%                 probably bigger than the K-th best can be missed (as in ratios).
+%
 %--------------------------------------------------------------------------------------------------
 % Descriptors Data Input:
 %--------------------------------------------------------------------------------------------------
@@ -112,6 +125,25 @@
 % DistType        The distance type that is used for the matching.
 %                 Possible values:
 %                 1 - SiftDist (default)
+%                 2 - EMD_MOD summed over the cells (the heavier cell of each
+%                     pair is scaled to the mass of the lighter one, and each
+%                     unit of the mass difference costs 2, as in SiftDist).
+%                     The stop thresholds prune it as they prune SiftDist.
+%
+% NumThreads      The number of threads that match descr1 in parallel.
+%                 The output does not depend on the number of threads.
+%                 0 means the number of cores.
+%                 Default: 1.
+%
+%--------------------------------------------------------------------------------------------------
+% Neighbors Input:
+%--------------------------------------------------------------------------------------------------
+% K               The number of nearest neighbors of each feature in neighbors.
+%                 0 means all the neighbors within Radius.
+%                 Default: 0.
+%
+% Radius          Only neighbors whose distance is smaller than Radius are in neighbors.
+%                 Default: inf.
 
 % Copyright (2008-2009), The Hebrew University of Jerusalem.
 % All Rights Reserved.
@@ -30,107 +30,398 @@
 #define _OFIRPELE_SIFT_RATIO_MATCH_IMPL__HXX
 
 #include "circleFuncs.hxx"
+#include "FramesGrid.hxx"
+#include "SiftDescrSet.hxx"
+#include "SiftDist.hxx"
+#include "SiftDistBatch.hxx"
+#include "SiftDistCounters.hxx"
+#include "WorkStealingPool.hxx"
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <cstddef>
 #include <math.h>
 
 
 
 
-///@param DISTANCE_T the type of the functor that computes distances between SIFT-like descriptors.
-/// inds and ratios are assumed to be initialized to 0.
-template<typename DISTANCE_T>
-class SiftRatioMatchImpl {
+
+/// A SiftRatioMatcher matches prepared sets of descriptors (SiftDescrSet) as
+/// SiftRatioMatchImpl does, any number of times. The threads, their buffers and
+/// the stop thresholds factors are kept between the matches, and each set is
+/// prepared once, however many sets it is matched against (e.g. a video frame
+/// against the previous and the next one, or query batches against a database).
+/// threads_num threads match disjoint blocks of descr1 (0 means the number of cores).
+/// Each thread has its own copy of sd, so the output does not depend on threads_num.
+/// The reverse scan of descr1 for a descr2 descriptor does not depend on the query
+/// that chose it, so its result is cached (per thread, for one match) in
+/// reverse_scan_cache_bytes.
+/// If prune_with_cells_bounds (and distRatio!=-1) the distances are computed with
+/// DISTANCE_T::prunedDist, which also stops pairs whose lower bound shows they are
+/// too far. The matches are the same, but ratios above distRatio are less exact.
+/// If also order_cells_by_mass, the cells with more mass in the query are computed
+/// first. Far pairs are then stopped sooner, but as the stop thresholds assume
+/// cells of similar distances, more good matches are lost (use a smaller
+/// stopThresholdsFactorGamma).
+/// If cascade_with_cells_bounds (and distRatio!=-1) the cells bound of a query
+/// with all the descriptors is computed ahead of their distances, which are then
+/// computed in increasing bound order. The nearest descriptors are found first,
+/// and the ones whose bound reached the last stop threshold are not computed at
+/// all (SiftDistPruneStats::cascadeSkips). The skipped pairs would have been
+/// stopped anyway, so the matches differ only by the other stops, which are
+/// earlier as the minimum is found sooner. It can be changed between matches.
+///@param DESCR_T the type of the descriptors entries, e.g. unsigned char for
+/// quantized SIFT. DISTANCE_T should take DESCR_T descriptors and return
+/// SiftDistAccum<DESCR_T>::DIST_T distances (e.g. SiftDistMulti<DESCR_T>).
+/// For integer distances the stop thresholds are rounded up, which stops
+/// exactly the pairs the unrounded thresholds stop.
+template<typename DISTANCE_T, typename DESCR_T= double>
+class SiftRatioMatcher {
 
 public:
-      
-SiftRatioMatchImpl(const double* descr1, const double* frames1, unsigned int sift_num1, 
-                   const double* descr2, const double* frames2, unsigned int sift_num2,
-                   double distRatio,
-                   double stopThresholdsFactorGamma,
-                   unsigned int NBO, unsigned int NBP, double Magnif,
-                   double maxOverlap,
-                   const DISTANCE_T& sd,
-                   int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND, int FRAMES_SCALE_IND,
-                   
-                   double* inds, double* ratios) {
 
-    unsigned int CELLS_NUM= NBP*NBP;
+typedef typename SiftDistAccum<DESCR_T>::DIST_T DIST_T;
+
+SiftRatioMatcher(double distRatio,
+                 double stopThresholdsFactorGamma,
+                 unsigned int NBO, unsigned int NBP,
+                 double maxOverlap,
+                 const DISTANCE_T& sd,
+                 int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND,
+                 unsigned int threads_num= 1,
+                 size_t reverse_scan_cache_bytes= 4*1024*1024,
+                 bool prune_with_cells_bounds= false,
+                 bool order_cells_by_mass= false,
+                 bool cascade_with_cells_bounds= false)
 
-    if (distRatio==-1) {
-        _stopThresholdsArr= NULL;
-        _stopThresholdsFactorsArr= NULL;
-    } else {
-        _stopThresholdsArr= new double[NBP*NBP];
-        _stopThresholdsFactorsArr= new double[NBP*NBP];
+    : _distRatio(distRatio), _maxOverlap(maxOverlap),
+      _NBO(NBO), _CELLS_NUM(NBP*NBP), _sift_dim(NBO*NBP*NBP),
+      _FRAMES_COL_SIZE(FRAMES_COL_SIZE), _FRAMES_X_IND(FRAMES_X_IND), _FRAMES_Y_IND(FRAMES_Y_IND),
+      _sdb(NBO*NBP*NBP, sizeof(DESCR_T)),
+      _prune(prune_with_cells_bounds&&distRatio!=-1),
+      _order_cells(_prune&&order_cells_by_mass),
+      _cascade(false),
+      _reverse_scan_cache_bytes(reverse_scan_cache_bytes),
+      _pool(threads_num),
+      _states(_pool.threadsNum(), ThreadState(sd)),
+      _block_size(1), _inds(NULL), _ratios(NULL), _neighbors(NULL),
+      _counters(_CELLS_NUM) {
+
+    if (distRatio!=-1) {
+        _stopThresholdsFactorsArr.resize(_CELLS_NUM);
         
         unsigned int i;
-        double factor= 1.0/(CELLS_NUM);
-        for (i=0; i<CELLS_NUM; ++i) {
+        double factor= 1.0/(_CELLS_NUM);
+        for (i=0; i<_CELLS_NUM; ++i) {
             _stopThresholdsFactorsArr[i]= pow(factor, stopThresholdsFactorGamma);
-            factor+= (1.0/CELLS_NUM);
+            factor+= (1.0/_CELLS_NUM);
         }
     }
+    setCascadeWithCellsBounds(cascade_with_cells_bounds);
+
+} // end Ctor
+
+void setCascadeWithCellsBounds(bool cascade_with_cells_bounds) {
+    _cascade= cascade_with_cells_bounds&&_distRatio!=-1;
+}
+
+/// What all the matches since the construction or resetCounters() did, summed
+/// over the threads (only with SIFT_DIST_COUNTERS, see "SiftDistCounters.hxx").
+const SiftRatioMatchCounters& counters() const { return _counters; }
+void resetCounters() { _counters= SiftRatioMatchCounters(_CELLS_NUM); }
+
+/// Matches each of the set1 descriptors to one of set2 (or to none).
+/// inds[i] is the 1-based index in set2 of the match of set1 descriptor i, or 0,
+/// and ratios[i] its ratio (see SiftRatioMatch.m). Both are set1.num long.
+/// set1 and set2 should have the cells masses if prune_with_cells_bounds or cascade.
+/// prune_stats, if not NULL, gets the prunedDist counts of this match added.
+/// neighbors, if not NULL, gets the neighbors in set2 of each set1 descriptor
+/// (its k and radius are the input), from the same scans. The stop thresholds
+/// are then also at least the distance of the k-th nearest found so far (or
+/// radius), so that the neighbors are exact as the minimum is. As fewer pairs
+/// are stopped, the ratios above distRatio might be more exact.
+/// Not reentrant: a matcher runs one match at a time.
+void match(const SiftDescrSetView<DESCR_T>& set1, const SiftDescrSetView<DESCR_T>& set2,
+           double* inds, double* ratios,
+           SiftDistPruneStats* prune_stats= NULL,
+           SiftNeighbors* neighbors= NULL) {
+
+    assert(!(_prune||_cascade) || set1.num==0 || set1.cellsMass!=NULL);
+    assert(!(_prune||_cascade) || set2.num==0 || set2.cellsMass!=NULL);
+    assert(set1.radius_vec->size()==set1.num && set2.radius_vec->size()==set2.num);
+    _set1= set1;
+    _set2= set2;
+    _inds= inds;
+    _ratios= ratios;
+    _neighbors= neighbors;
+    std::fill(inds, inds+set1.num, 0.0);
+    std::fill(ratios, ratios+set1.num, 0.0);
+    if (neighbors!=NULL) {
+        neighbors->starts.assign(set1.num+1, 0);
+        neighbors->inds.clear();
+        neighbors->dists.clear();
+    }
+    // Nothing to match (e.g. an image without descriptors): no matches and no neighbors
+    if (set1.num==0 || set2.num==0) return;
+    _block_size= blockSize(_sdb, set1.num, set2.num);
+
+    for (unsigned int t=0; t<_states.size(); ++t) {
+        _states[t].prepare(_block_size, set1.num, set2.num,
+                           _distRatio==-1 ? 0 : _block_size*_CELLS_NUM,
+                           _reverse_scan_cache_bytes/_states.size(),
+                           _order_cells ? _CELLS_NUM : 0,
+                           _cascade ? myMax(set1.num, set2.num) : 0);
+    }
+
+    // Blocks are small enough that a stolen block is worth it, yet a block
+    // of queries still shares the same descr tiles.
+    unsigned int blocks_num= (set1.num+_block_size-1)/_block_size;
+    BlockTask task(*this, _states);
+    _pool.run(blocks_num, task);
+
+    if (prune_stats!=NULL) {
+        for (unsigned int t=0; t<_states.size(); ++t) {
+            prune_stats->add(_states[t]._sd.pruneStats());
+            prune_stats->cascadePairs+= _states[t]._cascadePairs;
+            prune_stats->cascadeSkips+= _states[t]._cascadeSkips;
+        }
+    }
+    if (neighbors!=NULL) gatherNeighbors(*neighbors);
+#ifdef SIFT_DIST_COUNTERS
+    ++_counters.matches;
+    for (unsigned int t=0; t<_states.size(); ++t) {
+        _counters.add(_states[t]._counters);
+        _counters.dist.add(_states[t]._sd.counters());
+    }
+#endif
+      
+} // end match
+
+/// match of two SiftDescrSet, which should have the NBO, NBP and frames layout of this matcher.
+void match(const SiftDescrSet<DESCR_T>& set1, const SiftDescrSet<DESCR_T>& set2,
+           double* inds, double* ratios,
+           SiftDistPruneStats* prune_stats= NULL,
+           SiftNeighbors* neighbors= NULL) {
+    assert(compatible(set1) && compatible(set2));
+    match(set1.view(), set2.view(), inds, ratios, prune_stats, neighbors);
+}
+
+/// The number of blocks of a match of sift_num1 descriptors with sift_num2,
+/// more threads than that are idle.
+static unsigned int blocksNum(unsigned int sift_dim, unsigned int sift_num1, unsigned int sift_num2) {
+    unsigned int block_size= blockSize(SiftDistBatch(sift_dim, sizeof(DESCR_T)), sift_num1, sift_num2);
+    return (sift_num1+block_size-1)/block_size;
+}
+
+bool compatible(const SiftDescrSet<DESCR_T>& set) const {
+    return set.NBO()==_NBO && set.NBP()*set.NBP()==_CELLS_NUM &&
+        set.FRAMES_COL_SIZE()==_FRAMES_COL_SIZE &&
+        set.FRAMES_X_IND()==_FRAMES_X_IND && set.FRAMES_Y_IND()==_FRAMES_Y_IND;
+}
+      
+private:
+
+/// Number of descr1 descriptors that are scanned together. Bounded
+/// so that their distances vectors stay in L2; when most pairs stop
+/// after the first cell, writing the distances is most of the work.
+static unsigned int blockSize(const SiftDistBatch& sdb, unsigned int sift_num1, unsigned int sift_num2) {
+    const unsigned int MAX_BLOCK_DISTS= 64*1024;
+    unsigned int block_size= myMax(1u, myMin(sdb.queriesTileSize(), MAX_BLOCK_DISTS/myMax(1u, sift_num1+sift_num2)));
+    return myMin(block_size, myMax(1u, sift_num1));
+}
+
+/// A distance and the index of its descr2 descriptor
+typedef std::pair<DIST_T, unsigned int> Neighbor;
+
+/// A neighbor of descr1(:,c1), after the scan of its block
+struct FoundNeighbor {
+    unsigned int _c1;
+    Neighbor _neighbor;
+};
+
+/// What the post processing needs from the scan of descr1 with descr2(:,key):
+/// the index of the minimum, the minimum and the second minimum of the
+/// descriptors that do not overlap the minimum too much.
+struct ReverseScan {
+    ReverseScan() : _key(EMPTY_KEY), _min_Ind(0), _min(0), _min2(0) {}
+    static const unsigned int EMPTY_KEY= 0xFFFFFFFFu;
+    unsigned int _key;
+    unsigned int _min_Ind;
+    double _min;
+    double _min2;
+};
+
+/// Everything a thread changes while matching blocks.
+struct ThreadState {
+
+    explicit ThreadState(const DISTANCE_T& sd) : _sd(sd), _cascadePairs(0), _cascadeSkips(0) {}
+
+    /// Sizes the buffers for a match (they only grow, so matches of
+    /// similar sets do not allocate) and empties the cache.
+    void prepare(unsigned int block_size, unsigned int sift_num1, unsigned int sift_num2,
+                 unsigned int stopThresholdsArr_size, size_t cache_bytes, unsigned int order_CELLS_NUM,
+                 unsigned int cascade_num) {
+        _stopThresholdsArr.resize(stopThresholdsArr_size);
+        _descr1_block_descr2_all_dists.resize(block_size*sift_num2);
+        _descr2_min_block_descr1_all_dists.resize(block_size*sift_num1);
+        _min_descr1_block_descr2_all_dists_Inds.resize(block_size);
+        _min_descr2_min_block_descr1_all_dists_Inds.resize(block_size);
+        _queries.resize(block_size);
+        // Direct mapped, a slot for each descr2 descriptor if the budget allows it
+        _cache.assign(myMin(static_cast<size_t>(sift_num2), cache_bytes/sizeof(ReverseScan)), ReverseScan());
+        _block_keys.resize(block_size);
+        _block_scans.resize(block_size);
+        _queries_masses.resize(block_size);
+        _cellsOrders.resize(block_size*order_CELLS_NUM);
+        _bounds.resize(cascade_num);
+        _cascadeOrder.resize(cascade_num);
+        _sd.resetPruneStats();
+        _sd.resetCounters();
+        _counters= SiftRatioMatchCounters();
+        _cascadePairs= 0;
+        _cascadeSkips= 0;
+        _neighbors.resize(block_size);
+        _found.clear();
+    }
+
+    DIST_T* stopThresholdsArr() { return _stopThresholdsArr.empty() ? NULL : &_stopThresholdsArr[0]; }
     
-    double scaleToRadiusFactor= (Magnif*NBP)/2.0;
-    
-    std::vector<double> radius1_vec(sift_num1);
-    extractRadiusesFromFrames(frames1, FRAMES_SCALE_IND, FRAMES_COL_SIZE, scaleToRadiusFactor,
-                              radius1_vec);
-    
-    std::vector<double> radius2_vec(sift_num2);
-    extractRadiusesFromFrames(frames2, FRAMES_SCALE_IND, FRAMES_COL_SIZE, scaleToRadiusFactor,
-                              radius2_vec);
-    
+    DISTANCE_T _sd;
+    // block_size x CELLS_NUM, a row for each scanned query
+    std::vector<DIST_T> _stopThresholdsArr;
+    // Row q holds distances of desc1(:,c1_0+q) to descr2(:,1:end)
+    std::vector<DIST_T> _descr1_block_descr2_all_dists;
+    // Row q holds distances of desc2(:,min_(c1_0+q)) to descr1(:,1:end)
+    std::vector<DIST_T> _descr2_min_block_descr1_all_dists;
+    std::vector<unsigned int> _min_descr1_block_descr2_all_dists_Inds;
+    std::vector<unsigned int> _min_descr2_min_block_descr1_all_dists_Inds;
+    std::vector<const DESCR_T*> _queries;
+    std::vector<ReverseScan> _cache;
+    // Sorted descr2 indices that were scanned in this block and their scans
+    std::vector<unsigned int> _block_keys;
+    std::vector<ReverseScan> _block_scans;
+    // Only for prunedDist - cells masses of each query and the order of its cells
+    std::vector<const DIST_T*> _queries_masses;
+    std::vector<unsigned int> _cellsOrders;
+    // findMin2 - the frames near the minimum
+    std::vector<unsigned int> _near;
+    // Only for the cascade - the cells bounds of a query and the order they give
+    std::vector<DIST_T> _bounds;
+    std::vector<unsigned int> _cascadeOrder;
+    unsigned long long _cascadePairs;
+    unsigned long long _cascadeSkips;
+    // Only for neighbors - the ones of each scanned query (a max heap if
+    // k>0), and the ones of the blocks this thread matched, in order
+    std::vector< std::vector<Neighbor> > _neighbors;
+    std::vector<FoundNeighbor> _found;
+    // Only with SIFT_DIST_COUNTERS, the distances are in _sd
+    SiftRatioMatchCounters _counters;
+};
+
+struct BlockTask {
+    BlockTask(SiftRatioMatcher& impl, std::vector<ThreadState>& states) : _impl(impl), _states(states) {}
+    void operator()(unsigned int thread_ind, unsigned int block) {
+        _impl.matchBlock(_states[thread_ind], block*_impl._block_size);
+    }
+    SiftRatioMatcher& _impl;
+    std::vector<ThreadState>& _states;
+};
+
+/// Fills inds and ratios of descr1(:,c1_0+1:c1_0+block_size).
+void matchBlock(ThreadState& st, unsigned int c1_0) {
+
+    unsigned int queries_num= myMin(_block_size, _set1.num-c1_0);
+    SIFT_DIST_COUNT(st._counters.queries+= queries_num);
     
-    unsigned int sift_dim= NBO*CELLS_NUM;
+    for (unsigned int q=0; q<queries_num; ++q) {
+        st._queries[q]= _set1.descr + (c1_0+q)*_sift_dim;
+        if (_prune||_cascade) st._queries_masses[q]= _set1.cellsMass + (c1_0+q)*_CELLS_NUM;
+    }
+    computeDistsAndFindMin(st, _set2.descr, _set2.num, _prune||_cascade ? _set2.cellsMass : NULL, &st._queries[0], queries_num,
+                           _neighbors!=NULL,
+                           &st._descr1_block_descr2_all_dists[0],
+                           &st._min_descr1_block_descr2_all_dists_Inds[0]);
+    if (_neighbors!=NULL) {
+        for (unsigned int q=0; q<queries_num; ++q) {
+            std::vector<Neighbor>& neighbors= st._neighbors[q];
+            std::sort(neighbors.begin(), neighbors.end());
+            for (unsigned int k=0; k<neighbors.size(); ++k) {
+                FoundNeighbor found= { c1_0+q, neighbors[k] };
+                st._found.push_back(found);
+            }
+        }
+    }
     
-    // Holds distances of desc1(:,c1) to descr2(:,1:end)
-    std::vector<double> descr1_c1_descr2_all_dists = std::vector<double>(sift_num2);
-    // Holds distances of desc2(:,min_c1) to descr1(:,1:end)
-    std::vector<double> descr2_min_c1_descr1_all_dists= std::vector<double>(sift_num1);
+    // Reverse scans that are not cached, each descr2 index once
+    unsigned int keys_num= 0;
+    for (unsigned int q=0; q<queries_num; ++q) {
+        unsigned int key= st._min_descr1_block_descr2_all_dists_Inds[q];
+        if (findCachedReverseScan(st, key)==NULL) {
+            st._block_keys[keys_num++]= key;
+        } else {
+            SIFT_DIST_COUNT(++st._counters.reverseScansCached);
+        }
+    }
+    std::sort(st._block_keys.begin(), st._block_keys.begin()+keys_num);
+    keys_num= static_cast<unsigned int>(std::unique(st._block_keys.begin(), st._block_keys.begin()+keys_num)
+                                        - st._block_keys.begin());
+    SIFT_DIST_COUNT(st._counters.reverseScans+= keys_num);
     
+    for (unsigned int k=0; k<keys_num; ++k) {
+        st._queries[k]= _set2.descr + (st._block_keys[k]*_sift_dim);
+        if (_prune||_cascade) st._queries_masses[k]= _set2.cellsMass + st._block_keys[k]*_CELLS_NUM;
+    }
+    computeDistsAndFindMin(st, _set1.descr, _set1.num, _prune||_cascade ? _set1.cellsMass : NULL, &st._queries[0], keys_num,
+                           false,
+                           &st._descr2_min_block_descr1_all_dists[0],
+                           &st._min_descr2_min_block_descr1_all_dists_Inds[0]);
     
-    const double* descr1_c1= descr1;
-    for (unsigned int c1=0; c1<sift_num1; ++c1, descr1_c1+= sift_dim, ++inds, ++ratios) {
-        
-	    unsigned int min_descr1_c1_descr2_all_dists_Ind;
-	    computeDistsAndFindMin(descr2, sd, descr1_c1, NBO, CELLS_NUM, sift_dim, sift_num2, distRatio,
-                               descr1_c1_descr2_all_dists,
-                               min_descr1_c1_descr2_all_dists_Ind);
-	    const double* descr2_min= descr2 + (min_descr1_c1_descr2_all_dists_Ind*sift_dim);
-        
-	    unsigned int min_descr2_min_c1_descr1_all_dists_Ind;
-	    computeDistsAndFindMin(descr1, sd, descr2_min, NBO, CELLS_NUM, sift_dim, sift_num1, distRatio,
-                               descr2_min_c1_descr1_all_dists,
-                               min_descr2_min_c1_descr1_all_dists_Ind);
+    for (unsigned int k=0; k<keys_num; ++k) {
+        ReverseScan& scan= st._block_scans[k];
+        const DIST_T* descr2_min_descr1_all_dists= &st._descr2_min_block_descr1_all_dists[k*_set1.num];
+        scan._key= st._block_keys[k];
+        scan._min_Ind= st._min_descr2_min_block_descr1_all_dists_Inds[k];
+        scan._min= descr2_min_descr1_all_dists[scan._min_Ind];
+        findMin2(_set1.num,
+                 descr2_min_descr1_all_dists, scan._min_Ind,
+                 _set1.frames, *_set1.radius_vec, *_set1.grid,
+                 st,
+                 
+                 scan._min2);
+    }
+
+    double* inds= _inds + c1_0;
+    double* ratios= _ratios + c1_0;
+    for (unsigned int q=0; q<queries_num; ++q, ++inds, ++ratios) {
         
+        unsigned int c1= c1_0+q;
+        unsigned int min_descr1_c1_descr2_all_dists_Ind= st._min_descr1_block_descr2_all_dists_Inds[q];
+        const DIST_T* descr1_c1_descr2_all_dists= &st._descr1_block_descr2_all_dists[q*_set2.num];
+        const ReverseScan& scan= findReverseScan(st, min_descr1_c1_descr2_all_dists_Ind, keys_num);
         
 	    // If not a symmetric nearest neighbor - *inds and *ratios will be 0
-	    if (min_descr2_min_c1_descr1_all_dists_Ind!=c1) continue;
+	    if (scan._min_Ind!=c1) {
+            SIFT_DIST_COUNT(++st._counters.symmetricRejects);
+            continue;
+        }
 	    
-	    double min2_in_descr1;
-	    findMin2(sift_dim, sift_num1,
-                 descr2_min_c1_descr1_all_dists, min_descr2_min_c1_descr1_all_dists_Ind,
-                 frames1, FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND,
-                 radius1_vec,
-                 maxOverlap,
-                 
-                 min2_in_descr1);
+	    double min2_in_descr1= scan._min2;
+	    double min_descr2_min_c1_descr1_all_dists= scan._min;
         
 	    
 	    double min2_in_descr2;
-	    findMin2(sift_dim, sift_num2,
+	    findMin2(_set2.num,
                  descr1_c1_descr2_all_dists, min_descr1_c1_descr2_all_dists_Ind,
-                 frames2, FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND,
-                 radius2_vec,
-                 maxOverlap,
+                 _set2.frames, *_set2.radius_vec, *_set2.grid,
+                 st,
                  
                  min2_in_descr2);
         
 	    
-	    assert(min2_in_descr1>=descr2_min_c1_descr1_all_dists[c1]);
-	    assert(min2_in_descr2>=descr2_min_c1_descr1_all_dists[c1]);
+	    // With _order_cells the distance of a pair is summed in a different
+	    // order when scanning descr1 and descr2, so ties might be broken.
+	    assert(_order_cells||min2_in_descr1>=min_descr2_min_c1_descr1_all_dists);
+	    assert(_order_cells||min2_in_descr2>=min_descr2_min_c1_descr1_all_dists);
         
 	    //------------------------------------------
 	    // Fill output
@@ -143,117 +434,581 @@ SiftRatioMatchImpl(const double* descr1, const double* frames1, unsigned int sif
             if (min2_in_descr1==0) {
                 *ratios= 1.0;
             } else {
-                *ratios= (min2_in_descr1 / descr2_min_c1_descr1_all_dists[c1]);
+                *ratios= (min2_in_descr1 / min_descr2_min_c1_descr1_all_dists);
             }
 	    } else {
 		  if (min2_in_descr2==0) {
               *ratios= 1.0;
 		  } else {
-              *ratios= (min2_in_descr2 / descr2_min_c1_descr1_all_dists[c1]);
+              *ratios= (min2_in_descr2 / min_descr2_min_c1_descr1_all_dists);
 		  }
 	    }
         
-        if ((distRatio!=-1)&&((*ratios)<distRatio)) {
+        if ((_distRatio!=-1)&&((*ratios)<_distRatio)) {
+            SIFT_DIST_COUNT(++st._counters.ratioRejects);
             *inds= 0;
             *ratios= 0;
         }
 	    //------------------------------------------
 	    
-      } // for c1
-      
-} // end Ctor
+    } // for q
+
+    // Only now, as the cached scans of this block might be evicted by them
+    if (!st._cache.empty()) {
+        for (unsigned int k=0; k<keys_num; ++k) {
+            st._cache[st._block_keys[k]%st._cache.size()]= st._block_scans[k];
+        }
+    }
 
-~SiftRatioMatchImpl() {
-    delete[] _stopThresholdsArr;
-    delete[] _stopThresholdsFactorsArr;
+} // end matchBlock
+
+const ReverseScan* findCachedReverseScan(const ThreadState& st, unsigned int key) const {
+    if (st._cache.empty()) return NULL;
+    const ReverseScan& scan= st._cache[key%st._cache.size()];
+    return scan._key==key ? &scan : NULL;
+}
+
+/// The scan of key that was computed in this block, or cached before it.
+const ReverseScan& findReverseScan(const ThreadState& st, unsigned int key, unsigned int keys_num) const {
+    std::vector<unsigned int>::const_iterator it=
+        std::lower_bound(st._block_keys.begin(), st._block_keys.begin()+keys_num, key);
+    if (it!=st._block_keys.begin()+keys_num && *it==key) return st._block_scans[it-st._block_keys.begin()];
+    const ReverseScan* scan= findCachedReverseScan(st, key);
+    assert(scan!=NULL);
+    return *scan;
 }
-      
-private:
 
-void extractRadiusesFromFrames(const double* frames, int FRAMES_SCALE_IND, int FRAMES_COL_SIZE, double scaleToRadiusFactor,
-                               std::vector<double>& radius_vec) {
-      frames+= FRAMES_SCALE_IND;
-      for (unsigned int i=0; i<radius_vec.size(); ++i,frames+=FRAMES_COL_SIZE) {
-	    radius_vec[i]= (*frames) * scaleToRadiusFactor;
-      } // for i
-} // extractRadiusesFromFrames
-
-void updateStopThresholdsArr(double minVal, double distRatio, unsigned int CELLS_NUM) {
-    if (_stopThresholdsArr!=NULL) {
-        for (unsigned int i=0; i<CELLS_NUM; ++i) {
-            _stopThresholdsArr[i]= _stopThresholdsFactorsArr[i] * minVal * distRatio;
+/// Sets the stop thresholds of a query whose minimum is minVal, and if
+/// neighbors is not NULL, whose neighbors so far are these. Returns
+/// whether they changed.
+bool updateStopThresholdsArr(DIST_T* stopThresholdsArr, DIST_T minVal,
+                             const std::vector<Neighbor>* neighbors= NULL) const {
+    if (stopThresholdsArr==NULL) return false;
+    double bound= neighbors!=NULL ? neighborsBound(*neighbors) : 0.0;
+    bool by_neighbors= bound > minVal*_distRatio;
+    bool changed= false;
+    for (unsigned int i=0; i<_CELLS_NUM; ++i) {
+        DIST_T threshold= by_neighbors ? toStopThreshold(_stopThresholdsFactorsArr[i], bound) :
+            toStopThreshold(_stopThresholdsFactorsArr[i] * minVal * _distRatio);
+        changed= changed || threshold!=stopThresholdsArr[i];
+        stopThresholdsArr[i]= threshold;
+    }
+    return changed;
+}
+
+/// A descriptor farther than this from a query is not one of its neighbors
+/// (with what was found so far).
+double neighborsBound(const std::vector<Neighbor>& neighbors) const {
+    if (_neighbors->k>0 && neighbors.size()==_neighbors->k) {
+        return myMin(_neighbors->radius, static_cast<double>(neighbors.front().first));
+    }
+    return _neighbors->radius;
+}
+
+/// Adds descr2(:,ind) at distance dist to the neighbors of a query, if it is one.
+/// A distance that reached the last stop threshold might be of a stopped pair,
+/// which is not a neighbor anyway. Returns whether the neighbors changed.
+bool addNeighbor(std::vector<Neighbor>& neighbors, DIST_T dist, unsigned int ind,
+                 const DIST_T* stopThresholdsArr) const {
+    if (!(static_cast<double>(dist)<_neighbors->radius)) return false;
+    if (stopThresholdsArr!=NULL && !(dist<stopThresholdsArr[_CELLS_NUM-1])) return false;
+    Neighbor neighbor(dist, ind);
+    if (_neighbors->k==0 || neighbors.size()<_neighbors->k) {
+        neighbors.push_back(neighbor);
+        if (_neighbors->k>0) std::push_heap(neighbors.begin(), neighbors.end());
+        return true;
+    }
+    if (!(neighbor<neighbors.front())) return false;
+    std::pop_heap(neighbors.begin(), neighbors.end());
+    neighbors.back()= neighbor;
+    std::push_heap(neighbors.begin(), neighbors.end());
+    return true;
+}
+
+/// The neighbors all the threads found, as SiftNeighbors
+void gatherNeighbors(SiftNeighbors& neighbors) const {
+    std::vector<unsigned int>& starts= neighbors.starts;
+    for (unsigned int t=0; t<_states.size(); ++t) {
+        const std::vector<FoundNeighbor>& found= _states[t]._found;
+        for (unsigned int k=0; k<found.size(); ++k) ++starts[found[k]._c1+1];
+    }
+    for (unsigned int i=0; i<_set1.num; ++i) starts[i+1]+= starts[i];
+    neighbors.inds.resize(starts[_set1.num]);
+    neighbors.dists.resize(starts[_set1.num]);
+    // The neighbors of a descriptor are found together, sorted
+    for (unsigned int t=0; t<_states.size(); ++t) {
+        const std::vector<FoundNeighbor>& found= _states[t]._found;
+        for (unsigned int k=0; k<found.size(); ) {
+            unsigned int c1= found[k]._c1;
+            for (unsigned int n=starts[c1]; k<found.size() && found[k]._c1==c1; ++k, ++n) {
+                neighbors.inds[n]= found[k]._neighbor.second;
+                neighbors.dists[n]= static_cast<double>(found[k]._neighbor.first);
+            }
         }
     }
+} // gatherNeighbors
+
+// factor*bound, where bound might be HUGE_VAL (no stop) or too large for DIST_T
+static DIST_T toStopThreshold(double factor, double bound) {
+    double threshold= factor*bound;
+    if (!(threshold<static_cast<double>(std::numeric_limits<DIST_T>::max()))) return std::numeric_limits<DIST_T>::max();
+    return toStopThreshold(threshold);
 }
-        
-void computeDistsAndFindMin(const double* descr,
-                            DISTANCE_T sd,
-                            const double* descr_fixed,
-                            unsigned int NBO, unsigned int CELLS_NUM, unsigned int sift_dim,
-                            unsigned int sift_num,
-                            double distRatio,
+
+// An integer distance is >= threshold iff it is >= ceil(threshold)
+static DIST_T toStopThreshold(double threshold) {
+    if (std::numeric_limits<DIST_T>::is_integer) return static_cast<DIST_T>(ceil(threshold));
+    return static_cast<DIST_T>(threshold);
+}
+
+struct MoreMass {
+    MoreMass(const DIST_T* cellsMass) : _cellsMass(cellsMass) {}
+    bool operator()(unsigned int c1, unsigned int c2) const {
+        return _cellsMass[c1]>_cellsMass[c2] || (_cellsMass[c1]==_cellsMass[c2] && c1<c2);
+    }
+    const DIST_T* _cellsMass;
+};
+
+/// For each query q (queries[q] is a descriptor), fills row q of all_dists
+/// with its distances to all descr and finds the index of the minimum.
+/// Each query has its own stop thresholds, updated when its minimum changes.
+/// descr_cellsMass is NULL, or (for prunedDist and the cascade) the cells masses
+/// of descr, where the cells masses of queries are in st._queries_masses.
+/// If collect_neighbors, the neighbors of query q are collected in st._neighbors[q].
+void computeDistsAndFindMin(ThreadState& st,
+                            const DESCR_T* descr, unsigned int sift_num,
+                            const DIST_T* descr_cellsMass,
+                            const DESCR_T* const* queries, unsigned int queries_num,
+                            bool collect_neighbors,
                             
-                            std::vector<double>& descr_fixed_otherdescr_all_dists,
-                            unsigned int& min_Ind) {
+                            DIST_T* all_dists,
+                            unsigned int* min_Inds) const {
 
-    const double* descr_i= descr;
-    descr_fixed_otherdescr_all_dists[0]= sd(descr_i, descr_fixed);
-    descr_i+= sift_dim;
-    min_Ind= 0;
+    if (_order_cells) {
+        for (unsigned int q=0; q<queries_num; ++q) {
+            unsigned int* cellsOrder= &st._cellsOrders[q*_CELLS_NUM];
+            for (unsigned int c=0; c<_CELLS_NUM; ++c) cellsOrder[c]= c;
+            std::sort(cellsOrder, cellsOrder+_CELLS_NUM, MoreMass(st._queries_masses[q]));
+        }
+    }
 
-    
-    updateStopThresholdsArr(descr_fixed_otherdescr_all_dists[min_Ind], distRatio, CELLS_NUM);
-    
-    for (unsigned int i=1; i<sift_num; ++i, descr_i+= sift_dim) {
-        
-        descr_fixed_otherdescr_all_dists[i]= sd(descr_i, descr_fixed, _stopThresholdsArr);
-	    if (descr_fixed_otherdescr_all_dists[i] <
-            descr_fixed_otherdescr_all_dists[min_Ind]) {
-            min_Ind= i;
-            updateStopThresholdsArr(descr_fixed_otherdescr_all_dists[min_Ind], distRatio, CELLS_NUM);
+    if (collect_neighbors) {
+        for (unsigned int q=0; q<queries_num; ++q) st._neighbors[q].clear();
+    }
+
+    if (_cascade) {
+        for (unsigned int q=0; q<queries_num; ++q) {
+            cascadeScan(st, q, descr, sift_num, descr_cellsMass, queries[q],
+                        collect_neighbors ? &st._neighbors[q] : NULL,
+                        all_dists + q*sift_num, min_Inds[q]);
         }
-    } // i
+        return;
+    }
+
+    ScanVisitor visitor(*this, st, sift_num, _prune ? descr_cellsMass : NULL, collect_neighbors, all_dists, min_Inds);
+    _sdb.forEachGroup(queries, queries_num, descr, sift_num,
+                      SiftDistGroup<DISTANCE_T>::lanes(st._sd),
+                      visitor);
 
 } // end computeDistsAndFindMin
 
+struct LessBound {
+    LessBound(const DIST_T* bounds) : _bounds(bounds) {}
+    bool operator()(unsigned int i1, unsigned int i2) const {
+        return _bounds[i1]<_bounds[i2] || (_bounds[i1]==_bounds[i2] && i1<i2);
+    }
+    const DIST_T* _bounds;
+};
+
+/// The lower bound of the distance of two descriptors from their cells masses
+/// (as SiftDist::cellsBound).
+static DIST_T cellsBound(const DIST_T* cellsMass1, const DIST_T* cellsMass2, unsigned int CELLS_NUM) {
+    DIST_T bound= NumTypeZero<DIST_T>::ZERO();
+    for (unsigned int c=0; c<CELLS_NUM; ++c) {
+        bound+= SiftDist<DESCR_T>::cellBound(cellsMass1[c], cellsMass2[c]);
+    }
+    return bound;
+}
+
+/// computeDistsAndFindMin of query q, with the cascade: the cells bounds of the
+/// query with all descr are computed first, the nearest by bound are computed
+/// (the first one fully) to find a small minimum, and then only the descriptors
+/// whose bound is below the last stop threshold, in increasing bound order.
+/// The others get the last stop threshold as their distance, as stopped pairs.
+void cascadeScan(ThreadState& st, unsigned int q,
+                 const DESCR_T* descr, unsigned int sift_num, const DIST_T* descr_cellsMass,
+                 const DESCR_T* query,
+                 std::vector<Neighbor>* neighbors,
+                 
+                 DIST_T* dists, unsigned int& min_Ind) const {
+
+    // Enough to find a minimum close to the final one most of the times
+    const unsigned int HEAD_SIZE= 32;
+
+    DIST_T* bounds= &st._bounds[0];
+    unsigned int* order= &st._cascadeOrder[0];
+    const DIST_T* query_cellsMass= st._queries_masses[q];
+    for (unsigned int j=0; j<sift_num; ++j) {
+        bounds[j]= cellsBound(descr_cellsMass + j*_CELLS_NUM, query_cellsMass, _CELLS_NUM);
+        order[j]= j;
+    }
+    st._cascadePairs+= sift_num;
+    DIST_T* stopThresholdsArr= st.stopThresholdsArr() + q*_CELLS_NUM;
+    const DIST_T& stopThreshold= stopThresholdsArr[_CELLS_NUM-1];
+
+    unsigned int head= myMin(sift_num, HEAD_SIZE);
+    std::partial_sort(order, order+head, order+sift_num, LessBound(bounds));
+    min_Ind= order[0];
+    dists[min_Ind]= st._sd(descr + min_Ind*_sift_dim, query);
+    if (neighbors!=NULL) addNeighbor(*neighbors, dists[min_Ind], min_Ind, NULL);
+    updateStopThresholdsArr(stopThresholdsArr, dists[min_Ind], neighbors);
+    unsigned int end= cascadeGroups(st, q, descr, descr_cellsMass, query, neighbors, order, 1, head, bounds, dists, min_Ind);
+    if (end<head) {
+        // Sorted by bound after head too, so all the others are stopped
+        for (unsigned int k=end; k<sift_num; ++k) dists[order[k]]= stopThreshold;
+        st._cascadeSkips+= sift_num-end;
+        return;
+    }
+
+    // The rest are visited only if their bound does not already stop them
+    for (unsigned int k=head; k<sift_num; ++k) {
+        if (bounds[order[k]]<stopThreshold) order[end++]= order[k];
+        else dists[order[k]]= stopThreshold;
+    }
+    st._cascadeSkips+= sift_num-end;
+    std::sort(order+head, order+end, LessBound(bounds));
+    unsigned int tail= end;
+    end= cascadeGroups(st, q, descr, descr_cellsMass, query, neighbors, order, head, tail, bounds, dists, min_Ind);
+    for (unsigned int k=end; k<tail; ++k) dists[order[k]]= stopThreshold;
+    st._cascadeSkips+= tail-end;
+
+} // cascadeScan
+
+/// Computes the distances of descr(:,order[begin..end)), in groups, until the
+/// bound of the next one reaches the last stop threshold. Returns where it stopped.
+unsigned int cascadeGroups(ThreadState& st, unsigned int q,
+                           const DESCR_T* descr, const DIST_T* descr_cellsMass,
+                           const DESCR_T* query,
+                           std::vector<Neighbor>* neighbors,
+                           const unsigned int* order, unsigned int begin, unsigned int end,
+                           const DIST_T* bounds,
+                           
+                           DIST_T* dists, unsigned int& min_Ind) const {
+
+    DIST_T* stopThresholdsArr= st.stopThresholdsArr() + q*_CELLS_NUM;
+    const unsigned int* cellsOrder= _order_cells ? &st._cellsOrders[q*_CELLS_NUM] : NULL;
+    unsigned int lanes= SiftDistGroup<DISTANCE_T>::lanes(st._sd);
+    if (lanes>SiftDistBatch::MAX_GROUP_SIZE) lanes= SiftDistBatch::MAX_GROUP_SIZE;
+    const DESCR_T* sifts1[SiftDistBatch::MAX_GROUP_SIZE];
+    const DESCR_T* sifts2[SiftDistBatch::MAX_GROUP_SIZE];
+    const DIST_T* cellsMass1[SiftDistBatch::MAX_GROUP_SIZE];
+    const DIST_T* cellsMass2[SiftDistBatch::MAX_GROUP_SIZE];
+    DIST_T group_dists[SiftDistBatch::MAX_GROUP_SIZE];
+
+    unsigned int k= begin;
+    while (k<end) {
+        unsigned int m= 0;
+        while (m<lanes && k+m<end && bounds[order[k+m]]<stopThresholdsArr[_CELLS_NUM-1]) {
+            sifts1[m]= descr + order[k+m]*_sift_dim;
+            sifts2[m]= query;
+            cellsMass1[m]= descr_cellsMass + order[k+m]*_CELLS_NUM;
+            cellsMass2[m]= st._queries_masses[q];
+            ++m;
+        }
+        if (m==0) break;
+        if (_prune) {
+            SiftDistGroup<DISTANCE_T>::prunedDists(st._sd, sifts1, sifts2, m, static_cast<const DIST_T*>(stopThresholdsArr),
+                                                   cellsMass1, cellsMass2, cellsOrder,
+                                                   group_dists);
+        } else {
+            SiftDistGroup<DISTANCE_T>::dists(st._sd, sifts1, sifts2, m, static_cast<const DIST_T*>(stopThresholdsArr),
+                                             group_dists);
+        }
+        // As in ScanVisitor, when the stop thresholds change the rest of the
+        // group is computed again. The descriptors are not in index order,
+        // so equal distances go to the smaller index.
+        unsigned int l;
+        for (l=0; l<m; ++l) {
+            unsigned int j= order[k+l];
+            dists[j]= group_dists[l];
+            bool changed= false;
+            if (dists[j]<dists[min_Ind] || (dists[j]==dists[min_Ind] && j<min_Ind)) {
+                min_Ind= j;
+                changed= true;
+            }
+            if (neighbors!=NULL && addNeighbor(*neighbors, dists[j], j, stopThresholdsArr)) changed= true;
+            if (changed && updateStopThresholdsArr(stopThresholdsArr, dists[min_Ind], neighbors)) {
+                ++l;
+                SIFT_DIST_COUNT(++st._counters.thresholdUpdates; st._counters.recomputedPairs+= m-l);
+                break;
+            }
+        }
+        k+= l;
+    }
+    return k;
+
+} // cascadeGroups
+
+struct ScanVisitor {
+
+    ScanVisitor(const SiftRatioMatcher& impl, ThreadState& st, unsigned int sift_num,
+                const DIST_T* descr_cellsMass, bool collect_neighbors,
+                DIST_T* all_dists, unsigned int* min_Inds)
+        : _impl(impl), _st(st), _sift_num(sift_num), _CELLS_NUM(impl._CELLS_NUM), _sift_dim(impl._sift_dim),
+          _descr_cellsMass(descr_cellsMass), _collect_neighbors(collect_neighbors),
+          _all_dists(all_dists), _min_Inds(min_Inds) {}
+
+    void operator()(unsigned int q, unsigned int i0, unsigned int n, const DESCR_T* descr_fixed, const DESCR_T* descr_i0) {
+
+        DIST_T* descr_fixed_otherdescr_all_dists= _all_dists + q*_sift_num;
+        unsigned int& min_Ind= _min_Inds[q];
+        DIST_T* stopThresholdsArr= _st.stopThresholdsArr();
+        if (stopThresholdsArr!=NULL) stopThresholdsArr+= q*_CELLS_NUM;
+        std::vector<Neighbor>* neighbors= _collect_neighbors ? &_st._neighbors[q] : NULL;
+
+        unsigned int i= i0;
+        const DESCR_T* descr_i= descr_i0;
+        if (i==0) {
+            descr_fixed_otherdescr_all_dists[0]= _st._sd(descr_i, descr_fixed);
+            min_Ind= 0;
+            if (neighbors!=NULL) _impl.addNeighbor(*neighbors, descr_fixed_otherdescr_all_dists[0], 0, NULL);
+            _impl.updateStopThresholdsArr(stopThresholdsArr, descr_fixed_otherdescr_all_dists[min_Ind], neighbors);
+            ++i;
+            descr_i+= _sift_dim;
+        }
+
+        const unsigned int* cellsOrder= _impl._order_cells ? &_st._cellsOrders[q*_CELLS_NUM] : NULL;
+        const DESCR_T* sifts1[SiftDistBatch::MAX_GROUP_SIZE];
+        const DESCR_T* sifts2[SiftDistBatch::MAX_GROUP_SIZE];
+        const DIST_T* cellsMass1[SiftDistBatch::MAX_GROUP_SIZE];
+        const DIST_T* cellsMass2[SiftDistBatch::MAX_GROUP_SIZE];
+        while (i<i0+n) {
+            unsigned int m= i0+n-i;
+            for (unsigned int l=0; l<m; ++l) {
+                sifts1[l]= descr_i + l*_sift_dim;
+                sifts2[l]= descr_fixed;
+            }
+            if (_descr_cellsMass!=NULL) {
+                for (unsigned int l=0; l<m; ++l) {
+                    cellsMass1[l]= _descr_cellsMass + (i+l)*_CELLS_NUM;
+                    cellsMass2[l]= _st._queries_masses[q];
+                }
+                SiftDistGroup<DISTANCE_T>::prunedDists(_st._sd, sifts1, sifts2, m, static_cast<const DIST_T*>(stopThresholdsArr),
+                                                       cellsMass1, cellsMass2, cellsOrder,
+                                                       descr_fixed_otherdescr_all_dists+i);
+            } else {
+                SiftDistGroup<DISTANCE_T>::dists(_st._sd, sifts1, sifts2, m, static_cast<const DIST_T*>(stopThresholdsArr),
+                                                 descr_fixed_otherdescr_all_dists+i);
+            }
+            // The group was computed with the same stop thresholds. A new
+            // minimum (or neighbor) changes them, so the rest of the group is
+            // computed again.
+            unsigned int l;
+            for (l=0; l<m; ++l) {
+                bool changed= false;
+                if (descr_fixed_otherdescr_all_dists[i+l] <
+                    descr_fixed_otherdescr_all_dists[min_Ind]) {
+                    min_Ind= i+l;
+                    changed= true;
+                }
+                if (neighbors!=NULL &&
+                    _impl.addNeighbor(*neighbors, descr_fixed_otherdescr_all_dists[i+l], i+l, stopThresholdsArr)) {
+                    changed= true;
+                }
+                if (changed &&
+                    _impl.updateStopThresholdsArr(stopThresholdsArr, descr_fixed_otherdescr_all_dists[min_Ind], neighbors)) {
+                    ++l;
+                    SIFT_DIST_COUNT(++_st._counters.thresholdUpdates; _st._counters.recomputedPairs+= m-l);
+                    break;
+                }
+            }
+            i+= l;
+            descr_i+= l*_sift_dim;
+        }
+    }
+
+    const SiftRatioMatcher& _impl;
+    ThreadState& _st;
+    unsigned int _sift_num, _CELLS_NUM, _sift_dim;
+    const DIST_T* _descr_cellsMass;
+    bool _collect_neighbors;
+    DIST_T* _all_dists;
+    unsigned int* _min_Inds;
+};
       
-void findMin2(unsigned int sift_dim, unsigned int sift_num,
-              const std::vector<double>& dists, unsigned int min_Ind,
-              const double* frames, int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND,
-              const std::vector<double>& radius_vec, 
-              double maxOverlap,
+/// The minimum of m and dists[begin..end), with four independent minimums
+/// so that the comparisons do not wait for each other.
+static double minOfRange(const DIST_T* dists, unsigned int begin, unsigned int end, double m) {
+    double m0= m, m1= m, m2= m, m3= m;
+    unsigned int i= begin;
+    for (; i+4<=end; i+=4) {
+        m0= dists[i]<m0 ? dists[i] : m0;
+        m1= dists[i+1]<m1 ? dists[i+1] : m1;
+        m2= dists[i+2]<m2 ? dists[i+2] : m2;
+        m3= dists[i+3]<m3 ? dists[i+3] : m3;
+    }
+    for (; i<end; ++i) m0= dists[i]<m0 ? dists[i] : m0;
+    m0= m1<m0 ? m1 : m0;
+    m2= m3<m2 ? m3 : m2;
+    return m2<m0 ? m2 : m0;
+} // minOfRange
+
+/// min2 is the minimum of dists over the frames that do not overlap the frame
+/// min_Ind by more than _maxOverlap. Only the frames that grid finds near
+/// min_Ind can overlap it, so only they are tested, and the scan of dists
+/// skips the ones that overlap (sorted at the beginning of near).
+void findMin2(unsigned int sift_num,
+              const DIST_T* dists, unsigned int min_Ind,
+              const double* frames, const std::vector<double>& radius_vec, const FramesGrid& grid,
+              ThreadState& st,
               
-              double& min2) {
+              double& min2) const {
       
       assert( sift_num==radius_vec.size() );
       assert (std::numeric_limits<double>::has_infinity);
 
-      const double min_x= *((frames+FRAMES_X_IND) + min_Ind*FRAMES_COL_SIZE);
-      const double min_y= *((frames+FRAMES_Y_IND) + min_Ind*FRAMES_COL_SIZE);
-      const double min_r= radius_vec[min_Ind];
-      
       min2= std::numeric_limits<double>::infinity();
-      for (unsigned int i=0; i<sift_num; ++i,frames+=FRAMES_COL_SIZE) {
-	    
-	    if (i==min_Ind) continue;
-	    
-	    if ( dists[i]<min2 ) {
+      // All the frames overlap at least 0
+      if (_maxOverlap<0) return;
+      
+      const double min_x= frames[min_Ind*_FRAMES_COL_SIZE+_FRAMES_X_IND];
+      const double min_y= frames[min_Ind*_FRAMES_COL_SIZE+_FRAMES_Y_IND];
+      const double min_r= radius_vec[min_Ind];
 
-		  // It's not a neighbor
-		  if (circleFuncs::circleOverlap
-		      (frames[FRAMES_X_IND], frames[FRAMES_Y_IND], radius_vec[i],
-		       min_x, min_y, min_r)<=maxOverlap) {
-			min2= dists[i];
-		  }
-		  
-	    } // < min2
-	    
-      } // i
+      // Keeps the near frames that overlap too much (min_Ind is one of them)
+      std::vector<unsigned int>& near= st._near;
+      grid.candidates(min_x, min_y, min_r, near);
+      SIFT_DIST_COUNT(st._counters.overlapTests+= near.size()-1);
+      unsigned int overlapping_num= 0;
+      for (unsigned int k=0; k<near.size(); ++k) {
+          unsigned int i= near[k];
+          const double x= frames[i*_FRAMES_COL_SIZE+_FRAMES_X_IND];
+          const double y= frames[i*_FRAMES_COL_SIZE+_FRAMES_Y_IND];
+          if (i==min_Ind ||
+              (circleFuncs::circlesMayIntersect(x, y, radius_vec[i], min_x, min_y, min_r) &&
+               !(circleFuncs::circleOverlap(x, y, radius_vec[i], min_x, min_y, min_r)<=_maxOverlap))) {
+              near[overlapping_num++]= i;
+          }
+      }
+      SIFT_DIST_COUNT(st._counters.overlapRejects+= overlapping_num-1);
+      std::sort(near.begin(), near.begin()+overlapping_num);
+
+      unsigned int begin= 0;
+      for (unsigned int k=0; k<=overlapping_num; ++k) {
+          unsigned int end= k<overlapping_num ? near[k] : sift_num;
+          min2= minOfRange(dists, begin, end, min2);
+          begin= end+1;
+      }
       
 } // findMin2
     
-    double* _stopThresholdsArr;
-    double* _stopThresholdsFactorsArr;
+    double _distRatio;
+    double _maxOverlap;
+    unsigned int _NBO, _CELLS_NUM, _sift_dim;
+    int _FRAMES_COL_SIZE, _FRAMES_X_IND, _FRAMES_Y_IND;
+    SiftDistBatch _sdb;
+    bool _prune;
+    bool _order_cells;
+    bool _cascade;
+    std::vector<double> _stopThresholdsFactorsArr;
+    size_t _reverse_scan_cache_bytes;
+    WorkStealingPool _pool;
+    std::vector<ThreadState> _states;
+    // The current match
+    SiftDescrSetView<DESCR_T> _set1;
+    SiftDescrSetView<DESCR_T> _set2;
+    unsigned int _block_size;
+    double* _inds;
+    double* _ratios;
+    SiftNeighbors* _neighbors;
+    SiftRatioMatchCounters _counters;
+
+}; // end class SiftRatioMatcher
+
+
+///@param DISTANCE_T the type of the functor that computes distances between SIFT-like descriptors.
+/// Matches descr1 to descr2 once, with a SiftRatioMatcher (see there the
+/// meaning of the parameters) on the given arrays as they are.
+/// prune_stats, if not NULL, gets the prunedDist counts of all the threads added,
+/// neighbors, if not NULL, the neighbors of each descr1 descriptor in descr2,
+/// and counters, if not NULL, gets the SiftRatioMatcher::counters() added.
+template<typename DISTANCE_T, typename DESCR_T= double>
+class SiftRatioMatchImpl {
+
+public:
+
+typedef typename SiftDistAccum<DESCR_T>::DIST_T DIST_T;
+      
+SiftRatioMatchImpl(const DESCR_T* descr1, const double* frames1, unsigned int sift_num1, 
+                   const DESCR_T* descr2, const double* frames2, unsigned int sift_num2,
+                   double distRatio,
+                   double stopThresholdsFactorGamma,
+                   unsigned int NBO, unsigned int NBP, double Magnif,
+                   double maxOverlap,
+                   const DISTANCE_T& sd,
+                   int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND, int FRAMES_SCALE_IND,
+                   
+                   double* inds, double* ratios,
+                   unsigned int threads_num= 1,
+                   size_t reverse_scan_cache_bytes= 4*1024*1024,
+                   bool prune_with_cells_bounds= false,
+                   bool order_cells_by_mass= false,
+                   SiftDistPruneStats* prune_stats= NULL,
+                   bool cascade_with_cells_bounds= false,
+                   SiftNeighbors* neighbors= NULL,
+                   SiftRatioMatchCounters* counters= NULL) {
+
+    // The cells masses are needed by both
+    bool prune= (prune_with_cells_bounds||cascade_with_cells_bounds)&&distRatio!=-1;
+    SiftDescrSetView<DESCR_T> set1, set2;
+    std::vector<double> radius1_vec, radius2_vec;
+    FramesGrid grid1, grid2;
+    std::vector<DIST_T> cellsMass1, cellsMass2;
+    prepare(descr1, frames1, sift_num1, NBO, NBP, Magnif, prune,
+            FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND, FRAMES_SCALE_IND,
+            radius1_vec, grid1, cellsMass1, set1);
+    prepare(descr2, frames2, sift_num2, NBO, NBP, Magnif, prune,
+            FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND, FRAMES_SCALE_IND,
+            radius2_vec, grid2, cellsMass2, set2);
+
+    unsigned int blocks_num= SiftRatioMatcher<DISTANCE_T, DESCR_T>::blocksNum(NBO*NBP*NBP, sift_num1, sift_num2);
+    SiftRatioMatcher<DISTANCE_T, DESCR_T>
+        matcher(distRatio, stopThresholdsFactorGamma, NBO, NBP, maxOverlap, sd,
+                FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND,
+                myMin(WorkStealingPool::resolveThreadsNum(threads_num), myMax(1u, blocks_num)),
+                reverse_scan_cache_bytes, prune_with_cells_bounds, order_cells_by_mass,
+                cascade_with_cells_bounds);
+    matcher.match(set1, set2, inds, ratios, prune_stats, neighbors);
+    if (counters!=NULL) counters->add(matcher.counters());
+      
+} // end Ctor
+
+private:
+
+/// The radiuses, grid and (if prune) cells masses of the descriptors, as a set
+static void prepare(const DESCR_T* descr, const double* frames, unsigned int sift_num,
+                    unsigned int NBO, unsigned int NBP, double Magnif, bool prune,
+                    int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND, int FRAMES_SCALE_IND,
+                    std::vector<double>& radius_vec, FramesGrid& grid, std::vector<DIST_T>& cellsMass,
+                    SiftDescrSetView<DESCR_T>& set) {
+    radius_vec.resize(sift_num);
+    if (sift_num>0) {
+        SiftDescrSet<DESCR_T>::extractRadiusesFromFrames(frames, sift_num, FRAMES_SCALE_IND, FRAMES_COL_SIZE,
+                                                         (Magnif*NBP)/2.0, &radius_vec[0]);
+    }
+    // For findMin2, which only tests the frames near the minimum
+    grid.build(frames, FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND, radius_vec);
+    if (prune && sift_num>0) {
+        cellsMass.resize(sift_num*NBP*NBP);
+        SiftDescrSet<DESCR_T>::computeCellsMasses(descr, sift_num, NBO, NBP*NBP, &cellsMass[0]);
+    }
+    set.descr= descr;
+    set.frames= frames;
+    set.num= sift_num;
+    set.radius_vec= &radius_vec;
+    set.grid= &grid;
+    set.cellsMass= cellsMass.empty() ? NULL : &cellsMass[0];
+} // prepare
 
 }; // end class SiftRatioMatchImpl
       
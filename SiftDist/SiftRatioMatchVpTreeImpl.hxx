@@ -0,0 +1,179 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_SIFT_RATIO_MATCH_VP_TREE_IMPL__HXX
+#define _OFIRPELE_SIFT_RATIO_MATCH_VP_TREE_IMPL__HXX
+
+#include "circleFuncs.hxx"
+#include "SiftDistVpTree.hxx"
+#include <vector>
+#include <limits>
+#include <cassert>
+
+
+/// Same as SiftRatioMatchImpl, but instead of scanning all the descriptors
+/// the nearest neighbors are found with a SiftDistVpTree over each set.
+/// The second nearest neighbor (that does not overlap the nearest one too
+/// much) is searched only among the neighbors_num nearest ones; if there is
+/// no such neighbor the ratio is inf. With eps>0 or max_dists_num>0 (see
+/// SiftDistVpTree::knn) the neighbors are approximate.
+/// There are no stop thresholds from distRatio, the knn search has its own.
+/// inds and ratios are assumed to be initialized to 0.
+template<typename DISTANCE_T>
+class SiftRatioMatchVpTreeImpl {
+
+public:
+      
+SiftRatioMatchVpTreeImpl(const double* descr1, const double* frames1, unsigned int sift_num1, 
+                         const double* descr2, const double* frames2, unsigned int sift_num2,
+                         double distRatio,
+                         unsigned int NBO, unsigned int NBP, double Magnif,
+                         double maxOverlap,
+                         const DISTANCE_T& sd,
+                         int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND, int FRAMES_SCALE_IND,
+                         
+                         double* inds, double* ratios,
+                         unsigned int neighbors_num= 8,
+                         double eps= 0.0, unsigned int max_dists_num= 0) {
+
+    unsigned int CELLS_NUM= NBP*NBP;
+    unsigned int sift_dim= NBO*CELLS_NUM;
+    neighbors_num= myMax(2u, neighbors_num);
+    
+    double scaleToRadiusFactor= (Magnif*NBP)/2.0;
+    std::vector<double> radius1_vec(sift_num1);
+    extractRadiusesFromFrames(frames1, FRAMES_SCALE_IND, FRAMES_COL_SIZE, scaleToRadiusFactor,
+                              radius1_vec);
+    std::vector<double> radius2_vec(sift_num2);
+    extractRadiusesFromFrames(frames2, FRAMES_SCALE_IND, FRAMES_COL_SIZE, scaleToRadiusFactor,
+                              radius2_vec);
+
+    if (sift_num1==0||sift_num2==0) return;
+    
+    SiftDistVpTree<DISTANCE_T> tree1(descr1, sift_num1, NBO, CELLS_NUM, sd);
+    SiftDistVpTree<DISTANCE_T> tree2(descr2, sift_num2, NBO, CELLS_NUM, sd);
+
+    std::vector<unsigned int> nn_inds(neighbors_num);
+    std::vector<double> nn_dists(neighbors_num);
+
+    // The search from descr2(:,j) does not depend on the descr1 query that
+    // chose j - reverse_min_Inds[j] is the nearest descr1 or NONE if not searched yet
+    const unsigned int NONE= 0xFFFFFFFFu;
+    std::vector<unsigned int> reverse_min_Inds(sift_num2, NONE);
+    std::vector<double> reverse_min2(sift_num2);
+    
+    for (unsigned int c1=0; c1<sift_num1; ++c1, ++inds, ++ratios) {
+
+        unsigned int n= tree2.knn(descr1 + c1*sift_dim, neighbors_num, &nn_inds[0], &nn_dists[0],
+                                  eps, max_dists_num);
+        unsigned int min_Ind= nn_inds[0];
+        double min_dist= nn_dists[0];
+        double min2_in_descr2= findMin2(&nn_inds[0], &nn_dists[0], n,
+                                        frames2, FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND,
+                                        radius2_vec, maxOverlap);
+
+        if (reverse_min_Inds[min_Ind]==NONE) {
+            unsigned int rn= tree1.knn(descr2 + min_Ind*sift_dim, neighbors_num, &nn_inds[0], &nn_dists[0],
+                                       eps, max_dists_num);
+            reverse_min_Inds[min_Ind]= nn_inds[0];
+            reverse_min2[min_Ind]= findMin2(&nn_inds[0], &nn_dists[0], rn,
+                                            frames1, FRAMES_COL_SIZE, FRAMES_X_IND, FRAMES_Y_IND,
+                                            radius1_vec, maxOverlap);
+        }
+        
+        // If not a symmetric nearest neighbor - *inds and *ratios will be 0
+        if (reverse_min_Inds[min_Ind]!=c1) continue;
+        double min2_in_descr1= reverse_min2[min_Ind];
+
+        //------------------------------------------
+        // Fill output (as in SiftRatioMatchImpl)
+        //------------------------------------------
+        
+        // +1 to be a Matlab index
+        *inds= min_Ind + 1;
+        
+        double min2= myMin(min2_in_descr1, min2_in_descr2);
+        if (min2==0) {
+            *ratios= 1.0;
+        } else {
+            *ratios= min2 / min_dist;
+        }
+        
+        if ((distRatio!=-1)&&((*ratios)<distRatio)) {
+            *inds= 0;
+            *ratios= 0;
+        }
+        //------------------------------------------
+        
+    } // for c1
+      
+} // end Ctor
+      
+private:
+
+void extractRadiusesFromFrames(const double* frames, int FRAMES_SCALE_IND, int FRAMES_COL_SIZE, double scaleToRadiusFactor,
+                               std::vector<double>& radius_vec) {
+      frames+= FRAMES_SCALE_IND;
+      for (unsigned int i=0; i<radius_vec.size(); ++i,frames+=FRAMES_COL_SIZE) {
+	    radius_vec[i]= (*frames) * scaleToRadiusFactor;
+      } // for i
+} // extractRadiusesFromFrames
+
+/// The nearest of nn_inds[1..n-1] (sorted by distance) whose circle does
+/// not overlap the circle of nn_inds[0] too much, or inf.
+double findMin2(const unsigned int* nn_inds, const double* nn_dists, unsigned int n,
+                const double* frames, int FRAMES_COL_SIZE, int FRAMES_X_IND, int FRAMES_Y_IND,
+                const std::vector<double>& radius_vec, 
+                double maxOverlap) {
+      
+      assert (std::numeric_limits<double>::has_infinity);
+
+      unsigned int min_Ind= nn_inds[0];
+      const double min_x= *((frames+FRAMES_X_IND) + min_Ind*FRAMES_COL_SIZE);
+      const double min_y= *((frames+FRAMES_Y_IND) + min_Ind*FRAMES_COL_SIZE);
+      const double min_r= radius_vec[min_Ind];
+      
+      for (unsigned int k=1; k<n; ++k) {
+          const double* frame= frames + nn_inds[k]*FRAMES_COL_SIZE;
+          // It's not a neighbor (circles that do not intersect overlap 0)
+          if ((maxOverlap>=0 &&
+               !circleFuncs::circlesMayIntersect(frame[FRAMES_X_IND], frame[FRAMES_Y_IND], radius_vec[nn_inds[k]],
+                                                 min_x, min_y, min_r)) ||
+              circleFuncs::circleOverlap
+              (frame[FRAMES_X_IND], frame[FRAMES_Y_IND], radius_vec[nn_inds[k]],
+               min_x, min_y, min_r)<=maxOverlap) {
+              return nn_dists[k];
+          }
+      }
+      return std::numeric_limits<double>::infinity();
+      
+} // findMin2
+
+}; // end class SiftRatioMatchVpTreeImpl
+      
+#endif
@@ -0,0 +1,194 @@
+// Copyright (2008-2009), The Hebrew University of Jerusalem.
+// All Rights Reserved.
+
+// Created by Ofir Pele
+// The Hebrew University of Jerusalem
+
+// This software for computing the SiftDist distance between histograms is being
+// made available for individual non-profit research use only. Any commercial use
+// of this software requires a license from the Hebrew University of Jerusalem.
+
+// For further details on obtaining a commercial license, contact Ofir Pele
+// (ofirpele@cs.huji.ac.il) or Yissum, the technology transfer company of the
+// Hebrew University of Jerusalem.
+
+// THE HEBREW UNIVERSITY OF JERUSALEM MAKES NO REPRESENTATIONS OR WARRANTIES OF
+// ANY KIND CONCERNING THIS SOFTWARE.
+
+// IN NO EVENT SHALL THE HEBREW UNIVERSITY OF JERUSALEM BE LIABLE TO ANY PARTY FOR
+// DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST
+// PROFITS, ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+// THE THE HEBREW UNIVERSITY OF JERUSALEM HAS BEEN ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE. THE HEBREW UNIVERSITY OF JERUSALEM SPECIFICALLY DISCLAIMS ANY
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE PROVIDED
+// HEREUNDER IS ON AN "AS IS" BASIS, AND THE HEBREW UNIVERSITY OF JERUSALEM HAS NO
+// OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+// MODIFICATIONS.
+
+#ifndef _OFIRPELE_WORK_STEALING_POOL__HXX
+#define _OFIRPELE_WORK_STEALING_POOL__HXX
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+/// A pool of threads that runs tasks 0..tasks_num-1 with work stealing.
+/// Each thread starts with a contiguous range of the tasks and takes
+/// them from its beginning. A thread that has no more tasks steals the
+/// second half of the remaining range of another thread.
+/// The thread that calls run() is thread 0, thus a pool with one thread
+/// runs everything on the calling thread without any synchronization.
+class WorkStealingPool {
+
+public:
+
+    /// @param threads_num number of threads (including the calling one).
+    /// 0 means std::thread::hardware_concurrency().
+    explicit WorkStealingPool(unsigned int threads_num= 1)
+        : _ranges(resolveThreadsNum(threads_num)),
+          _job(NULL), _job_ctx(NULL), _generation(0), _running(0), _stop(false) {
+        for (unsigned int t=1; t<_ranges.size(); ++t) {
+            _threads.push_back(std::thread(&WorkStealingPool::workerLoop, this, t));
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop= true;
+        }
+        _start_cv.notify_all();
+        for (unsigned int t=0; t<_threads.size(); ++t) _threads[t].join();
+    }
+
+    unsigned int threadsNum() const { return static_cast<unsigned int>(_ranges.size()); }
+
+    /// The number of threads a pool constructed with threads_num will have.
+    static unsigned int resolveThreadsNum(unsigned int threads_num) {
+        if (threads_num==0) threads_num= std::thread::hardware_concurrency();
+        return threads_num>0 ? threads_num : 1;
+    }
+
+    /// Calls f(thread_ind, task) for every 0<=task<tasks_num,
+    /// where 0<=thread_ind<threadsNum(). Returns when all tasks are done.
+    /// Tasks of the same thread are never run concurrently, so f can use
+    /// per thread state indexed by thread_ind.
+    template<typename FUNC>
+    void run(unsigned int tasks_num, FUNC& f) {
+
+        unsigned int threads_num= threadsNum();
+        if (threads_num==1) {
+            for (unsigned int task=0; task<tasks_num; ++task) f(0, task);
+            return;
+        }
+
+        for (unsigned int t=0; t<threads_num; ++t) {
+            _ranges[t]._begin= static_cast<unsigned int>( (static_cast<unsigned long long>(tasks_num)*t)/threads_num );
+            _ranges[t]._end=   static_cast<unsigned int>( (static_cast<unsigned long long>(tasks_num)*(t+1))/threads_num );
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job= &invoke<FUNC>;
+            _job_ctx= &f;
+            _running= threads_num-1;
+            ++_generation;
+        }
+        _start_cv.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_running>0) _done_cv.wait(lock);
+        _job= NULL;
+        _job_ctx= NULL;
+
+    } // run
+
+private:
+
+    struct Range {
+        Range() : _begin(0), _end(0) {}
+        Range(const Range&) : _begin(0), _end(0) {}
+        std::mutex _mutex;
+        unsigned int _begin, _end;
+    };
+
+    template<typename FUNC>
+    static void invoke(void* ctx, unsigned int thread_ind, unsigned int task) {
+        (*static_cast<FUNC*>(ctx))(thread_ind, task);
+    }
+
+    bool takeOwn(unsigned int t, unsigned int& task) {
+        Range& r= _ranges[t];
+        std::lock_guard<std::mutex> lock(r._mutex);
+        if (r._begin==r._end) return false;
+        task= r._begin++;
+        return true;
+    }
+
+    bool steal(unsigned int t) {
+        unsigned int threads_num= threadsNum();
+        for (unsigned int i=1; i<threads_num; ++i) {
+            Range& victim= _ranges[(t+i)%threads_num];
+            unsigned int begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim._mutex);
+                if (victim._begin==victim._end) continue;
+                begin= victim._begin + (victim._end-victim._begin)/2;
+                end= victim._end;
+                victim._end= begin;
+            }
+            Range& own= _ranges[t];
+            std::lock_guard<std::mutex> lock(own._mutex);
+            own._begin= begin;
+            own._end= end;
+            return true;
+        }
+        return false;
+    }
+
+    void work(unsigned int t) {
+        unsigned int task;
+        do {
+            while (takeOwn(t, task)) {
+                _job(_job_ctx, t, task);
+            }
+        } while (steal(t));
+    }
+
+    void workerLoop(unsigned int t) {
+        unsigned long long seen_generation= 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_stop&&_generation==seen_generation) _start_cv.wait(lock);
+                if (_stop) return;
+                seen_generation= _generation;
+            }
+            work(t);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (--_running==0) _done_cv.notify_one();
+            }
+        }
+    }
+
+    std::vector<Range> _ranges;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _start_cv, _done_cv;
+    void (*_job)(void*, unsigned int, unsigned int);
+    void* _job_ctx;
+    unsigned long long _generation;
+    unsigned int _running;
+    bool _stop;
+
+}; // end class WorkStealingPool
+
+#endif
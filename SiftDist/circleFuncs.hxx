@@ -69,6 +69,19 @@ public:
 	    
       } // circleOverlap
       //-----------------------------------------------------------------------
+
+      //-----------------------------------------------------------------------
+      // False only if the circles surely do not intersect, that is, if
+      // circleOverlap would return 0. No sqrt, and a small margin so that
+      // rounding never makes it disagree with circleOverlap.
+      static bool circlesMayIntersect(double x1, double y1, double r1,
+				      double x2, double y2, double r2) {
+	    double x1_m_x2= x1-x2;
+	    double y1_m_y2= y1-y2;
+	    double r1_p_r2= r1+r2;
+	    return !(x1_m_x2*x1_m_x2 + y1_m_y2*y1_m_y2 > r1_p_r2*r1_p_r2*(1.0+1e-9));
+      } // circlesMayIntersect
+      //-----------------------------------------------------------------------
       
 };
 
@@ -1,3 +1,6 @@
-mex -O -DNDEBUG SiftDist.cxx
-mex -O -DNDEBUG SiftRatioMatch.cxx
+% Both are thin wrappers over SiftMatch.cxx (the C++ library, see CMakeLists.txt
+% at the top folder for building it, and the mex files, with CMake), which
+% also uses EMD_MOD.hpp (SiftEmdModDist.hxx)
+mex -O -DNDEBUG -I../EMD_MOD CXXFLAGS='$CXXFLAGS -std=c++11 -pthread' LDFLAGS='$LDFLAGS -pthread' SiftDist.cxx SiftMatch.cxx
+mex -O -DNDEBUG -I../EMD_MOD CXXFLAGS='$CXXFLAGS -std=c++11 -pthread' LDFLAGS='$LDFLAGS -pthread' SiftRatioMatch.cxx SiftMatch.cxx
 
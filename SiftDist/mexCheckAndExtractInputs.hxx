@@ -32,7 +32,7 @@
 #include <mex.h>
 #include <math.h> // for pow
 
-enum distType {SiftDistType};
+enum distType {SiftDistType, EmdModType};
 
 
 class mexCheckAndExtractInputs {
@@ -312,6 +312,59 @@ static void checkAndExtract_Magnif(const mxArray* in_Magnif,
 } // end checkAndExtract_Magnif
 //----------------------------------------------------------------------------
 
+//----------------------------------------------------------------------------
+static void checkAndExtract_numThreads(const mxArray* in_numThreads,
+					 
+				       unsigned int& out_numThreads) {
+
+    if ( !( (mxIsDouble(in_numThreads))&&(!mxIsComplex(in_numThreads)) ) ) {
+        mexErrMsgTxt("NumThreads should be regular double.");
+    }
+    
+    double numThreads= static_cast<double>( (*mxGetPr(in_numThreads)) );
+    if (numThreads<0) {
+	    mexErrMsgTxt("NumThreads has to be greater or equal to zero.");
+    }
+    out_numThreads= static_cast<unsigned int>(numThreads);
+    
+} // end checkAndExtract_numThreads
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+static void checkAndExtract_neighborsK(const mxArray* in_K,
+					 
+				       unsigned int& out_K) {
+
+    if ( !( (mxIsDouble(in_K))&&(!mxIsComplex(in_K)) ) ) {
+        mexErrMsgTxt("K should be regular double.");
+    }
+    
+    double K= static_cast<double>( (*mxGetPr(in_K)) );
+    if (K<0) {
+	    mexErrMsgTxt("K has to be greater or equal to zero.");
+    }
+    out_K= static_cast<unsigned int>(K);
+    
+} // end checkAndExtract_neighborsK
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+static void checkAndExtract_neighborsRadius(const mxArray* in_Radius,
+					 
+					    double& out_Radius) {
+
+    if ( !( (mxIsDouble(in_Radius))&&(!mxIsComplex(in_Radius)) ) ) {
+        mexErrMsgTxt("Radius should be regular double.");
+    }
+    
+    out_Radius= static_cast<double>( (*mxGetPr(in_Radius)) );
+    if (!(out_Radius>=0)) {
+	    mexErrMsgTxt("Radius has to be greater or equal to zero.");
+    }
+    
+} // end checkAndExtract_neighborsRadius
+//----------------------------------------------------------------------------
+
 
 //----------------------------------------------------------------------------
 
@@ -325,8 +378,11 @@ static void checkAndExtract_distType(const mxArray* in_dt,
     case 1:
         out_dt= SiftDistType;
         break;
+    case 2:
+        out_dt= EmdModType;
+        break;
     default:
-        mexErrMsgTxt("DistType should be 1 (SiftDist)");
+        mexErrMsgTxt("DistType should be 1 (SiftDist) or 2 (EMD_MOD)");
     }
     
 } // end checkAndExtract_distType